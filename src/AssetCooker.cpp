@@ -0,0 +1,246 @@
+#define WEBGPU_CPP_IMPLEMENTATION
+#include <webgpu/webgpu.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AssetPack.hpp"
+#include "GeometryCache.hpp"
+#include "ImageLoader.hpp"
+#include "JobSystem.hpp"
+#include "Ktx2.hpp"
+#include "MipmapGenerator.hpp"
+#include "TextureCodec.hpp"
+
+// Offline half of the asset pipeline. Parses, welds, optimizes and quantizes every OBJ below
+// the asset directory into its geometry cache, and turns the textures its materials use into
+// KTX2 files with their whole mip chain: colour maps premultiplied RGBA8, normal maps BC5.
+// The App prefers the cooked files and never has to touch the sources.
+namespace {
+// bumped whenever the cooked output changes without a format version changing with it
+constexpr uint32_t COOKER_VERSION = 2;
+const fs::path DEFAULT_ASSET_DIR = "assets";
+const fs::path COOK_DATABASE_NAME = "cook.db";
+
+enum class CookResult {
+    UpToDate,
+    Cooked,
+    Failed,
+};
+
+struct CookJob {
+    fs::path source;
+    fs::path output;
+    bool normalMap = false;
+    std::vector<fs::path> inputs; // every file the output depends on, source first
+    uint64_t hash = 0;
+    CookResult result = CookResult::Failed;
+    double milliseconds = 0.0;
+    std::vector<MaterialData> materials; // geometry jobs only
+};
+
+// hash of an output's inputs as of its last cook, keyed by the output
+using CookDatabase = std::unordered_map<std::string, uint64_t>;
+
+CookDatabase LoadDatabase(const fs::path& path) {
+    CookDatabase database;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        uint64_t hash;
+        std::string output;
+        if (fields >> std::hex >> hash && std::getline(fields >> std::ws, output)) database[output] = hash;
+    }
+    return database;
+}
+
+bool SaveDatabase(const fs::path& path, const CookDatabase& database) {
+    // sorted, so the file diffs cleanly between runs
+    std::map<std::string, uint64_t> sorted(database.begin(), database.end());
+    const fs::path tempPath = UniqueTempPath(path);
+    {
+        std::ofstream out(tempPath, std::ios::trunc);
+        for (const auto& [output, hash] : sorted) out << std::hex << hash << " " << output << "\n";
+        if (!out) {
+            std::cerr << "Could not write " << path.string() << std::endl;
+            out.close();
+            std::error_code error;
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Could not write " << path.string() << ": " << error.message() << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+// content hash of the inputs together with everything that decides what the cook makes of them
+bool HashInputs(CookJob& job) {
+    std::vector<uint64_t> hashes = {COOKER_VERSION, GEOMETRY_CACHE_VERSION, job.normalMap ? 1u : 0u};
+    for (const auto& input : job.inputs) {
+        MappedFile file;
+        if (!file.Open(input)) {
+            std::cerr << "Could not read " << input.string() << std::endl;
+            return false;
+        }
+        hashes.push_back(ResourceManager::hashBytes(file.Data(), file.Size()));
+    }
+    job.hash = ResourceManager::hashBytes(hashes.data(), hashes.size() * sizeof(uint64_t));
+    return true;
+}
+
+bool IsUpToDate(const CookJob& job, const CookDatabase& database) {
+    auto it = database.find(AssetPack::Key(job.output));
+    std::error_code error;
+    return it != database.end() && it->second == job.hash && fs::exists(job.output, error);
+}
+
+CookResult CookGeometry(CookJob& job, bool upToDate) {
+    GeometryCache cache;
+    if (upToDate && cache.Load(job.source)) {
+        job.materials = cache.Materials();
+        return CookResult::UpToDate;
+    }
+    GeometryData geometry;
+    if (!ResourceManager::loadGeometryObj(job.source, geometry) || !cache.Store(job.source, geometry)) {
+        std::cerr << "Could not cook " << job.source.string() << std::endl;
+        return CookResult::Failed;
+    }
+    job.materials = cache.Materials();
+    return CookResult::Cooked;
+}
+
+CookResult CookTexture(CookJob& job, bool upToDate) {
+    if (upToDate) return CookResult::UpToDate;
+    ImageData image = ImageLoader::Load(job.source, job.normalMap);
+    if (image.pixels.empty()) return CookResult::Failed;
+    // normal maps come out of Prepare with their chain, colour maps get theirs here instead of on the GPU
+    if (image.format == TextureFormat::RGBA8Unorm && image.mips.empty()) {
+        ImageData level = image;
+        for (uint32_t mip = 1; mip < MipmapGenerator::MipLevelCount(image.width, image.height); ++mip) {
+            level = MipmapGenerator::Downsample(level);
+            image.mips.push_back(level.pixels);
+        }
+    }
+    return Ktx2::Save(job.output, image) ? CookResult::Cooked : CookResult::Failed;
+}
+
+// runs the jobs on every core and records what got cooked, true if none of them failed
+bool RunJobs(std::vector<CookJob>& jobs, CookDatabase& database, const char* kind, CookResult (*cook)(CookJob&, bool)) {
+    auto start = std::chrono::steady_clock::now();
+    JobSystem::Get().ParallelFor(jobs.size(), [&](size_t i) {
+        CookJob& job = jobs[i];
+        auto jobStart = std::chrono::steady_clock::now();
+        if (HashInputs(job)) job.result = cook(job, IsUpToDate(job, database));
+        job.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+    });
+    uint32_t counts[3] = {};
+    for (const CookJob& job : jobs) {
+        ++counts[uint32_t(job.result)];
+        if (job.result == CookResult::Cooked) {
+            database[AssetPack::Key(job.output)] = job.hash;
+            std::cout << "Cooked " << job.output.string() << " in " << job.milliseconds << " ms" << std::endl;
+        }
+        else if (job.result == CookResult::Failed) {
+            database.erase(AssetPack::Key(job.output));
+        }
+    }
+    std::cout << jobs.size() << " " << kind << ": " << counts[uint32_t(CookResult::Cooked)] << " cooked, "
+        << counts[uint32_t(CookResult::UpToDate)] << " up to date, " << counts[uint32_t(CookResult::Failed)] << " failed in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms on "
+        << JobSystem::Get().ThreadCount() << " threads" << std::endl;
+    return counts[uint32_t(CookResult::Failed)] == 0;
+}
+}
+
+int main(int argc, char** argv) {
+    // AssetCooker [asset directory] [--pack <pack> [file or directory]...]
+    fs::path assetDir = DEFAULT_ASSET_DIR;
+    int packArg = 1;
+    if (argc >= 2 && std::string(argv[1]) != "--pack") {
+        assetDir = argv[1];
+        packArg = 2;
+    }
+    const bool pack = argc > packArg && std::string(argv[packArg]) == "--pack";
+    if ((argc > packArg && !pack) || (pack && argc < packArg + 2)) {
+        std::cerr << "usage: " << argv[0] << " [asset directory] [--pack <pack> [file or directory]...]" << std::endl;
+        return 1;
+    }
+    std::error_code error;
+    if (!fs::is_directory(assetDir, error)) {
+        std::cerr << "Could not find " << assetDir.string() << std::endl;
+        return 1;
+    }
+    // cooked normal maps are BC5, devices without BC get them transcoded to RG8 at load
+    TextureCodec::SetSupport({true, false, false});
+
+    const fs::path databasePath = assetDir/COOK_DATABASE_NAME;
+    CookDatabase database = LoadDatabase(databasePath);
+
+    // geometry first, the materials of the cooked models name the textures to cook
+    std::vector<fs::path> models;
+    for (const auto& item : fs::recursive_directory_iterator(assetDir, error)) {
+        if (item.is_regular_file() && item.path().extension() == ".obj") models.push_back(item.path());
+    }
+    std::sort(models.begin(), models.end());
+    std::vector<CookJob> geometryJobs;
+    for (const auto& model : models) {
+        CookJob job;
+        job.source = model;
+        job.output = GeometryCache::CachePath(model);
+        job.inputs.push_back(model);
+        // any material library next to the model may be the one it names
+        for (const auto& item : fs::directory_iterator(model.parent_path(), error)) {
+            if (item.is_regular_file() && item.path().extension() == ".mtl") job.inputs.push_back(item.path());
+        }
+        std::sort(job.inputs.begin() + 1, job.inputs.end());
+        geometryJobs.push_back(std::move(job));
+    }
+    bool cooked = RunJobs(geometryJobs, database, "models", CookGeometry);
+
+    std::vector<CookJob> textureJobs;
+    std::map<fs::path, size_t> scheduled;
+    for (const CookJob& geometryJob : geometryJobs) {
+        for (const auto& material : geometryJob.materials) {
+            for (bool normalMap : {false, true}) {
+                const std::string& name = normalMap ? material.normalTexture : material.diffuseTexture;
+                const fs::path source = ImageLoader::ResolvePath(geometryJob.source, name, normalMap).lexically_normal();
+                // KTX2 sources are runtime ready already, a missing source has nothing to cook from
+                if (source.empty() || source.extension() == ".ktx2" || !fs::exists(source, error)) continue;
+                const fs::path output = ImageLoader::CookedPath(source, normalMap);
+                if (!scheduled.emplace(output, textureJobs.size()).second) continue;
+                CookJob job;
+                job.source = source;
+                job.output = output;
+                job.normalMap = normalMap;
+                job.inputs.push_back(source);
+                textureJobs.push_back(std::move(job));
+            }
+        }
+    }
+    cooked = RunJobs(textureJobs, database, "textures", CookTexture) && cooked;
+    SaveDatabase(databasePath, database);
+
+    if (pack) {
+        // the pack ships the cooked files only, plus whatever else was named on the command line
+        std::vector<fs::path> inputs(argv + packArg + 2, argv + argc);
+        for (const auto* jobs : {&geometryJobs, &textureJobs}) {
+            for (const CookJob& job : *jobs) {
+                if (job.result != CookResult::Failed) inputs.push_back(job.output);
+            }
+        }
+        if (!AssetPack::Build(argv[packArg + 1], inputs)) return 1;
+    }
+    return cooked ? 0 : 1;
+}
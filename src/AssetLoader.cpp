@@ -0,0 +1,86 @@
+#include <chrono>
+#include <iostream>
+#include "AssetLoader.hpp"
+#include "JobSystem.hpp"
+
+AssetLoader::AssetLoader(size_t queueCapacity) : finished(queueCapacity) {
+}
+
+MeshHandle AssetLoader::LoadMesh(const fs::path& path, ResidentCallback onResident, const MeshHandle* parent) {
+    MeshHandle handle;
+    handle.id = nextId++;
+    PendingMesh& entry = pending[handle.id];
+    entry.parent = parent != nullptr ? parent->id : 0;
+    entry.onResident = std::move(onResident);
+    handle.resident = entry.promise.get_future().share();
+
+    const uint32_t id = handle.id;
+    const VertexLayout layout = vertexLayout;
+    jobs.push_back(JobSystem::Get().Submit([this, id, path, layout]() {
+        auto result = std::make_unique<FinishedMesh>();
+        result->id = id;
+        result->payload = Mesh::LoadPayload(path, layout);
+        finished.Push(std::move(result));
+    }));
+    return handle;
+}
+
+void AssetLoader::Update(double budgetMilliseconds, const UploadFunction& upload) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<FinishedMesh> result;
+    while (finished.TryPop(result)) {
+        auto uploadStart = std::chrono::steady_clock::now();
+        Mesh* mesh = upload(result->payload);
+        UploadChildren(result->payload, *mesh, upload);
+        PendingMesh& entry = pending[result->id];
+        resident[result->id] = mesh;
+
+        auto parent = resident.find(entry.parent);
+        if (parent != resident.end()) {
+            mesh->SetParent(parent->second);
+        }
+        else if (entry.parent != 0) {
+            orphans.emplace(entry.parent, mesh);
+        }
+        if (entry.onResident) entry.onResident(*mesh);
+        auto children = orphans.equal_range(result->id);
+        for (auto it = children.first; it != children.second; ++it) {
+            it->second->SetParent(mesh);
+        }
+        orphans.erase(result->id);
+        entry.promise.set_value(mesh);
+        pending.erase(result->id);
+
+        auto now = std::chrono::steady_clock::now();
+        std::cout << result->payload.path.string() << ": uploaded in "
+            << std::chrono::duration<double, std::milli>(now - uploadStart).count() << " ms" << std::endl;
+        if (std::chrono::duration<double, std::milli>(now - start).count() >= budgetMilliseconds) break;
+    }
+}
+
+void AssetLoader::UploadChildren(const MeshPayload& payload, Mesh& mesh, const UploadFunction& upload) {
+    // scene nodes go up with their root, parents before children
+    for (const MeshPayload& child : payload.children) {
+        Mesh* childMesh = upload(child);
+        childMesh->SetParent(&mesh);
+        UploadChildren(child, *childMesh, upload);
+    }
+}
+
+bool AssetLoader::IsIdle() const {
+    return pending.empty();
+}
+
+void AssetLoader::SetVertexLayout(VertexLayout layout) {
+    vertexLayout = layout;
+}
+
+void AssetLoader::Shutdown() {
+    // unblock workers waiting on a full queue, their payloads are dropped
+    finished.Close();
+    for (auto& job : jobs) {
+        job.wait();
+    }
+    jobs.clear();
+    pending.clear();
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "BoundedQueue.hpp"
+#include "Mesh.hpp"
+
+struct MeshHandle {
+    uint32_t id = 0;
+    std::shared_future<Mesh*> resident;
+};
+
+// Reads, parses and decodes assets on the job system. Finished CPU payloads travel through
+// a bounded queue to the render thread, which uploads them under a per frame time budget.
+// A glTF file arrives as one payload tree, its nodes become children of the returned mesh.
+class AssetLoader {
+public:
+    using UploadFunction = std::function<Mesh*(const MeshPayload& payload)>;
+    using ResidentCallback = std::function<void(Mesh& mesh)>;
+
+    explicit AssetLoader(size_t queueCapacity = 4);
+    MeshHandle LoadMesh(const fs::path& path, ResidentCallback onResident = nullptr, const MeshHandle* parent = nullptr);
+    // uploads finished payloads until the budget is spent, at least one per call
+    void Update(double budgetMilliseconds, const UploadFunction& upload);
+    bool IsIdle() const;
+    // vertex layout payloads are prepared in, set before the first LoadMesh
+    void SetVertexLayout(VertexLayout layout);
+    void Shutdown();
+
+private:
+    struct FinishedMesh {
+        uint32_t id;
+        MeshPayload payload;
+    };
+    struct PendingMesh {
+        uint32_t parent = 0;
+        ResidentCallback onResident;
+        std::promise<Mesh*> promise;
+    };
+    BoundedQueue<std::unique_ptr<FinishedMesh>> finished;
+    std::unordered_map<uint32_t, PendingMesh> pending;
+    std::unordered_map<uint32_t, Mesh*> resident;
+    // children that became resident before their parent
+    std::unordered_multimap<uint32_t, Mesh*> orphans;
+    std::vector<std::future<void>> jobs;
+    uint32_t nextId = 1;
+    VertexLayout vertexLayout = VertexLayout::Full;
+
+    static void UploadChildren(const MeshPayload& payload, Mesh& mesh, const UploadFunction& upload);
+};
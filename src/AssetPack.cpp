@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "AssetPack.hpp"
+#include "JobSystem.hpp"
+#include "Lz4.hpp"
+
+namespace {
+constexpr char PACK_MAGIC[4] = {'W', 'P', 'A', 'K'};
+// uncompressed entries start on page boundaries, mapped views of them are page aligned
+constexpr uint64_t PACK_ALIGNMENT = 4096;
+// entries are compressed when that saves at least an eighth, PNG and JPG usually don't
+constexpr uint64_t MIN_SAVING_DIVISOR = 8;
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+template <typename T>
+void WriteValue(std::vector<uint8_t>& out, const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void WriteString(std::vector<uint8_t>& out, const std::string& value) {
+    WriteValue(out, static_cast<uint32_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool ReadBytes(const uint8_t*& p, const uint8_t* end, void* out, size_t count) {
+    if (size_t(end - p) < count) return false;
+    std::memcpy(out, p, count);
+    p += count;
+    return true;
+}
+
+bool ReadString(const uint8_t*& p, const uint8_t* end, std::string& value) {
+    uint32_t length;
+    if (!ReadBytes(p, end, &length, sizeof(length)) || size_t(end - p) < length) return false;
+    value.assign(reinterpret_cast<const char*>(p), length);
+    p += length;
+    return true;
+}
+}
+
+std::string AssetPack::Key(const fs::path& path) {
+    fs::path normal = path.lexically_normal();
+    if (normal.is_absolute()) {
+        std::error_code error;
+        const fs::path relative = normal.lexically_relative(fs::current_path(error));
+        if (!relative.empty() && *relative.begin() != "..") normal = relative;
+    }
+    return normal.generic_u8string();
+}
+
+bool AssetPack::Build(const fs::path& packPath, const std::vector<fs::path>& inputs) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<fs::path> files;
+    std::error_code error;
+    for (const auto& input : inputs) {
+        if (fs::is_directory(input, error)) {
+            for (const auto& item : fs::recursive_directory_iterator(input, error)) {
+                if (item.is_regular_file()) files.push_back(item.path());
+            }
+        }
+        else if (fs::is_regular_file(input, error)) {
+            files.push_back(input);
+        }
+        else {
+            std::cerr << "Could not find " << input.string() << std::endl;
+            return false;
+        }
+    }
+    // the pack may sit below one of the inputs, an older one must not end up inside the new one
+    files.erase(std::remove_if(files.begin(), files.end(), [&](const fs::path& file) {
+        return fs::equivalent(file, packPath, error);
+    }), files.end());
+
+    struct PackedFile {
+        std::string key;
+        MappedFile source;
+        std::vector<uint8_t> block; // empty when stored uncompressed
+        bool read = false;
+    };
+    std::vector<PackedFile> packed(files.size());
+    JobSystem::Get().ParallelFor(files.size(), [&](size_t i) {
+        PackedFile& file = packed[i];
+        file.key = Key(files[i]);
+        file.read = file.source.Open(files[i]);
+        if (!file.read || file.source.Size() == 0) return;
+        std::vector<uint8_t> block = Lz4::Compress(file.source.Data(), file.source.Size());
+        if (block.size() <= file.source.Size() - file.source.Size() / MIN_SAVING_DIVISOR) file.block = std::move(block);
+    });
+    std::sort(packed.begin(), packed.end(), [](const PackedFile& a, const PackedFile& b) { return a.key < b.key; });
+    packed.erase(std::unique(packed.begin(), packed.end(), [](const PackedFile& a, const PackedFile& b) {
+        return a.key == b.key;
+    }), packed.end());
+
+    // write to a temporary file first so a crash never leaves a half written pack behind
+    const fs::path tempPath = UniqueTempPath(packPath);
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    AssetPackHeader header = {};
+    std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = ASSET_PACK_VERSION;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+    uint64_t sourceBytes = 0;
+    uint32_t compressedCount = 0;
+    std::vector<uint8_t> toc;
+    const std::vector<char> padding(PACK_ALIGNMENT, 0);
+    for (const PackedFile& file : packed) {
+        if (!file.read) {
+            std::cerr << "Could not read " << file.key << ", left out of the pack" << std::endl;
+            continue;
+        }
+        AssetPackEntry entry;
+        entry.size = file.source.Size();
+        entry.compression = file.block.empty() ? PackCompression::None : PackCompression::Lz4;
+        entry.storedSize = file.block.empty() ? entry.size : file.block.size();
+        entry.offset = entry.compression == PackCompression::None ? AlignUp(offset, PACK_ALIGNMENT) : offset;
+        out.write(padding.data(), std::streamsize(entry.offset - offset));
+        out.write(reinterpret_cast<const char*>(file.block.empty() ? file.source.Data() : file.block.data()),
+            std::streamsize(entry.storedSize));
+        offset = entry.offset + entry.storedSize;
+        sourceBytes += entry.size;
+        if (entry.compression == PackCompression::Lz4) ++compressedCount;
+        WriteString(toc, file.key);
+        WriteValue(toc, entry.offset);
+        WriteValue(toc, entry.storedSize);
+        WriteValue(toc, entry.size);
+        WriteValue(toc, entry.compression);
+        ++header.entryCount;
+    }
+    header.tocOffset = offset;
+    header.tocSize = toc.size();
+    out.write(reinterpret_cast<const char*>(toc.data()), std::streamsize(toc.size()));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        std::cerr << "Could not write asset pack " << packPath.string() << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    fs::rename(tempPath, packPath, error);
+    if (error) {
+        std::cerr << "Could not write asset pack " << packPath.string() << ": " << error.message() << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    std::cout << packPath.string() << ": " << header.entryCount << " files (" << compressedCount << " compressed), "
+        << sourceBytes / 1024 << " KB -> " << (offset + toc.size()) / 1024 << " KB in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    return true;
+}
+
+bool AssetPack::Open(const fs::path& path) {
+    entries.clear();
+    if (!file.Open(path)) {
+        std::cerr << "Could not open " << path.string() << std::endl;
+        return false;
+    }
+    const uint8_t* data = file.Data();
+    const size_t size = file.Size();
+    AssetPackHeader header = {};
+    if (size >= sizeof(header)) std::memcpy(&header, data, sizeof(header));
+    if (size < sizeof(header) || std::memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0) {
+        std::cerr << path.string() << " is not an asset pack" << std::endl;
+        file.Close();
+        return false;
+    }
+    if (header.version != ASSET_PACK_VERSION) {
+        std::cerr << path.string() << ": pack version " << header.version << ", expected " << ASSET_PACK_VERSION << std::endl;
+        file.Close();
+        return false;
+    }
+    bool valid = header.tocOffset <= size && header.tocSize <= size - header.tocOffset;
+    const uint8_t* p = data + (valid ? header.tocOffset : 0);
+    const uint8_t* end = valid ? p + header.tocSize : p;
+    for (uint32_t i = 0; valid && i < header.entryCount; ++i) {
+        std::string key;
+        AssetPackEntry entry;
+        valid = ReadString(p, end, key) && ReadBytes(p, end, &entry.offset, sizeof(entry.offset)) &&
+            ReadBytes(p, end, &entry.storedSize, sizeof(entry.storedSize)) && ReadBytes(p, end, &entry.size, sizeof(entry.size)) &&
+            ReadBytes(p, end, &entry.compression, sizeof(entry.compression));
+        // entries must lie before the table and uncompressed ones are used in place
+        valid = valid && entry.offset <= header.tocOffset && entry.storedSize <= header.tocOffset - entry.offset &&
+            (entry.compression == PackCompression::Lz4 || (entry.compression == PackCompression::None && entry.storedSize == entry.size));
+        if (valid) entries.emplace(std::move(key), entry);
+    }
+    if (!valid) {
+        std::cerr << path.string() << ": corrupt table of contents" << std::endl;
+        entries.clear();
+        file.Close();
+        return false;
+    }
+    std::cout << "Mounted " << path.string() << " (" << entries.size() << " files)" << std::endl;
+    return true;
+}
+
+const AssetPackEntry* AssetPack::Find(const std::string& key) const {
+    auto it = entries.find(key);
+    return it != entries.end() ? &it->second : nullptr;
+}
+
+const uint8_t* AssetPack::EntryData(const AssetPackEntry& entry) const {
+    return file.Data() + entry.offset;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.hpp"
+
+// Bumped whenever the pack layout changes
+constexpr uint32_t ASSET_PACK_VERSION = 1;
+
+enum class PackCompression : uint32_t {
+    None,
+    Lz4,
+};
+
+struct AssetPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t tocOffset;
+    uint64_t tocSize;
+};
+
+struct AssetPackEntry {
+    uint64_t offset;
+    uint64_t storedSize;
+    uint64_t size;
+    PackCompression compression;
+};
+
+// Single file holding the assets of a deployment: a header, the entries and a table of
+// contents at the end. Entries that compress well are stored as LZ4 blocks, the others
+// start on 4 KB boundaries so they can be used straight from the mapping.
+class AssetPack {
+public:
+    // the name an asset is stored and looked up under, relative to the working directory
+    static std::string Key(const fs::path& path);
+    // packs the files and the files below the directories in inputs
+    static bool Build(const fs::path& packPath, const std::vector<fs::path>& inputs);
+
+    bool Open(const fs::path& path);
+    const AssetPackEntry* Find(const std::string& key) const;
+    // stored bytes of an entry, compressed ones still need Lz4::Decompress
+    const uint8_t* EntryData(const AssetPackEntry& entry) const;
+
+private:
+    MappedFile file;
+    std::unordered_map<std::string, AssetPackEntry> entries;
+};
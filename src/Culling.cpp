@@ -0,0 +1,119 @@
+#include "Culling.hpp"
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE2 1
+#endif
+
+namespace {
+glm::vec4 Normalized(const glm::vec4& plane) {
+    const float length = glm::length(glm::vec3(plane));
+    return length > 0.0f ? plane / length : plane;
+}
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4x4& viewProjection) {
+    // Gribb and Hartmann, every plane is a sum of rows of the matrix
+    const glm::mat4x4 m = glm::transpose(viewProjection);
+    Frustum frustum;
+    frustum.planes[0] = Normalized(m[3] + m[0]);  // left
+    frustum.planes[1] = Normalized(m[3] - m[0]);  // right
+    frustum.planes[2] = Normalized(m[3] + m[1]);  // bottom
+    frustum.planes[3] = Normalized(m[3] - m[1]);  // top
+    frustum.planes[4] = Normalized(m[2]);         // near
+    frustum.planes[5] = Normalized(m[3] - m[2]);  // far
+    return frustum;
+}
+
+Frustum Frustum::Transformed(const glm::mat4x4& model) const {
+    const glm::mat4x4 transposed = glm::transpose(model);
+    Frustum frustum;
+    for (int i = 0; i < 6; ++i) frustum.planes[i] = Normalized(transposed * planes[i]);
+    return frustum;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const {
+    for (const glm::vec4& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool ConeBackFacing(const glm::vec3& center, float radius, const glm::vec3& coneAxis, float coneCutoff,
+    const glm::vec3& cameraPosition) {
+    const glm::vec3 view = center - cameraPosition;
+    return glm::dot(view, coneAxis) >= coneCutoff * glm::length(view) + radius;
+}
+
+void SphereBatch::Clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+}
+
+uint32_t SphereBatch::Add(const glm::vec3& center, float radius) {
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    this->radius.push_back(radius);
+    return uint32_t(x.size() - 1);
+}
+
+size_t SphereBatch::Size() const {
+    return x.size();
+}
+
+size_t SphereBatch::Cull(const Frustum& frustum, std::vector<uint8_t>& visible) const {
+    const size_t count = x.size();
+    visible.resize(count);
+    size_t visibleCount = 0;
+    size_t i = 0;
+    // a sphere is out once it lies behind any plane by more than its radius
+#if defined(CULLING_AVX)
+    for (; i + 8 <= count; i += 8) {
+        const __m256 cx = _mm256_loadu_ps(&x[i]);
+        const __m256 cy = _mm256_loadu_ps(&y[i]);
+        const __m256 cz = _mm256_loadu_ps(&z[i]);
+        const __m256 r = _mm256_loadu_ps(&radius[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_set1_ps(plane.w));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(cy, _mm256_set1_ps(plane.y)));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(cz, _mm256_set1_ps(plane.z)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        const int mask = _mm256_movemask_ps(inside);
+        for (int lane = 0; lane < 8; ++lane) {
+            visible[i + lane] = uint8_t((mask >> lane) & 1);
+            visibleCount += visible[i + lane];
+        }
+    }
+#elif defined(CULLING_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        const __m128 cx = _mm_loadu_ps(&x[i]);
+        const __m128 cy = _mm_loadu_ps(&y[i]);
+        const __m128 cz = _mm_loadu_ps(&z[i]);
+        const __m128 r = _mm_loadu_ps(&radius[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+            distance = _mm_add_ps(distance, _mm_mul_ps(cy, _mm_set1_ps(plane.y)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(cz, _mm_set1_ps(plane.z)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), _mm_setzero_ps()));
+        }
+        const int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; ++lane) {
+            visible[i + lane] = uint8_t((mask >> lane) & 1);
+            visibleCount += visible[i + lane];
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        visible[i] = frustum.IntersectsSphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
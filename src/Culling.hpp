@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// view frustum as six inward facing planes, xyz is the unit normal and w the distance
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // from a view projection matrix with WebGPU's 0 to w clip depth
+    static Frustum FromMatrix(const glm::mat4x4& viewProjection);
+    // the same frustum in the space model maps from
+    Frustum Transformed(const glm::mat4x4& model) const;
+    bool IntersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+// true when the camera sees the back of every triangle in the cone's cluster
+bool ConeBackFacing(const glm::vec3& center, float radius, const glm::vec3& coneAxis, float coneCutoff,
+    const glm::vec3& cameraPosition);
+
+// meshlet culling results of one frame
+struct MeshletCullStats {
+    uint32_t total = 0;
+    uint32_t frustumCulled = 0;
+    uint32_t backfaceCulled = 0;
+};
+
+// World space bounding spheres kept as structure of arrays, so Cull tests the six planes
+// against a whole SIMD register of spheres at once: AVX where the compiler targets it,
+// SSE2 otherwise, scalar for the tail.
+class SphereBatch {
+public:
+    void Clear();
+    // returns the index the sphere's result has in Cull's output
+    uint32_t Add(const glm::vec3& center, float radius);
+    size_t Size() const;
+    // visible[i] is 1 for every sphere touching the frustum, returns how many do
+    size_t Cull(const Frustum& frustum, std::vector<uint8_t>& visible) const;
+
+private:
+    std::vector<float> x, y, z, radius;
+};
+
+// whole mesh culling results of one frame
+struct ObjectCullStats {
+    uint32_t total = 0;
+    uint32_t culled = 0;
+    uint32_t occluded = 0;
+};
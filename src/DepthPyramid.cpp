@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <iostream>
+#include "DepthPyramid.hpp"
+#include "MipmapGenerator.hpp"
+#include "ResourceManager.hpp"
+
+bool DepthPyramid::Initialize(Device device, Texture depthTexture) {
+    width = depthTexture.getWidth();
+    height = depthTexture.getHeight();
+    const uint32_t levelCount = MipmapGenerator::MipLevelCount(width, height);
+
+    // the copy reads the depth buffer at binding 0, the reduction the level above at binding 1
+    std::vector<BindGroupLayoutEntry> bindingLayoutEntries(2, Default);
+    bindingLayoutEntries[0].binding = 0;
+    bindingLayoutEntries[0].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[0].texture.sampleType = TextureSampleType::Depth;
+    bindingLayoutEntries[0].texture.viewDimension = TextureViewDimension::_2D;
+
+    bindingLayoutEntries[1].binding = 2;
+    bindingLayoutEntries[1].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[1].storageTexture.access = StorageTextureAccess::WriteOnly;
+    bindingLayoutEntries[1].storageTexture.format = TextureFormat::R32Float;
+    bindingLayoutEntries[1].storageTexture.viewDimension = TextureViewDimension::_2D;
+
+    BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+    bindGroupLayoutDesc.entryCount = bindingLayoutEntries.size();
+    bindGroupLayoutDesc.entries = bindingLayoutEntries.data();
+    copyBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+
+    bindingLayoutEntries[0] = Default;
+    bindingLayoutEntries[0].binding = 1;
+    bindingLayoutEntries[0].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[0].texture.sampleType = TextureSampleType::UnfilterableFloat;
+    bindingLayoutEntries[0].texture.viewDimension = TextureViewDimension::_2D;
+    reduceBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+
+    ShaderModule shaderModule = ResourceManager::loadShaderModule("src/pyramid.wgsl", device);
+    if (shaderModule == nullptr) {
+        std::cerr << "Could not load depth pyramid shader!" << std::endl;
+        return false;
+    }
+    PipelineLayoutDescriptor layoutDesc{};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout*)&copyBindGroupLayout;
+    PipelineLayout copyLayout = device.createPipelineLayout(layoutDesc);
+    layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout*)&reduceBindGroupLayout;
+    PipelineLayout reduceLayout = device.createPipelineLayout(layoutDesc);
+
+    ComputePipelineDescriptor pipelineDesc;
+    pipelineDesc.label = "Depth pyramid copy pipeline";
+    pipelineDesc.layout = copyLayout;
+    pipelineDesc.compute.module = shaderModule;
+    pipelineDesc.compute.entryPoint = "cs_copy";
+    pipelineDesc.compute.constantCount = 0;
+    pipelineDesc.compute.constants = nullptr;
+    copyPipeline = device.createComputePipeline(pipelineDesc);
+    pipelineDesc.label = "Depth pyramid reduce pipeline";
+    pipelineDesc.layout = reduceLayout;
+    pipelineDesc.compute.entryPoint = "cs_reduce";
+    reducePipeline = device.createComputePipeline(pipelineDesc);
+    shaderModule.release();
+    copyLayout.release();
+    reduceLayout.release();
+
+    TextureDescriptor textureDesc;
+    textureDesc.label = "depth pyramid";
+    textureDesc.dimension = TextureDimension::_2D;
+    textureDesc.format = TextureFormat::R32Float;
+    textureDesc.mipLevelCount = levelCount;
+    textureDesc.sampleCount = 1;
+    textureDesc.size = {width, height, 1};
+    textureDesc.usage = TextureUsage::StorageBinding | TextureUsage::TextureBinding;
+    textureDesc.viewFormatCount = 0;
+    textureDesc.viewFormats = nullptr;
+    texture = device.createTexture(textureDesc);
+
+    TextureViewDescriptor viewDesc;
+    viewDesc.aspect = TextureAspect::All;
+    viewDesc.baseArrayLayer = 0;
+    viewDesc.arrayLayerCount = 1;
+    viewDesc.baseMipLevel = 0;
+    viewDesc.mipLevelCount = levelCount;
+    viewDesc.dimension = TextureViewDimension::_2D;
+    viewDesc.format = TextureFormat::R32Float;
+    view = texture.createView(viewDesc);
+    viewDesc.mipLevelCount = 1;
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        viewDesc.baseMipLevel = level;
+        levelViews.push_back(texture.createView(viewDesc));
+    }
+    viewDesc.aspect = TextureAspect::DepthOnly;
+    viewDesc.baseMipLevel = 0;
+    viewDesc.format = depthTexture.getFormat();
+    depthView = depthTexture.createView(viewDesc);
+
+    // the chain never changes, its bind groups are made once
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        std::vector<BindGroupEntry> bindings(2);
+        bindings[0].binding = level == 0 ? 0 : 1;
+        bindings[0].textureView = level == 0 ? depthView : levelViews[level - 1];
+        bindings[1].binding = 2;
+        bindings[1].textureView = levelViews[level];
+
+        BindGroupDescriptor bindGroupDesc;
+        bindGroupDesc.layout = level == 0 ? copyBindGroupLayout : reduceBindGroupLayout;
+        bindGroupDesc.entryCount = bindings.size();
+        bindGroupDesc.entries = bindings.data();
+        bindGroups.push_back(device.createBindGroup(bindGroupDesc));
+    }
+    return true;
+}
+
+void DepthPyramid::Terminate() {
+    for (auto& bindGroup : bindGroups) bindGroup.release();
+    bindGroups.clear();
+    for (auto& levelView : levelViews) levelView.release();
+    levelViews.clear();
+    if (depthView) depthView.release();
+    if (view) view.release();
+    if (texture) {
+        texture.destroy();
+        texture.release();
+    }
+    if (copyPipeline) copyPipeline.release();
+    if (reducePipeline) reducePipeline.release();
+    if (copyBindGroupLayout) copyBindGroupLayout.release();
+    if (reduceBindGroupLayout) reduceBindGroupLayout.release();
+}
+
+void DepthPyramid::Build(ComputePassEncoder computePass) const {
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+    for (uint32_t level = 0; level < bindGroups.size(); ++level) {
+        if (level > 0) {
+            levelWidth = std::max(1u, levelWidth / 2);
+            levelHeight = std::max(1u, levelHeight / 2);
+        }
+        // each dispatch sees the level written by the previous one
+        computePass.setPipeline(level == 0 ? copyPipeline : reducePipeline);
+        computePass.setBindGroup(0, bindGroups[level], 0, nullptr);
+        computePass.dispatchWorkgroups((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+    }
+}
+
+TextureView DepthPyramid::GetView() const {
+    return view;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <cstdint>
+#include <vector>
+
+using namespace wgpu;
+
+// Hierarchical Z of the depth buffer, built in compute. Level 0 copies the depth and every
+// level after it keeps the farthest depth of the texels below, so anything whose nearest
+// depth lies behind the farthest of the few texels its screen rectangle touches is hidden.
+class DepthPyramid {
+public:
+    // depthTexture needs TextureBinding on top of RenderAttachment, false when the shader could not be loaded
+    bool Initialize(Device device, Texture depthTexture);
+    void Terminate();
+    // records the whole chain into computePass, after the pass that wrote the depth
+    void Build(ComputePassEncoder computePass) const;
+    // every level, for textureLoad
+    TextureView GetView() const;
+
+private:
+    Texture texture;
+    TextureView view;
+    TextureView depthView;
+    std::vector<TextureView> levelViews;
+    std::vector<BindGroup> bindGroups; // one per level, level 0 reads the depth buffer
+    ComputePipeline copyPipeline, reducePipeline;
+    BindGroupLayout copyBindGroupLayout, reduceBindGroupLayout;
+    uint32_t width = 0, height = 0;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Elements of a CPU array changed since its last upload. Flush hands them out as runs so
+// neighbouring changes go up in one write; a run bridges up to maxGap clean elements, a few
+// of those cost less than another write.
+class DirtyRanges {
+public:
+    void Mark(uint32_t index) {
+        if (!all) indices.push_back(index);
+    }
+
+    // everything goes up on the next Flush, e.g. into a freshly created buffer
+    void MarkAll() {
+        all = true;
+        indices.clear();
+    }
+
+    // calls write(first, count) for every run below end, then starts over
+    template<typename Write>
+    void Flush(uint32_t end, uint32_t maxGap, Write&& write) {
+        if (all) {
+            if (end > 0) write(0u, end);
+            all = false;
+            return;
+        }
+        if (indices.empty()) return;
+        // elements past the end were removed after they were marked
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+        indices.erase(std::lower_bound(indices.begin(), indices.end(), end), indices.end());
+        size_t i = 0;
+        while (i < indices.size()) {
+            const uint32_t first = indices[i];
+            uint32_t last = first;
+            while (++i < indices.size() && indices[i] - last <= maxGap + 1) last = indices[i];
+            write(first, last - first + 1);
+        }
+        indices.clear();
+    }
+
+private:
+    std::vector<uint32_t> indices;
+    bool all = false;
+};
@@ -0,0 +1,322 @@
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include "GeometryCache.hpp"
+
+using namespace wgpu;
+
+namespace {
+constexpr char CACHE_MAGIC[4] = {'G', 'E', 'O', 'C'};
+
+size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void WriteString(std::vector<uint8_t>& out, const std::string& value) {
+    uint32_t length = static_cast<uint32_t>(value.size());
+    out.insert(out.end(), reinterpret_cast<const uint8_t*>(&length), reinterpret_cast<const uint8_t*>(&length) + sizeof(length));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool ReadBytes(const uint8_t*& p, const uint8_t* end, void* out, size_t count) {
+    if (size_t(end - p) < count) return false;
+    std::memcpy(out, p, count);
+    p += count;
+    return true;
+}
+
+// names on the mtllib lines of an .obj, in file order
+std::vector<std::string> MaterialLibraries(const uint8_t* data, size_t size) {
+    std::vector<std::string> libraries;
+    const char* p = reinterpret_cast<const char*>(data);
+    const char* end = p + size;
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (lineEnd == nullptr) lineEnd = end;
+        while (p < lineEnd && (*p == ' ' || *p == '\t')) ++p;
+        if (lineEnd - p > 7 && std::memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+            const char* first = p + 7;
+            const char* last = lineEnd;
+            while (first < last && (*first == ' ' || *first == '\t')) ++first;
+            while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) --last;
+            if (first < last) libraries.emplace_back(first, last);
+        }
+        p = lineEnd + 1;
+    }
+    return libraries;
+}
+
+bool ReadString(const uint8_t*& p, const uint8_t* end, std::string& value) {
+    uint32_t length;
+    if (!ReadBytes(p, end, &length, sizeof(length)) || size_t(end - p) < length) return false;
+    value.assign(reinterpret_cast<const char*>(p), length);
+    p += length;
+    return true;
+}
+}
+
+fs::path GeometryCache::CachePath(const fs::path& sourcePath) {
+    fs::path cachePath = sourcePath;
+    cachePath += ".geomcache";
+    return cachePath;
+}
+
+bool GeometryCache::HashSource(const fs::path& sourcePath, uint64_t& hash) {
+    VfsFile source;
+    if (!Vfs::Open(sourcePath, source)) return false;
+    // the materials come from the libraries the model names, an edit there is an edit of the model
+    std::vector<uint64_t> hashes = {ResourceManager::hashBytes(source.Data(), source.Size())};
+    for (const std::string& library : MaterialLibraries(source.Data(), source.Size())) {
+        VfsFile file;
+        // a missing library hashes as empty, so adding it later rebuilds the cache too
+        hashes.push_back(Vfs::Open(sourcePath.parent_path() / fs::u8path(library), file) ? ResourceManager::hashBytes(file.Data(), file.Size()) : 0);
+    }
+    hash = ResourceManager::hashBytes(hashes.data(), hashes.size() * sizeof(uint64_t));
+    return true;
+}
+
+std::vector<uint8_t> GeometryCache::EncodeMaterials(const std::vector<MaterialData>& materials) {
+    std::vector<uint8_t> out;
+    for (const auto& material : materials) {
+        const uint8_t* diffuse = reinterpret_cast<const uint8_t*>(&material.diffuse);
+        out.insert(out.end(), diffuse, diffuse + sizeof(glm::vec3));
+        WriteString(out, material.name);
+        WriteString(out, material.diffuseTexture);
+        WriteString(out, material.normalTexture);
+    }
+    return out;
+}
+
+bool GeometryCache::DecodeMaterials(const uint8_t* data, size_t size, std::vector<MaterialData>& materials) {
+    materials.clear();
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    while (p < end) {
+        MaterialData material;
+        if (!ReadBytes(p, end, &material.diffuse, sizeof(glm::vec3)) || !ReadString(p, end, material.name) ||
+            !ReadString(p, end, material.diffuseTexture) || !ReadString(p, end, material.normalTexture)) {
+            return false;
+        }
+        materials.push_back(material);
+    }
+    return true;
+}
+
+bool GeometryCache::Validate(const uint8_t* data, size_t size, const uint64_t* sourceHash) {
+    if (data == nullptr || size < sizeof(GeometryCacheHeader)) return false;
+    GeometryCacheHeader header;
+    std::memcpy(&header, data, sizeof(GeometryCacheHeader));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return false;
+    if (header.version != GEOMETRY_CACHE_VERSION || (sourceHash != nullptr && header.sourceHash != *sourceHash)) return false;
+    if (header.payloadSize != size - sizeof(GeometryCacheHeader)) return false;
+    for (uint32_t section = 0; section < SECTION_COUNT; ++section) {
+        if (header.sectionOffsets[section] < sizeof(GeometryCacheHeader) || header.sectionOffsets[section] % 16 != 0 ||
+            header.sectionOffsets[section] > size || header.sectionSizes[section] > size - header.sectionOffsets[section]) {
+            return false;
+        }
+    }
+    const uint64_t indexStride = header.indexFormat == IndexFormat::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    if (header.sectionSizes[SECTION_VERTICES] != uint64_t(header.vertexCount) * sizeof(VertexAttributes) ||
+        header.sectionSizes[SECTION_PACKED_VERTICES] != uint64_t(header.vertexCount) * sizeof(PackedVertex) ||
+        header.sectionSizes[SECTION_INDICES] < uint64_t(header.indexCount) * indexStride ||
+        header.sectionSizes[SECTION_SUBMESHES] % sizeof(Submesh) != 0 ||
+        header.sectionSizes[SECTION_LODS] % sizeof(MeshLod) != 0 || header.sectionSizes[SECTION_MESHLETS] % sizeof(Meshlet) != 0) {
+        return false;
+    }
+    if (ResourceManager::hashBytes(data + sizeof(GeometryCacheHeader), header.payloadSize) != header.payloadHash) return false;
+    // ranges must stay inside the index buffer before they are handed to draw calls
+    std::vector<Submesh> submeshes(header.sectionSizes[SECTION_SUBMESHES] / sizeof(Submesh));
+    std::memcpy(submeshes.data(), data + header.sectionOffsets[SECTION_SUBMESHES], header.sectionSizes[SECTION_SUBMESHES]);
+    std::vector<MaterialData> materials;
+    if (!DecodeMaterials(data + header.sectionOffsets[SECTION_MATERIALS], header.sectionSizes[SECTION_MATERIALS], materials)) return false;
+    const uint64_t meshletCount = header.sectionSizes[SECTION_MESHLETS] / sizeof(Meshlet);
+    for (const auto& submesh : submeshes) {
+        if (uint64_t(submesh.firstIndex) + submesh.indexCount > header.indexCount || submesh.material >= materials.size() ||
+            uint64_t(submesh.firstMeshlet) + submesh.meshletCount > meshletCount) {
+            return false;
+        }
+    }
+    std::vector<Meshlet> meshlets(meshletCount);
+    std::memcpy(meshlets.data(), data + header.sectionOffsets[SECTION_MESHLETS], header.sectionSizes[SECTION_MESHLETS]);
+    for (const auto& meshlet : meshlets) {
+        if (uint64_t(meshlet.firstIndex) + meshlet.indexCount > header.indexCount) return false;
+    }
+    std::vector<MeshLod> lods(header.sectionSizes[SECTION_LODS] / sizeof(MeshLod));
+    std::memcpy(lods.data(), data + header.sectionOffsets[SECTION_LODS], header.sectionSizes[SECTION_LODS]);
+    for (const auto& lod : lods) {
+        if (uint64_t(lod.firstSubmesh) + lod.submeshCount > submeshes.size()) return false;
+    }
+    return true;
+}
+
+bool GeometryCache::Load(const fs::path& sourcePath) {
+    data = nullptr;
+    size = 0;
+    blob.clear();
+    uint64_t sourceHash;
+    const bool hasSource = HashSource(sourcePath, sourceHash);
+    const fs::path cachePath = CachePath(sourcePath);
+    if (!Vfs::Open(cachePath, file)) return false;
+    const uint64_t* expectedHash = hasSource ? &sourceHash : nullptr;
+    bool valid = Validate(file.Data(), file.Size(), expectedHash);
+    // a pack cooked before the model changed would shadow the cache Store rebuilt next to it forever
+    if (!valid && file.Packed() && Vfs::OpenLoose(cachePath, file)) valid = Validate(file.Data(), file.Size(), expectedHash);
+    if (!valid) {
+        std::cout << cachePath.filename().string() << ": stale or corrupt geometry cache, rebuilding" << std::endl;
+        file.Close();
+        return false;
+    }
+    data = file.Data();
+    size = file.Size();
+    return true;
+}
+
+bool GeometryCache::Store(const fs::path& sourcePath, const GeometryData& geometry) {
+    file.Close();
+    uint64_t sourceHash = 0;
+    const bool persist = HashSource(sourcePath, sourceHash) && !geometry.indices.empty();
+
+    std::vector<uint8_t> sections[SECTION_COUNT];
+    const uint8_t* vertices = reinterpret_cast<const uint8_t*>(geometry.vertices.data());
+    sections[SECTION_VERTICES].assign(vertices, vertices + geometry.vertices.size() * sizeof(VertexAttributes));
+    sections[SECTION_INDICES] = ResourceManager::packIndices(geometry);
+    const uint8_t* submeshes = reinterpret_cast<const uint8_t*>(geometry.submeshes.data());
+    sections[SECTION_SUBMESHES].assign(submeshes, submeshes + geometry.submeshes.size() * sizeof(Submesh));
+    sections[SECTION_MATERIALS] = EncodeMaterials(geometry.materials);
+    const uint8_t* lods = reinterpret_cast<const uint8_t*>(geometry.lods.data());
+    sections[SECTION_LODS].assign(lods, lods + geometry.lods.size() * sizeof(MeshLod));
+    const uint8_t* meshlets = reinterpret_cast<const uint8_t*>(geometry.meshlets.data());
+    sections[SECTION_MESHLETS].assign(meshlets, meshlets + geometry.meshlets.size() * sizeof(Meshlet));
+    // quantized here so neither the cooker's output nor a warm start packs at load time
+    const std::vector<PackedVertex> packed = ResourceManager::packVertices(geometry.vertices.data(), geometry.vertices.size(), geometry.bounds);
+    const uint8_t* packedVertices = reinterpret_cast<const uint8_t*>(packed.data());
+    sections[SECTION_PACKED_VERTICES].assign(packedVertices, packedVertices + packed.size() * sizeof(PackedVertex));
+
+    GeometryCacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = GEOMETRY_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.vertexCount = static_cast<uint32_t>(geometry.vertices.size());
+    header.indexCount = static_cast<uint32_t>(geometry.indices.size());
+    header.indexFormat = geometry.indexFormat;
+    for (int i = 0; i < 3; ++i) {
+        header.boundsMin[i] = geometry.bounds.min[i];
+        header.boundsMax[i] = geometry.bounds.max[i];
+        header.sphere[i] = geometry.sphere.center[i];
+    }
+    header.sphere[3] = geometry.sphere.radius;
+    size_t offset = AlignUp(sizeof(GeometryCacheHeader), 16);
+    for (uint32_t section = 0; section < SECTION_COUNT; ++section) {
+        header.sectionOffsets[section] = offset;
+        header.sectionSizes[section] = sections[section].size();
+        offset = AlignUp(offset + sections[section].size(), 16);
+    }
+
+    blob.assign(offset, 0);
+    for (uint32_t section = 0; section < SECTION_COUNT; ++section) {
+        std::memcpy(blob.data() + header.sectionOffsets[section], sections[section].data(), sections[section].size());
+    }
+    header.payloadSize = blob.size() - sizeof(GeometryCacheHeader);
+    header.payloadHash = ResourceManager::hashBytes(blob.data() + sizeof(GeometryCacheHeader), header.payloadSize);
+    std::memcpy(blob.data(), &header, sizeof(GeometryCacheHeader));
+    // the fresh blob is served from memory, the file only speeds up the next start
+    data = blob.data();
+    size = blob.size();
+    if (!persist) return false;
+
+    // write to a temporary file first so a crash never leaves a half written cache behind
+    const fs::path cachePath = CachePath(sourcePath);
+    const fs::path tempPath = UniqueTempPath(cachePath);
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.write(reinterpret_cast<const char*>(blob.data()), blob.size())) {
+            std::cerr << "Could not write geometry cache " << cachePath.string() << std::endl;
+            out.close();
+            std::error_code error;
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(tempPath, cachePath, error);
+    if (error) {
+        std::cerr << "Could not write geometry cache " << cachePath.string() << ": " << error.message() << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+const GeometryCacheHeader* GeometryCache::Header() const {
+    return reinterpret_cast<const GeometryCacheHeader*>(data);
+}
+
+const uint8_t* GeometryCache::Section(GeometryCacheSection section) const {
+    return data + Header()->sectionOffsets[section];
+}
+
+const VertexAttributes* GeometryCache::Vertices() const {
+    return reinterpret_cast<const VertexAttributes*>(Section(SECTION_VERTICES));
+}
+
+const PackedVertex* GeometryCache::PackedVertices() const {
+    return reinterpret_cast<const PackedVertex*>(Section(SECTION_PACKED_VERTICES));
+}
+
+uint32_t GeometryCache::VertexCount() const {
+    return Header()->vertexCount;
+}
+
+const void* GeometryCache::Indices() const {
+    return Section(SECTION_INDICES);
+}
+
+uint64_t GeometryCache::IndexSize() const {
+    return Header()->sectionSizes[SECTION_INDICES];
+}
+
+uint32_t GeometryCache::IndexCount() const {
+    return Header()->indexCount;
+}
+
+IndexFormat GeometryCache::GetIndexFormat() const {
+    return static_cast<WGPUIndexFormat>(Header()->indexFormat);
+}
+
+Bounds GeometryCache::GetBounds() const {
+    Bounds bounds;
+    bounds.min = glm::vec3(Header()->boundsMin[0], Header()->boundsMin[1], Header()->boundsMin[2]);
+    bounds.max = glm::vec3(Header()->boundsMax[0], Header()->boundsMax[1], Header()->boundsMax[2]);
+    return bounds;
+}
+
+BoundingSphere GeometryCache::GetBoundingSphere() const {
+    BoundingSphere sphere;
+    sphere.center = glm::vec3(Header()->sphere[0], Header()->sphere[1], Header()->sphere[2]);
+    sphere.radius = Header()->sphere[3];
+    return sphere;
+}
+
+std::vector<Submesh> GeometryCache::Submeshes() const {
+    std::vector<Submesh> submeshes(Header()->sectionSizes[SECTION_SUBMESHES] / sizeof(Submesh));
+    std::memcpy(submeshes.data(), Section(SECTION_SUBMESHES), submeshes.size() * sizeof(Submesh));
+    return submeshes;
+}
+
+std::vector<MaterialData> GeometryCache::Materials() const {
+    std::vector<MaterialData> materials;
+    DecodeMaterials(Section(SECTION_MATERIALS), Header()->sectionSizes[SECTION_MATERIALS], materials);
+    return materials;
+}
+
+std::vector<MeshLod> GeometryCache::Lods() const {
+    std::vector<MeshLod> lods(Header()->sectionSizes[SECTION_LODS] / sizeof(MeshLod));
+    std::memcpy(lods.data(), Section(SECTION_LODS), lods.size() * sizeof(MeshLod));
+    return lods;
+}
+
+std::vector<Meshlet> GeometryCache::Meshlets() const {
+    std::vector<Meshlet> meshlets(Header()->sectionSizes[SECTION_MESHLETS] / sizeof(Meshlet));
+    std::memcpy(meshlets.data(), Section(SECTION_MESHLETS), meshlets.size() * sizeof(Meshlet));
+    return meshlets;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include "ResourceManager.hpp"
+#include "Vfs.hpp"
+
+// Bumped whenever the loader output or the blob layout changes, so older caches get rebuilt
+constexpr uint32_t GEOMETRY_CACHE_VERSION = 7;
+
+enum GeometryCacheSection : uint32_t {
+    SECTION_VERTICES,
+    SECTION_INDICES,
+    SECTION_SUBMESHES,
+    SECTION_MATERIALS,
+    SECTION_LODS,
+    SECTION_MESHLETS,
+    SECTION_PACKED_VERTICES,
+    SECTION_COUNT
+};
+
+struct GeometryCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t payloadHash;
+    uint64_t payloadSize;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexFormat;
+    uint32_t reserved;
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphere[4];
+    uint64_t sectionOffsets[SECTION_COUNT];
+    uint64_t sectionSizes[SECTION_COUNT];
+};
+
+// Binary blob holding the final vertex/index arrays of a parsed model, stored next to the source file.
+// The arrays are used straight from the blob, either mapped from disk or a pack or freshly serialized in memory.
+// A cache whose source isn't shipped is taken as cooked and used without the staleness check.
+class GeometryCache {
+public:
+    static fs::path CachePath(const fs::path& sourcePath);
+    bool Load(const fs::path& sourcePath);
+    bool Store(const fs::path& sourcePath, const GeometryData& geometry);
+
+    const VertexAttributes* Vertices() const;
+    // the same vertices quantized to the bounds, for VertexLayout::Packed
+    const PackedVertex* PackedVertices() const;
+    uint32_t VertexCount() const;
+    const void* Indices() const;
+    uint64_t IndexSize() const;
+    uint32_t IndexCount() const;
+    wgpu::IndexFormat GetIndexFormat() const;
+    Bounds GetBounds() const;
+    BoundingSphere GetBoundingSphere() const;
+    std::vector<Submesh> Submeshes() const;
+    std::vector<MaterialData> Materials() const;
+    std::vector<MeshLod> Lods() const;
+    std::vector<Meshlet> Meshlets() const;
+
+private:
+    VfsFile file;
+    std::vector<uint8_t> blob;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const GeometryCacheHeader* Header() const;
+    const uint8_t* Section(GeometryCacheSection section) const;
+    static bool HashSource(const fs::path& sourcePath, uint64_t& hash);
+    static bool Validate(const uint8_t* data, size_t size, const uint64_t* sourceHash);
+    static std::vector<uint8_t> EncodeMaterials(const std::vector<MaterialData>& materials);
+    static bool DecodeMaterials(const uint8_t* data, size_t size, std::vector<MaterialData>& materials);
+};
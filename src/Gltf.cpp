@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include "Gltf.hpp"
+
+namespace {
+constexpr uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+uint32_t ReadU32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+size_t ComponentSize(uint32_t componentType) {
+    switch (componentType) {
+    case GLTF_COMPONENT_BYTE: case GLTF_COMPONENT_UNSIGNED_BYTE: return 1;
+    case GLTF_COMPONENT_SHORT: case GLTF_COMPONENT_UNSIGNED_SHORT: return 2;
+    case GLTF_COMPONENT_UNSIGNED_INT: case GLTF_COMPONENT_FLOAT: return 4;
+    default: return 0;
+    }
+}
+
+uint32_t ComponentCount(const std::string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4" || type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+bool IsDataUri(const std::string& uri) {
+    return uri.compare(0, 5, "data:") == 0;
+}
+
+bool DecodeBase64(const std::string& uri, std::vector<uint8_t>& bytes) {
+    const size_t comma = uri.find(',');
+    if (comma == std::string::npos || comma < 7 || uri.compare(comma - 7, 7, ";base64") != 0) return false;
+    bytes.clear();
+    bytes.reserve((uri.size() - comma) * 3 / 4);
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (size_t i = comma + 1; i < uri.size() && uri[i] != '='; ++i) {
+        const char c = uri[i];
+        uint32_t value;
+        if (c >= 'A' && c <= 'Z') value = uint32_t(c - 'A');
+        else if (c >= 'a' && c <= 'z') value = uint32_t(c - 'a' + 26);
+        else if (c >= '0' && c <= '9') value = uint32_t(c - '0' + 52);
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else return false;
+        bits = (bits << 6) | value;
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            bytes.push_back(uint8_t(bits >> bitCount));
+        }
+    }
+    return true;
+}
+
+// uris are percent encoded, file names with spaces arrive as %20
+std::string DecodeUri(const std::string& uri) {
+    std::string decoded;
+    for (size_t i = 0; i < uri.size(); ++i) {
+        if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(uint8_t(uri[i + 1])) && std::isxdigit(uint8_t(uri[i + 2]))) {
+            decoded += char(std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        }
+        else {
+            decoded += uri[i];
+        }
+    }
+    return decoded;
+}
+}
+
+float GltfAccessor::Read(size_t element, uint32_t component) const {
+    if (data == nullptr || element >= count || component >= components) return 0.0f;
+    const uint8_t* p = data + element * stride + component * ComponentSize(componentType);
+    switch (componentType) {
+    case GLTF_COMPONENT_FLOAT: {
+        float value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    case GLTF_COMPONENT_UNSIGNED_BYTE:
+        return normalized ? *p / 255.0f : float(*p);
+    case GLTF_COMPONENT_BYTE: {
+        const int8_t value = int8_t(*p);
+        return normalized ? std::max(value / 127.0f, -1.0f) : float(value);
+    }
+    case GLTF_COMPONENT_UNSIGNED_SHORT: {
+        uint16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return normalized ? value / 65535.0f : float(value);
+    }
+    case GLTF_COMPONENT_SHORT: {
+        int16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return normalized ? std::max(value / 32767.0f, -1.0f) : float(value);
+    }
+    case GLTF_COMPONENT_UNSIGNED_INT:
+        return float(ReadU32(p));
+    default:
+        return 0.0f;
+    }
+}
+
+uint32_t GltfAccessor::ReadIndex(size_t element) const {
+    if (data == nullptr || element >= count) return 0;
+    const uint8_t* p = data + element * stride;
+    switch (componentType) {
+    case GLTF_COMPONENT_UNSIGNED_BYTE: return *p;
+    case GLTF_COMPONENT_UNSIGNED_SHORT: {
+        uint16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    case GLTF_COMPONENT_UNSIGNED_INT: return ReadU32(p);
+    default: return 0;
+    }
+}
+
+bool GltfFile::Open(const fs::path& path) {
+    this->path = path;
+    if (!Vfs::Open(path, file)) {
+        std::cerr << "Could not open " << path.string() << std::endl;
+        return false;
+    }
+    const uint8_t* data = file.Data();
+    const size_t size = file.Size();
+    const char* text = reinterpret_cast<const char*>(data);
+    size_t textSize = size;
+    BufferData binaryChunk;
+    const bool binary = size >= 12 && ReadU32(data) == GLB_MAGIC;
+    if (binary) {
+        // 12 byte header, then a JSON chunk and an optional binary chunk
+        if (ReadU32(data + 4) != 2 || ReadU32(data + 8) > size || size < 20 || ReadU32(data + 16) != GLB_CHUNK_JSON) {
+            std::cerr << path.string() << " is not a glTF 2.0 binary" << std::endl;
+            return false;
+        }
+        const size_t length = ReadU32(data + 8);
+        const size_t jsonSize = ReadU32(data + 12);
+        if (20 + jsonSize > length) {
+            std::cerr << path.string() << ": truncated JSON chunk" << std::endl;
+            return false;
+        }
+        text = reinterpret_cast<const char*>(data + 20);
+        textSize = jsonSize;
+        const size_t binOffset = 20 + ((jsonSize + 3) & ~size_t(3));
+        if (binOffset + 8 <= length && ReadU32(data + binOffset + 4) == GLB_CHUNK_BIN) {
+            binaryChunk.data = data + binOffset + 8;
+            binaryChunk.size = std::min<size_t>(ReadU32(data + binOffset), length - binOffset - 8);
+        }
+    }
+    std::string error;
+    if (!JsonValue::Parse(text, textSize, json, error)) {
+        std::cerr << path.string() << ": " << error << std::endl;
+        return false;
+    }
+    if (json["asset"]["version"].AsString().compare(0, 2, "2.") != 0) {
+        std::cerr << path.string() << ": only glTF 2.0 is supported" << std::endl;
+        return false;
+    }
+
+    const JsonValue& bufferList = json["buffers"];
+    for (size_t i = 0; i < bufferList.Size(); ++i) {
+        const JsonValue& buffer = bufferList[i];
+        const std::string& uri = buffer["uri"].AsString();
+        const size_t byteLength = size_t(buffer["byteLength"].AsNumber());
+        BufferData resolved;
+        if (uri.empty()) {
+            if (i != 0 || binaryChunk.data == nullptr) {
+                std::cerr << path.string() << ": buffer " << i << " has no data" << std::endl;
+                return false;
+            }
+            resolved = binaryChunk;
+        }
+        else if (IsDataUri(uri)) {
+            decodedBuffers.emplace_back();
+            if (!DecodeBase64(uri, decodedBuffers.back())) {
+                std::cerr << path.string() << ": buffer " << i << " is not base64 encoded" << std::endl;
+                return false;
+            }
+            resolved = {decodedBuffers.back().data(), decodedBuffers.back().size()};
+        }
+        else {
+            const fs::path bufferPath = path.parent_path()/fs::u8path(DecodeUri(uri));
+            externalBuffers.emplace_back();
+            if (!Vfs::Open(bufferPath, externalBuffers.back())) {
+                std::cerr << "Could not open " << bufferPath.string() << std::endl;
+                return false;
+            }
+            resolved = {externalBuffers.back().Data(), externalBuffers.back().Size()};
+        }
+        if (resolved.size < byteLength) {
+            std::cerr << path.string() << ": buffer " << i << " is shorter than its byteLength" << std::endl;
+            return false;
+        }
+        resolved.size = byteLength;
+        buffers.push_back(resolved);
+    }
+    // the document is parsed, only a binary chunk has to stay mapped
+    if (!binary) file.Close();
+    return true;
+}
+
+const JsonValue& GltfFile::Json() const {
+    return json;
+}
+
+bool GltfFile::BufferView(int index, const uint8_t*& data, size_t& size, size_t& stride, size_t& available) const {
+    const JsonValue& view = json["bufferViews"][size_t(index)];
+    const int buffer = view["buffer"].AsInt();
+    if (!view.IsObject() || buffer < 0 || size_t(buffer) >= buffers.size()) return false;
+    const size_t offset = size_t(view["byteOffset"].AsNumber());
+    size = size_t(view["byteLength"].AsNumber());
+    stride = size_t(view["byteStride"].AsNumber());
+    if (offset + size > buffers[buffer].size) return false;
+    data = buffers[buffer].data + offset;
+    available = buffers[buffer].size - offset;
+    return true;
+}
+
+bool GltfFile::Accessor(int index, GltfAccessor& accessor) const {
+    const JsonValue& description = json["accessors"][size_t(index)];
+    if (index < 0 || !description.IsObject()) return false;
+    accessor = GltfAccessor();
+    accessor.count = size_t(description["count"].AsNumber());
+    accessor.componentType = uint32_t(description["componentType"].AsInt(0));
+    accessor.components = ComponentCount(description["type"].AsString());
+    accessor.normalized = description["normalized"].AsBool();
+    accessor.elementSize = ComponentSize(accessor.componentType) * accessor.components;
+    accessor.stride = accessor.elementSize;
+    if (accessor.elementSize == 0) {
+        std::cerr << path.string() << ": accessor " << index << " has an unknown type" << std::endl;
+        return false;
+    }
+    if (description.Has("sparse")) {
+        std::cerr << path.string() << ": sparse accessors are not supported" << std::endl;
+        return false;
+    }
+    if (!description.Has("bufferView")) return true;
+    const uint8_t* viewData;
+    size_t viewSize, viewStride, available;
+    if (!BufferView(description["bufferView"].AsInt(), viewData, viewSize, viewStride, available)) {
+        std::cerr << path.string() << ": accessor " << index << " has an invalid buffer view" << std::endl;
+        return false;
+    }
+    const size_t offset = size_t(description["byteOffset"].AsNumber());
+    if (viewStride != 0) accessor.stride = viewStride;
+    if (accessor.count > 0 && offset + accessor.stride * (accessor.count - 1) + accessor.elementSize > viewSize) {
+        std::cerr << path.string() << ": accessor " << index << " overruns its buffer view" << std::endl;
+        return false;
+    }
+    accessor.data = viewData + offset;
+    accessor.available = available - offset;
+    return true;
+}
+
+std::string GltfFile::ImageUri(int index) const {
+    const std::string& uri = json["images"][size_t(index)]["uri"].AsString();
+    return IsDataUri(uri) ? std::string() : DecodeUri(uri);
+}
+
+bool GltfFile::ImageBytes(int index, std::vector<uint8_t>& storage, const uint8_t*& data, size_t& size) const {
+    const JsonValue& image = json["images"][size_t(index)];
+    if (image.Has("bufferView")) {
+        size_t stride, available;
+        return BufferView(image["bufferView"].AsInt(), data, size, stride, available);
+    }
+    if (!IsDataUri(image["uri"].AsString()) || !DecodeBase64(image["uri"].AsString(), storage)) return false;
+    data = storage.data();
+    size = storage.size();
+    return true;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Json.hpp"
+#include "ResourceManager.hpp"
+#include "Vfs.hpp"
+
+namespace fs = std::filesystem;
+
+// accessor component types
+constexpr uint32_t GLTF_COMPONENT_BYTE = 5120;
+constexpr uint32_t GLTF_COMPONENT_UNSIGNED_BYTE = 5121;
+constexpr uint32_t GLTF_COMPONENT_SHORT = 5122;
+constexpr uint32_t GLTF_COMPONENT_UNSIGNED_SHORT = 5123;
+constexpr uint32_t GLTF_COMPONENT_UNSIGNED_INT = 5125;
+constexpr uint32_t GLTF_COMPONENT_FLOAT = 5126;
+
+// primitive modes the loader turns into triangle lists
+constexpr int GLTF_MODE_TRIANGLES = 4;
+constexpr int GLTF_MODE_TRIANGLE_STRIP = 5;
+constexpr int GLTF_MODE_TRIANGLE_FAN = 6;
+
+// accessor resolved against its buffer view, element i starts at data + i * stride
+struct GltfAccessor {
+    const uint8_t* data = nullptr; // null for accessors without a buffer view, they read as zeros
+    size_t count = 0;
+    uint32_t componentType = 0;
+    uint32_t components = 0;
+    size_t stride = 0;
+    size_t elementSize = 0;
+    // bytes from data to the end of its buffer, lets uploads round up to 4 bytes in place
+    size_t available = 0;
+    bool normalized = false;
+
+    float Read(size_t element, uint32_t component) const;
+    uint32_t ReadIndex(size_t element) const;
+};
+
+// glTF 2.0 asset, a .gltf with external or base64 buffers or a .glb whose binary chunk
+// stays memory mapped. Accessors point straight into the buffers.
+class GltfFile {
+public:
+    bool Open(const fs::path& path);
+    const JsonValue& Json() const;
+    bool Accessor(int index, GltfAccessor& accessor) const;
+    // external file an image points at, empty when it lives in a buffer or a data uri
+    std::string ImageUri(int index) const;
+    // bytes of an embedded image, storage holds them when they had to be decoded
+    bool ImageBytes(int index, std::vector<uint8_t>& storage, const uint8_t*& data, size_t& size) const;
+
+private:
+    struct BufferData {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+    fs::path path;
+    VfsFile file;
+    std::vector<VfsFile> externalBuffers;
+    std::vector<std::vector<uint8_t>> decodedBuffers;
+    std::vector<BufferData> buffers;
+    JsonValue json;
+
+    bool BufferView(int index, const uint8_t*& data, size_t& size, size_t& stride, size_t& available) const;
+};
+
+// material of a glTF file with the images its textures sample, -1 when it has none
+struct GltfMaterial {
+    MaterialData data;
+    int diffuseImage = -1;
+    int normalImage = -1;
+};
+
+// Geometry of one glTF mesh, its primitives become submeshes. Vertices and indices point
+// into the mapped file when the accessors already have the runtime layout and into the
+// converted arrays otherwise.
+struct GltfMesh {
+    GltfMesh() = default;
+    GltfMesh(GltfMesh&&) = default;
+    GltfMesh& operator=(GltfMesh&&) = default;
+    // a copy would still point at the converted arrays of the original
+    GltfMesh(const GltfMesh&) = delete;
+    GltfMesh& operator=(const GltfMesh&) = delete;
+
+    std::string name;
+    const VertexAttributes* vertices = nullptr;
+    uint32_t vertexCount = 0;
+    const void* indices = nullptr;
+    uint32_t indexCount = 0;
+    uint64_t indexSize = 0; // multiple of 4 bytes, what writeBuffer takes
+    wgpu::IndexFormat indexFormat = wgpu::IndexFormat::Uint32;
+    Bounds bounds;
+    BoundingSphere sphere;
+    std::vector<Submesh> submeshes;
+    std::vector<uint32_t> materials; // into GltfScene::materials, submeshes index this
+    std::vector<VertexAttributes> convertedVertices;
+    std::vector<uint8_t> convertedIndices;
+};
+
+struct GltfNode {
+    std::string name;
+    int mesh = -1;   // into GltfScene::meshes, -1 for transform only nodes
+    int parent = -1; // into GltfScene::nodes, -1 for roots
+    glm::mat4x4 matrix = glm::mat4x4(1.0f); // relative to the parent
+};
+
+struct GltfScene {
+    std::shared_ptr<GltfFile> file; // keeps the mapped buffers alive while meshes point into them
+    std::vector<GltfMaterial> materials;
+    std::vector<GltfMesh> meshes;
+    std::vector<GltfNode> nodes; // parents come before their children
+};
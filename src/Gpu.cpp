@@ -1,20 +1,70 @@
 #include <iostream>
 #define WEBGPU_CPP_IMPLEMENTATION
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <filesystem>
+#include <random>
 #include <GLFW/glfw3.h>
 #include <glfw3webgpu.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/common.hpp>
 #include "ResourceManager.hpp"
 #include "Gpu.hpp"
+#include "TextureCodec.hpp"
 #include "MainWindow.hpp"
 
 
 using namespace wgpu;
 namespace fs = std::filesystem;
 
+// time per frame the render thread may spend uploading streamed in assets
+constexpr double UPLOAD_BUDGET_MS = 4.0;
+// screen space error a LOD may have before a finer one is drawn, scaled by lodBias
+constexpr float LOD_ERROR_PIXELS = 1.0f;
+// relative band around the threshold in which the current LOD is kept
+constexpr float LOD_HYSTERESIS = 0.2f;
+// the projection in shaders.wgsl, scales y by the surface's aspect ratio and the focal length
+constexpr float PROJECTION_FOCAL_LENGTH = 1.2f;
+constexpr float PROJECTION_NEAR = 0.01f;
+constexpr float PROJECTION_FAR = 100.0f;
+const glm::vec3 PROJECTION_FOCAL_POINT = glm::vec3(0.0f, 0.0f, -2.0f);
+// seconds between two culling reports
+constexpr float CULL_STATS_INTERVAL = 1.0f;
+// meshes rasterized into the OcclusionBuffer each frame, the largest on screen
+constexpr size_t MAX_OCCLUDERS = 16;
+// bounding sphere radius over distance below which a mesh hides too little to be worth rasterizing
+constexpr float MIN_OCCLUDER_SIZE = 0.1f;
+// asteroid belt drawn as one InstancedMesh
+constexpr uint32_t ASTEROID_FIELD_COUNT = 10000;
+constexpr float ASTEROID_FIELD_INNER_RADIUS = 30.0f;
+constexpr float ASTEROID_FIELD_OUTER_RADIUS = 60.0f;
+constexpr float ASTEROID_FIELD_THICKNESS = 4.0f;
+
+
+// random placements in a flat ring around the origin, the same belt on every run
+static std::vector<InstanceData> AsteroidField(uint32_t count) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<InstanceData> instances(count);
+    for (auto& instance : instances) {
+        // uniform over the ring's area, not its radius
+        const float inner2 = ASTEROID_FIELD_INNER_RADIUS * ASTEROID_FIELD_INNER_RADIUS;
+        const float outer2 = ASTEROID_FIELD_OUTER_RADIUS * ASTEROID_FIELD_OUTER_RADIUS;
+        const float radius = std::sqrt(inner2 + unit(random) * (outer2 - inner2));
+        const float angle = unit(random) * glm::two_pi<float>();
+        const glm::vec3 position(radius * std::cos(angle), (unit(random) - 0.5f) * ASTEROID_FIELD_THICKNESS, radius * std::sin(angle));
+        const glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) - 0.5f + glm::vec3(0.0f, 1e-3f, 0.0f));
+        glm::mat4x4 transform = glm::translate(glm::mat4x4(1.0f), position);
+        transform = glm::rotate(transform, unit(random) * glm::two_pi<float>(), axis);
+        transform = glm::scale(transform, glm::vec3(0.05f + 0.2f * unit(random)));
+        const float shade = 0.6f + 0.4f * unit(random);
+        instance = InstancedMesh::MakeInstance(transform, glm::vec4(shade, shade, shade, 1.0f));
+    }
+    return instances;
+}
 
 auto onDeviceError = [](WGPUErrorType type, char const* message, void* /* pUserData */) {
         std::cout << "Uncaptured device error: type " << type;
@@ -39,6 +89,26 @@ bool Gpu::Initialize() {
     DeviceDescriptor devDesc = {};
     RequiredLimits requiredLimits = GetRequiredLimits(adapter);
     devDesc.requiredLimits = &requiredLimits;
+    // block compressed textures are sampled directly where the adapter allows it
+    TextureSupport textureSupport;
+    std::vector<WGPUFeatureName> requiredFeatures;
+    if (adapter.hasFeature(FeatureName::TextureCompressionBC)) {
+        textureSupport.bc = true;
+        requiredFeatures.push_back(FeatureName::TextureCompressionBC);
+    }
+    if (adapter.hasFeature(FeatureName::TextureCompressionETC2)) {
+        textureSupport.etc2 = true;
+        requiredFeatures.push_back(FeatureName::TextureCompressionETC2);
+    }
+    if (adapter.hasFeature(FeatureName::TextureCompressionASTC)) {
+        textureSupport.astc = true;
+        requiredFeatures.push_back(FeatureName::TextureCompressionASTC);
+    }
+    devDesc.requiredFeatureCount = requiredFeatures.size();
+    devDesc.requiredFeatures = requiredFeatures.data();
+    TextureCodec::SetSupport(textureSupport);
+    std::cout << "Texture compression: BC " << textureSupport.bc << ", ETC2 " << textureSupport.etc2
+        << ", ASTC " << textureSupport.astc << std::endl;
     devDesc.deviceLostCallbackInfo.callback = [](const WGPUDevice* /* device */, WGPUDeviceLostReason reason, char const* message, void* /* pUserData */) {    std::cout << "Device lost: reason " << reason;
     if (message) std::cout << " (" << message << ")";
     std::cout << std::endl;
@@ -48,20 +118,39 @@ bool Gpu::Initialize() {
     
     InitializeSurface(adapter);
     queue = device.getQueue();
+    // the null backend never runs shaders, so its mip chains are built on the CPU
+    AdapterInfo adapterInfo;
+    adapter.getInfo(&adapterInfo);
+    mipmapGenerator.Initialize(device, queue, adapterInfo.backendType != BackendType::Null);
+    textureUploader.Initialize(device, queue, mipmapGenerator);
+    adapterInfo.freeMembers();
+    if (!gpuCulling.Initialize(device)) return false;
     InitializeUniforms();
     InitializeSampler();
     InitializeBinding();
+    assetLoader.SetVertexLayout(vertexLayout);
     InitializeMeshes();
     UpdateViewMatrix();
     InitializePipeline();
+    if (!depthPyramid.Initialize(device, depthTexture)) return false;
+    gpuCulling.SetDepthPyramid(depthPyramid);
     SetCallbacks();
     adapter.release();
     return true;
 }
 void Gpu::Terminate(){
+    assetLoader.Shutdown();
+    textureUploader.Terminate();
+    for (auto &instancedMesh : instancedMeshes){
+        instancedMesh.Terminate();
+    }
     for (auto &mesh : meshes){
         mesh.Terminate();
     }
+    transformBuffer.Terminate();
+    mipmapGenerator.Terminate();
+    gpuCulling.Terminate();
+    depthPyramid.Terminate();
     depthTextureView.release();
     depthTexture.destroy();
     depthTexture.release();
@@ -69,8 +158,12 @@ void Gpu::Terminate(){
     bindGroup.release();
     bindGroupLayout.release();
     meshBindGroupLayout.release();
+    materialBindGroupLayout.release();
+    instanceBindGroupLayout.release();
     pipeline.release();
     pipelineLayout.release();
+    instancedPipeline.release();
+    instancedPipelineLayout.release();
     instance.release();
     surface.unconfigure();
     surface.release();
@@ -81,6 +174,15 @@ void Gpu::MainLoop(){
     glfwPollEvents();
     time = static_cast<float>(glfwGetTime());
     queue.writeBuffer(uniformBuffer, offsetof(Uniforms, time), &time, sizeof(float));
+    assetLoader.Update(UPLOAD_BUDGET_MS, [this](const MeshPayload& payload) {
+        sceneChanged = true;
+        return &meshes.emplace_back(device, queue, transformBuffer, materialBindGroupLayout, textureUploader, payload);
+    });
+    // textures of this frame's uploads go out in one submit, ahead of the frame that draws them
+    textureUploader.Flush();
+    textureUploader.Poll();
+    // only objects that moved since the last frame are written
+    transformBuffer.Upload();
     auto [ surfaceTexture, targetView ] = GetNextSurfaceViewData();
     if (!targetView) return;
     RenderPassDescriptor renderPassDesc = {};
@@ -114,24 +216,118 @@ void Gpu::MainLoop(){
     encoderDesc.nextInChain = nullptr;
     encoderDesc.label = "My command encoder";
     CommandEncoder encoder = device.createCommandEncoder(encoderDesc);
+    const glm::mat4x4 viewProjection = ViewProjection();
+    const Frustum frustum = Frustum::FromMatrix(viewProjection);
+    // instances are culled on the GPU, the CPU cost doesn't grow with their number. The early
+    // phase keeps what was visible last frame, its depth then occludes everything else
+    ComputePassDescriptor computePassDesc;
+    computePassDesc.timestampWrites = nullptr;
+    if (!instancedMeshes.empty()) {
+        gpuCulling.BeginFrame(encoder);
+        ComputePassEncoder cullPass = encoder.beginComputePass(computePassDesc);
+        for (auto &instancedMesh : instancedMeshes){
+            instancedMesh.Upload();
+            instancedMesh.Cull(cullPass, frustum, viewProjection, CullPhase::Early);
+        }
+        cullPass.end();
+        cullPass.release();
+    }
     // render pass
     RenderPassEncoder renderPass = encoder.beginRenderPass(renderPassDesc);
     renderPass.setPipeline(pipeline);
-    for (auto &mesh : meshes){
+    renderPass.setBindGroup(0, bindGroup, 0, nullptr);
+    renderPass.setBindGroup(1, transformBuffer.GetBindGroup(), 0, nullptr);
+    const float projectionScale = 0.5f * config.height * Aspect() * PROJECTION_FOCAL_LENGTH;
+    // transformVertex projects towards the focal point in view space, not the camera position
+    const glm::vec3 cameraPosition = glm::vec3(glm::inverse(camera->view) * glm::vec4(PROJECTION_FOCAL_POINT, 1.0f));
+    // the BVH rejects whole subtrees, the meshes of leaves straddling the frustum get their
+    // world spheres tested in SIMD batches
+    if (sceneChanged) RebuildScene();
+    visibleObjects.clear();
+    boundaryObjects.clear();
+    sceneBvh.Cull(frustum, visibleObjects, boundaryObjects);
+    meshSpheres.Clear();
+    for (uint32_t object : boundaryObjects) {
+        meshSpheres.Add(sceneObjects[object]->worldSphere.center, sceneObjects[object]->worldSphere.radius);
+    }
+    meshSpheres.Cull(frustum, meshVisible);
+    for (size_t i = 0; i < boundaryObjects.size(); ++i) {
+        if (meshVisible[i]) visibleObjects.push_back(boundaryObjects[i]);
+    }
+    objectCullStats.total = uint32_t(sceneObjects.size());
+    objectCullStats.culled = uint32_t(sceneObjects.size() - visibleObjects.size());
+    CullOccluded(viewProjection, cameraPosition);
+    MeshletCullStats cullStats;
+    for (uint32_t object : visibleObjects){
+        Mesh &mesh = *sceneObjects[object];
+        mesh.SelectLod(cameraPosition, projectionScale, LOD_ERROR_PIXELS * lodBias, LOD_HYSTERESIS);
+        mesh.CullMeshlets(frustum, cameraPosition, cullStats);
+        if (mesh.drawRanges.empty()) continue;
         //std::cout<<"RenderMeshes"<<std::endl;
-        queue.writeBuffer(mesh.transformsBuffer, 0, &mesh.globalTransforms, sizeof(ObjectTransforms));
-        //std::vector<BindGroup> bindGroups = {bindGroup, mesh.bindGroup};
+        renderPass.setVertexBuffer(0, mesh.vertexBuffer, 0, mesh.vertexBuffer.getSize());
+        renderPass.setIndexBuffer(mesh.indexBuffer, mesh.indexFormat, 0, mesh.indexBuffer.getSize());
+        // ranges are grouped by material so each material is bound once
+        uint32_t boundMaterial = ~0u;
+        for (const auto &range : mesh.drawRanges){
+            if (range.material != boundMaterial) {
+                renderPass.setBindGroup(2, mesh.materials[range.material].bindGroup, 0, nullptr);
+                boundMaterial = range.material;
+            }
+            // the instance index is the mesh's slot in the transform buffer
+            renderPass.drawIndexed(range.indexCount, 1, range.firstIndex, 0, mesh.transformSlot);
+        }
+    }
+    if (!instancedMeshes.empty()) {
+        renderPass.setPipeline(instancedPipeline);
         renderPass.setBindGroup(0, bindGroup, 0, nullptr);
-        renderPass.setBindGroup(1, mesh.bindGroup, 0, nullptr);
-        renderPass.setVertexBuffer(0, mesh.vertexBuffer, 0, mesh.vertexData.size()*sizeof(VertexAttributes));
-        renderPass.draw(mesh.vertexCount, 1, 0, 0);
+        for (auto &instancedMesh : instancedMeshes){
+            instancedMesh.Draw(renderPass, CullPhase::Early);
+        }
     }
     renderPass.end();
+    if (!instancedMeshes.empty()) {
+        // the pyramid is written and read in passes of its own
+        ComputePassEncoder pyramidPass = encoder.beginComputePass(computePassDesc);
+        depthPyramid.Build(pyramidPass);
+        pyramidPass.end();
+        pyramidPass.release();
+        ComputePassEncoder cullPass = encoder.beginComputePass(computePassDesc);
+        for (auto &instancedMesh : instancedMeshes){
+            instancedMesh.Cull(cullPass, frustum, viewProjection, CullPhase::Late);
+        }
+        cullPass.end();
+        cullPass.release();
+        gpuCulling.EndFrame(encoder);
+        // on top of what the first pass left
+        renderPassColorAttachment.loadOp = LoadOp::Load;
+        depthStencilAttachment.depthLoadOp = LoadOp::Load;
+        RenderPassEncoder latePass = encoder.beginRenderPass(renderPassDesc);
+        latePass.setPipeline(instancedPipeline);
+        latePass.setBindGroup(0, bindGroup, 0, nullptr);
+        for (auto &instancedMesh : instancedMeshes){
+            instancedMesh.Draw(latePass, CullPhase::Late);
+        }
+        latePass.end();
+        latePass.release();
+    }
+    if (time - cullStatsTime >= CULL_STATS_INTERVAL) {
+        cullStatsTime = time;
+        std::cout << "Meshes: " << objectCullStats.total - objectCullStats.culled - objectCullStats.occluded << "/" << objectCullStats.total
+            << " drawn, " << objectCullStats.culled << " off screen, " << objectCullStats.occluded << " occluded" << std::endl;
+        std::cout << "Meshlets: " << cullStats.total - cullStats.frustumCulled - cullStats.backfaceCulled << "/" << cullStats.total
+            << " drawn, " << cullStats.frustumCulled << " off screen, " << cullStats.backfaceCulled << " back facing" << std::endl;
+        if (!instancedMeshes.empty()) {
+            std::cout << "Instances: " << occlusionStats.earlyDrawn + occlusionStats.lateDrawn << "/" << occlusionStats.inFrustum
+                << " in view drawn, " << occlusionStats.lateDrawn << " of them late, " << occlusionStats.occluded << " occluded" << std::endl;
+        }
+    }
     CommandBufferDescriptor cmdBufferDescriptor = {};
     cmdBufferDescriptor.nextInChain = nullptr;
     cmdBufferDescriptor.label = "Command buffer";
     CommandBuffer command = encoder.finish(cmdBufferDescriptor);
     queue.submit(1, &command);
+    gpuCulling.ReadStats();
+    occlusionStats = gpuCulling.GetStats();
 
     renderPass.release();
     surface.present();
@@ -140,6 +336,75 @@ void Gpu::MainLoop(){
     command.release();
     encoder.release();
 }
+void Gpu::RebuildScene() {
+    sceneChanged = false;
+    sceneObjects.clear();
+    std::vector<Bounds> bounds;
+    for (auto &mesh : meshes){
+        if (mesh.instanced || mesh.indexCount == 0) continue;
+        mesh.SetSceneBvh(&sceneBvh, uint32_t(sceneObjects.size()));
+        sceneObjects.push_back(&mesh);
+        bounds.push_back(mesh.worldBounds);
+    }
+    sceneBvh.Build(bounds);
+}
+
+void Gpu::CullOccluded(const glm::mat4x4& viewProjection, const glm::vec3& cameraPosition) {
+    occluderObjects.clear();
+    for (uint32_t object : visibleObjects) {
+        const Mesh& mesh = *sceneObjects[object];
+        if (mesh.occluderIndices.empty()) continue;
+        const float distance = glm::length(mesh.worldSphere.center - cameraPosition);
+        // around the camera the mesh fills the screen, its triangles crossing the near plane are skipped
+        const float size = distance > mesh.worldSphere.radius ? mesh.worldSphere.radius / distance : 1.0f;
+        if (size >= MIN_OCCLUDER_SIZE) occluderObjects.emplace_back(size, object);
+    }
+    const size_t occluderCount = std::min(occluderObjects.size(), MAX_OCCLUDERS);
+    std::partial_sort(occluderObjects.begin(), occluderObjects.begin() + occluderCount, occluderObjects.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
+    occluderObjects.resize(occluderCount);
+    // nearest first leaves the tightest depth in the tiles
+    for (auto& [order, object] : occluderObjects) order = glm::length(sceneObjects[object]->worldSphere.center - cameraPosition);
+    std::sort(occluderObjects.begin(), occluderObjects.end());
+    objectCullStats.occluded = 0;
+    if (occluderObjects.empty()) return;
+    occluders.clear();
+    for (const auto& [distance, object] : occluderObjects) {
+        const Mesh& mesh = *sceneObjects[object];
+        occluders.push_back(Occluder{&mesh.occluderPositions, &mesh.occluderIndices, mesh.globalTransforms.Rot});
+    }
+    occlusionBuffer.Clear(viewProjection);
+    occlusionBuffer.Rasterize(occluders);
+    // occluders are drawn whatever their own bounds say, the rest have to show past them
+    occludeeObjects.clear();
+    occludeeBounds.clear();
+    for (uint32_t object : visibleObjects) {
+        const bool occluder = std::any_of(occluderObjects.begin(), occluderObjects.end(), [&](const auto& o) { return o.second == object; });
+        if (occluder) continue;
+        occludeeObjects.push_back(object);
+        occludeeBounds.push_back(sceneObjects[object]->worldBounds);
+    }
+    const uint32_t occludeeCount = occlusionBuffer.Cull(occludeeBounds, occludeeVisible);
+    objectCullStats.occluded = uint32_t(occludeeObjects.size()) - occludeeCount;
+    visibleObjects.clear();
+    for (const auto& [distance, object] : occluderObjects) visibleObjects.push_back(object);
+    for (size_t i = 0; i < occludeeObjects.size(); ++i) {
+        if (occludeeVisible[i]) visibleObjects.push_back(occludeeObjects[i]);
+    }
+}
+
+Mesh* Gpu::Pick(double x, double y) {
+    // the cursor's ray runs from the near to the far plane through the inverse projection
+    const glm::vec2 ndc(2.0f * float(x) / config.width - 1.0f, 1.0f - 2.0f * float(y) / config.height);
+    const glm::mat4x4 inverse = glm::inverse(ViewProjection());
+    const glm::vec4 nearPoint = inverse * glm::vec4(ndc, 0.0f, 1.0f);
+    const glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+    const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    BvhHit hit;
+    if (!sceneBvh.Raycast(origin, glm::vec3(farPoint) / farPoint.w - origin, hit, 1.0f)) return nullptr;
+    return sceneObjects[hit.object];
+}
+
 RequiredLimits Gpu::GetRequiredLimits(Adapter adapter) const {
     SupportedLimits supportedLimits;
     adapter.getLimits(&supportedLimits);
@@ -192,15 +457,23 @@ void Gpu::InitializeSurface(Adapter adapter){
     surface.configure(config);
 }
 void Gpu::InitializeMeshes() {
-    Mesh mesh(device, queue, meshBindGroupLayout, "asteroid.obj");
-    Mesh mesh2(device, queue, meshBindGroupLayout, "krzeslo.obj", &mesh);
-    mesh.AddChild(&mesh2);
-    //Mesh mesh3(device, queue, meshBindGroupLayout, "obszar_prism.obj");
-    mesh.SetTransforms(glm::vec3(1.0f,2.0f,1.0f),glm::vec3(0.0f,-10.0f,1.0f),glm::vec3(1.0f,1.0f,1.0f));
-    mesh2.SetTransforms(glm::vec3(1.0f,1.0f,1.0f),glm::vec3(0.0f,10.0f,1.0f),glm::vec3(1.0f,1.0f,1.0f));
-    //mesh3.SetTransforms(glm::vec3(2.0f,2.0f,2.0f),glm::vec3(0.0f,6.0f,1.0f),glm::vec3(1.0f,1.0f,1.0f));
-    //meshes = {mesh, mesh2, mesh3};
-    meshes = {mesh, mesh2};
+    // meshes load in the background and show up in MainLoop once they are resident
+    MeshHandle mesh = assetLoader.LoadMesh("asteroid.obj", [](Mesh& mesh) {
+        mesh.SetTransforms(glm::vec3(1.0f,2.0f,1.0f),glm::vec3(0.0f,-10.0f,1.0f),glm::vec3(1.0f,1.0f,1.0f));
+    });
+    assetLoader.LoadMesh("krzeslo.obj", [](Mesh& mesh) {
+        mesh.SetTransforms(glm::vec3(1.0f,1.0f,1.0f),glm::vec3(0.0f,10.0f,1.0f),glm::vec3(1.0f,1.0f,1.0f));
+    }, &mesh);
+    // the belt is one mesh drawn ten thousand times at its coarsest level
+    assetLoader.LoadMesh("asteroid.obj", [this](Mesh& mesh) {
+        mesh.SetTransforms(glm::vec3(1.0f,1.0f,1.0f),glm::vec3(0.0f,0.0f,0.0f),glm::vec3(0.0f,0.0f,0.0f));
+        InstancedMesh& field = instancedMeshes.emplace_back(device, queue, instanceBindGroupLayout, gpuCulling, mesh);
+        field.SetLod(uint32_t(mesh.lods.size() - 1));
+        field.Add(AsteroidField(ASTEROID_FIELD_COUNT));
+    });
+    //assetLoader.LoadMesh("obszar_prism.obj", [](Mesh& mesh) {
+    //    mesh.SetTransforms(glm::vec3(2.0f,2.0f,2.0f),glm::vec3(0.0f,6.0f,1.0f),glm::vec3(1.0f,1.0f,1.0f));
+    //});
 }
 void Gpu::InitializeUniforms() {
     BufferDescriptor bufferDesc;
@@ -212,6 +485,8 @@ void Gpu::InitializeUniforms() {
     
     float t = static_cast<float>(glfwGetTime());
     queue.writeBuffer(uniformBuffer, offsetof(Uniforms, time), &t, sizeof(float));
+    uniforms.aspect = Aspect();
+    queue.writeBuffer(uniformBuffer, offsetof(Uniforms, aspect), &uniforms.aspect, sizeof(float));
 }
 void Gpu::InitializeSampler() {
     SamplerDescriptor samplerDesc;
@@ -222,7 +497,7 @@ void Gpu::InitializeSampler() {
     samplerDesc.minFilter = FilterMode::Linear;
     samplerDesc.mipmapFilter = MipmapFilterMode::Linear;
     samplerDesc.lodMinClamp = 0.0f;
-    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.lodMaxClamp = 32.0f; // textures carry full mip chains, don't cut them off
     samplerDesc.compare = CompareFunction::Undefined;
     samplerDesc.maxAnisotropy = 1;
     sampler = device.createSampler(samplerDesc);
@@ -259,8 +534,20 @@ void Gpu::InitializeBinding() {
     bindGroupDesc.entries = bindings.data();
     bindGroup = device.createBindGroup(bindGroupDesc);
 
+    // the transforms of all objects, bound once per frame
+    BindGroupLayoutEntry transformsBindingLayout(Default);
+    transformsBindingLayout.binding = 0;
+    transformsBindingLayout.visibility = ShaderStage::Vertex;
+    transformsBindingLayout.buffer.type = BufferBindingType::ReadOnlyStorage;
+    transformsBindingLayout.buffer.minBindingSize = sizeof(ObjectTransforms);
+
+    bindGroupLayoutDesc.entryCount = 1;
+    bindGroupLayoutDesc.entries = &transformsBindingLayout;
+    meshBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+    transformBuffer.Initialize(device, queue, meshBindGroupLayout);
+
+    // per material binding
     std::vector<BindGroupLayoutEntry> bindingLayoutEntries(3, Default);
-    //BindGroupLayoutEntry textureBindingLayout(Default);
     bindingLayoutEntries[0].binding = 0;
     bindingLayoutEntries[0].visibility = ShaderStage::Fragment;
     bindingLayoutEntries[0].texture.sampleType = TextureSampleType::Float;
@@ -268,9 +555,9 @@ void Gpu::InitializeBinding() {
     bindingLayoutEntries[0].texture.multisampled = 0;
     
     bindingLayoutEntries[1].binding = 1;
-    bindingLayoutEntries[1].visibility = ShaderStage::Vertex;
+    bindingLayoutEntries[1].visibility = ShaderStage::Fragment;
     bindingLayoutEntries[1].buffer.type = BufferBindingType::Uniform;
-    bindingLayoutEntries[1].buffer.minBindingSize = sizeof(ObjectTransforms);
+    bindingLayoutEntries[1].buffer.minBindingSize = sizeof(MaterialUniforms);
 
     bindingLayoutEntries[2].binding = 2;
     bindingLayoutEntries[2].visibility = ShaderStage::Fragment;
@@ -278,12 +565,30 @@ void Gpu::InitializeBinding() {
     bindingLayoutEntries[2].texture.viewDimension = TextureViewDimension::_2D;
     bindingLayoutEntries[2].texture.multisampled = 0;
 
-    // Create a bind group layout
     bindGroupLayoutDesc.entryCount = bindingLayoutEntries.size();
     bindGroupLayoutDesc.entries = bindingLayoutEntries.data();
-    meshBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+    materialBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
     
-    bindGroupLayouts = {bindGroupLayout, meshBindGroupLayout};
+    bindGroupLayouts = {bindGroupLayout, meshBindGroupLayout, materialBindGroupLayout};
+
+    // per instanced mesh binding, its instances, the mesh's transforms and what survived culling
+    std::vector<BindGroupLayoutEntry> instanceBindingLayout(3, Default);
+    instanceBindingLayout[0].binding = 1;
+    instanceBindingLayout[0].visibility = ShaderStage::Vertex;
+    instanceBindingLayout[0].buffer.type = BufferBindingType::ReadOnlyStorage;
+    instanceBindingLayout[0].buffer.minBindingSize = sizeof(InstanceData);
+    instanceBindingLayout[1].binding = 2;
+    instanceBindingLayout[1].visibility = ShaderStage::Vertex;
+    instanceBindingLayout[1].buffer.type = BufferBindingType::Uniform;
+    instanceBindingLayout[1].buffer.minBindingSize = sizeof(ObjectTransforms);
+    instanceBindingLayout[2].binding = 3;
+    instanceBindingLayout[2].visibility = ShaderStage::Vertex;
+    instanceBindingLayout[2].buffer.type = BufferBindingType::ReadOnlyStorage;
+    instanceBindingLayout[2].buffer.minBindingSize = sizeof(uint32_t);
+
+    bindGroupLayoutDesc.entryCount = instanceBindingLayout.size();
+    bindGroupLayoutDesc.entries = instanceBindingLayout.data();
+    instanceBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
 }
 void Gpu::InitializePipeline(){
     // create shader module
@@ -296,23 +601,24 @@ void Gpu::InitializePipeline(){
     // vertex buffer layout
     VertexBufferLayout vertexBufferLayout;
     std::vector<VertexAttribute> vertexAttrib(4);
+    const bool packed = vertexLayout == VertexLayout::Packed;
     
     vertexAttrib[0].shaderLocation = 0;
-    vertexAttrib[0].offset = offsetof(VertexAttributes, position);
-    vertexAttrib[0].format = VertexFormat::Float32x3;
+    vertexAttrib[0].offset = packed ? offsetof(PackedVertex, position) : offsetof(VertexAttributes, position);
+    vertexAttrib[0].format = packed ? VertexFormat::Unorm16x4 : VertexFormat::Float32x3;
     vertexAttrib[1].shaderLocation = 1;
-    vertexAttrib[1].offset = offsetof(VertexAttributes, normal);
-    vertexAttrib[1].format = VertexFormat::Float32x3;
+    vertexAttrib[1].offset = packed ? offsetof(PackedVertex, normal) : offsetof(VertexAttributes, normal);
+    vertexAttrib[1].format = packed ? VertexFormat::Snorm16x2 : VertexFormat::Float32x3;
     vertexAttrib[2].shaderLocation = 2;
-    vertexAttrib[2].offset = offsetof(VertexAttributes, color);
-    vertexAttrib[2].format = VertexFormat::Float32x3;
+    vertexAttrib[2].offset = packed ? offsetof(PackedVertex, color) : offsetof(VertexAttributes, color);
+    vertexAttrib[2].format = packed ? VertexFormat::Unorm8x4 : VertexFormat::Float32x3;
     vertexAttrib[3].shaderLocation = 3;
-    vertexAttrib[3].offset = offsetof(VertexAttributes, texCoords);
-    vertexAttrib[3].format = VertexFormat::Float32x2;
+    vertexAttrib[3].offset = packed ? offsetof(PackedVertex, texCoords) : offsetof(VertexAttributes, texCoords);
+    vertexAttrib[3].format = packed ? VertexFormat::Float16x2 : VertexFormat::Float32x2;
 
     vertexBufferLayout.attributeCount = vertexAttrib.size();
     vertexBufferLayout.attributes = vertexAttrib.data();
-    vertexBufferLayout.arrayStride = sizeof(VertexAttributes);
+    vertexBufferLayout.arrayStride = packed ? sizeof(PackedVertex) : sizeof(VertexAttributes);
     vertexBufferLayout.stepMode = VertexStepMode::Vertex;
 
     // pipeline
@@ -322,7 +628,7 @@ void Gpu::InitializePipeline(){
     pipelineDesc.vertex.buffers = &vertexBufferLayout;
     // vertex shader
     pipelineDesc.vertex.module = shaderModule;
-    pipelineDesc.vertex.entryPoint = "vs_main";
+    pipelineDesc.vertex.entryPoint = packed ? "vs_main_packed" : "vs_main";
     pipelineDesc.vertex.constantCount = 0;
     pipelineDesc.vertex.constants = nullptr;
     pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
@@ -336,8 +642,9 @@ void Gpu::InitializePipeline(){
     fragmentState.constantCount = 0;
     fragmentState.constants = nullptr;
     // blending
+    // fs_main returns premultiplied colour, see ImageLoader::Prepare
     BlendState blendState;
-    blendState.color.srcFactor = BlendFactor::SrcAlpha;
+    blendState.color.srcFactor = BlendFactor::One;
     blendState.color.dstFactor = BlendFactor::OneMinusSrcAlpha;
     blendState.color.operation = BlendOperation::Add;
     blendState.alpha.srcFactor = BlendFactor::Zero;
@@ -371,6 +678,16 @@ void Gpu::InitializePipeline(){
     pipelineDesc.layout = pipelineLayout;
 
     pipeline = device.createRenderPipeline(pipelineDesc);
+
+    // instanced meshes share everything but the vertex entry point and group 1
+    std::vector<BindGroupLayout> instancedBindGroupLayouts = {bindGroupLayout, instanceBindGroupLayout, materialBindGroupLayout};
+    layoutDesc.bindGroupLayoutCount = instancedBindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout*)instancedBindGroupLayouts.data();
+    instancedPipelineLayout = device.createPipelineLayout(layoutDesc);
+    pipelineDesc.label = "Instanced pipeline";
+    pipelineDesc.layout = instancedPipelineLayout;
+    pipelineDesc.vertex.entryPoint = packed ? "vs_instanced_packed" : "vs_instanced";
+    instancedPipeline = device.createRenderPipeline(pipelineDesc);
     shaderModule.release();
 
     // Create the depth texture
@@ -380,7 +697,8 @@ void Gpu::InitializePipeline(){
     depthTextureDesc.mipLevelCount = 1;
     depthTextureDesc.sampleCount = 1;
     depthTextureDesc.size = {640, 480, 1};
-    depthTextureDesc.usage = TextureUsage::RenderAttachment;
+    // the depth pyramid reads it back for occlusion culling
+    depthTextureDesc.usage = TextureUsage::RenderAttachment | TextureUsage::TextureBinding;
     depthTextureDesc.viewFormatCount = 1;
     depthTextureDesc.viewFormats = (WGPUTextureFormat*)&depthTextureFormat;
     depthTexture = device.createTexture(depthTextureDesc);
@@ -421,6 +739,23 @@ void Gpu::UpdateViewMatrix(){
     queue.writeBuffer(uniformBuffer, offsetof(Uniforms, cameraPos), &cameraPos, sizeof(Uniforms::cameraPos));
 }
 
+float Gpu::Aspect() const {
+    return float(config.width) / float(config.height);
+}
+
+glm::mat4x4 Gpu::ViewProjection() const {
+    // mirrors transformVertex in shaders.wgsl
+    const glm::mat4x4 focalTranslation = glm::translate(glm::mat4x4(1.0f), -PROJECTION_FOCAL_POINT);
+    const float divider = 1.0f / (PROJECTION_FOCAL_LENGTH * (PROJECTION_FAR - PROJECTION_NEAR));
+    const glm::mat4x4 projection = glm::transpose(glm::mat4x4(
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, Aspect(), 0.0f, 0.0f,
+        0.0f, 0.0f, PROJECTION_FAR * divider, -PROJECTION_FAR * PROJECTION_NEAR * divider,
+        0.0f, 0.0f, 1.0f / PROJECTION_FOCAL_LENGTH, 0.0f
+    ));
+    return projection * focalTranslation * camera->view;
+}
+
 void Gpu::SetWindow(MainWindow* window) {
     this->window = window;
 }
@@ -1,7 +1,16 @@
 #pragma once
 #include <webgpu/webgpu.hpp>
 #include <vector>
+#include <deque>
 #include "Mesh.hpp"
+#include "InstancedMesh.hpp"
+#include "GpuCulling.hpp"
+#include "DepthPyramid.hpp"
+#include "OcclusionBuffer.hpp"
+#include "AssetLoader.hpp"
+#include "MipmapGenerator.hpp"
+#include "TextureUploader.hpp"
+#include "TransformBuffer.hpp"
 #include "Helpers.hpp"
 #include "Camera.hpp"
 
@@ -16,9 +25,17 @@ void Terminate();
 void MainLoop();
 void UpdateViewMatrix();
 void SetWindow(MainWindow* window);
+// closest mesh under the cursor, by its box, nullptr when there is none
+Mesh* Pick(double x, double y);
 
 float time=0;
 Camera* camera;
+// scales the pixel error LODs may have, above 1 picks coarser levels sooner
+float lodBias = 1.0f;
+// meshes drawn, culled by the frustum and hidden by occluders in the last frame, instanced ones aside
+ObjectCullStats objectCullStats;
+// instances the GPU culling passes counted, read back a few frames late
+OcclusionStats occlusionStats;
 
 private:
 Instance instance;
@@ -28,9 +45,21 @@ Surface surface;
 SurfaceConfiguration config;
 Queue queue;
 RenderPipeline pipeline;
+RenderPipeline instancedPipeline;
 TextureFormat surfaceFormat = TextureFormat::Undefined;
 PipelineLayout pipelineLayout;
-std::vector<Mesh> meshes;
+PipelineLayout instancedPipelineLayout;
+// deque keeps meshes in place as they stream in, children point at their parents
+std::deque<Mesh> meshes;
+std::deque<InstancedMesh> instancedMeshes;
+TransformBuffer transformBuffer;
+GpuCulling gpuCulling;
+DepthPyramid depthPyramid;
+AssetLoader assetLoader;
+MipmapGenerator mipmapGenerator;
+TextureUploader textureUploader;
+// Packed halves vertex memory and fetch bandwidth, Full keeps the 44 byte float layout
+VertexLayout vertexLayout = VertexLayout::Packed;
 TextureView depthTextureView;
 Texture depthTexture;
 Sampler sampler;
@@ -39,8 +68,27 @@ BindGroup bindGroup;
 
 BindGroupLayout bindGroupLayout;
 BindGroupLayout meshBindGroupLayout;
+BindGroupLayout materialBindGroupLayout;
+BindGroupLayout instanceBindGroupLayout;
 std::vector<BindGroupLayout> bindGroupLayouts;
 Uniforms uniforms;
+float cullStatsTime = 0;
+// the meshes drawn on their own, indexed by their id in sceneBvh
+std::vector<Mesh*> sceneObjects;
+SceneBvh sceneBvh;
+bool sceneChanged = false; // meshes streamed in since the last build
+// culling state, reused every frame
+std::vector<uint32_t> visibleObjects, boundaryObjects;
+SphereBatch meshSpheres;
+std::vector<uint8_t> meshVisible;
+// the projection's aspect at a resolution where tiles still cover a few pixels of a big occluder
+OcclusionBuffer occlusionBuffer{256, 192};
+std::vector<Occluder> occluders;
+// object and its projected size or distance while picking occluders
+std::vector<std::pair<float, uint32_t>> occluderObjects;
+std::vector<uint32_t> occludeeObjects;
+std::vector<Bounds> occludeeBounds;
+std::vector<uint8_t> occludeeVisible;
 
 RequiredLimits GetRequiredLimits(Adapter adapter) const;
 void InitializeSurface(Adapter adapter);
@@ -49,6 +97,13 @@ void InitializeSampler();
 void InitializeUniforms();
 void InitializeBinding();
 void InitializePipeline();
+void RebuildScene();
+// drops the visible objects hidden behind the nearest big ones, which are kept and come first
+void CullOccluded(const glm::mat4x4& viewProjection, const glm::vec3& cameraPosition);
+// what the vertex shader projects with, for culling on the CPU
+glm::mat4x4 ViewProjection() const;
+// of the surface, the shader gets it through Uniforms
+float Aspect() const;
 void SetCallbacks();
 std::pair<SurfaceTexture, TextureView> GetNextSurfaceViewData();
 };
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "GpuCulling.hpp"
+#include "ResourceManager.hpp"
+
+// threads per workgroup of cs_cull_early and cs_cull_late in culling.wgsl
+constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+
+bool GpuCulling::Initialize(Device device) {
+    this->device = device;
+    std::vector<BindGroupLayoutEntry> bindingLayoutEntries(7, Default);
+    bindingLayoutEntries[0].binding = 0;
+    bindingLayoutEntries[0].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[0].buffer.type = BufferBindingType::Uniform;
+    bindingLayoutEntries[0].buffer.minBindingSize = sizeof(CullUniforms);
+
+    bindingLayoutEntries[1].binding = 1;
+    bindingLayoutEntries[1].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[1].buffer.type = BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[1].buffer.minBindingSize = sizeof(InstanceData);
+
+    // the early and the late visible list and arguments look alike
+    for (uint32_t binding = 2; binding <= 5; ++binding) {
+        const bool list = binding % 2 == 0;
+        bindingLayoutEntries[binding].binding = binding;
+        bindingLayoutEntries[binding].visibility = ShaderStage::Compute;
+        bindingLayoutEntries[binding].buffer.type = BufferBindingType::Storage;
+        bindingLayoutEntries[binding].buffer.minBindingSize = list ? sizeof(uint32_t) : sizeof(uint32_t) + sizeof(DrawIndexedArgs);
+    }
+
+    bindingLayoutEntries[6].binding = 6;
+    bindingLayoutEntries[6].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[6].buffer.type = BufferBindingType::Storage;
+    bindingLayoutEntries[6].buffer.minBindingSize = sizeof(uint32_t);
+
+    BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+    bindGroupLayoutDesc.entryCount = bindingLayoutEntries.size();
+    bindGroupLayoutDesc.entries = bindingLayoutEntries.data();
+    bindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+
+    std::vector<BindGroupLayoutEntry> frameLayoutEntries(2, Default);
+    frameLayoutEntries[0].binding = 0;
+    frameLayoutEntries[0].visibility = ShaderStage::Compute;
+    frameLayoutEntries[0].texture.sampleType = TextureSampleType::UnfilterableFloat;
+    frameLayoutEntries[0].texture.viewDimension = TextureViewDimension::_2D;
+
+    frameLayoutEntries[1].binding = 1;
+    frameLayoutEntries[1].visibility = ShaderStage::Compute;
+    frameLayoutEntries[1].buffer.type = BufferBindingType::Storage;
+    frameLayoutEntries[1].buffer.minBindingSize = sizeof(OcclusionStats);
+
+    bindGroupLayoutDesc.entryCount = frameLayoutEntries.size();
+    bindGroupLayoutDesc.entries = frameLayoutEntries.data();
+    frameBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+
+    ShaderModule shaderModule = ResourceManager::loadShaderModule("src/culling.wgsl", device);
+    if (shaderModule == nullptr) {
+        std::cerr << "Could not load culling shader!" << std::endl;
+        return false;
+    }
+    std::vector<BindGroupLayout> layouts = {bindGroupLayout, frameBindGroupLayout};
+    PipelineLayoutDescriptor layoutDesc{};
+    layoutDesc.bindGroupLayoutCount = layouts.size();
+    layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout*)layouts.data();
+    PipelineLayout layout = device.createPipelineLayout(layoutDesc);
+
+    ComputePipelineDescriptor pipelineDesc;
+    pipelineDesc.label = "Early culling pipeline";
+    pipelineDesc.layout = layout;
+    pipelineDesc.compute.module = shaderModule;
+    pipelineDesc.compute.entryPoint = "cs_cull_early";
+    pipelineDesc.compute.constantCount = 0;
+    pipelineDesc.compute.constants = nullptr;
+    earlyPipeline = device.createComputePipeline(pipelineDesc);
+    pipelineDesc.label = "Late culling pipeline";
+    pipelineDesc.compute.entryPoint = "cs_cull_late";
+    latePipeline = device.createComputePipeline(pipelineDesc);
+    pipelineDesc.label = "Early culling finish pipeline";
+    pipelineDesc.compute.entryPoint = "cs_finish_early";
+    finishEarlyPipeline = device.createComputePipeline(pipelineDesc);
+    pipelineDesc.label = "Late culling finish pipeline";
+    pipelineDesc.compute.entryPoint = "cs_finish_late";
+    finishLatePipeline = device.createComputePipeline(pipelineDesc);
+    shaderModule.release();
+    layout.release();
+
+    BufferDescriptor bufferDesc;
+    bufferDesc.label = "occlusion stats";
+    bufferDesc.size = sizeof(OcclusionStats);
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::CopySrc | BufferUsage::Storage;
+    bufferDesc.mappedAtCreation = false;
+    statsBuffer = device.createBuffer(bufferDesc);
+    bufferDesc.label = "occlusion stats readback";
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::MapRead;
+    readbackBuffer = device.createBuffer(bufferDesc);
+    return true;
+}
+
+void GpuCulling::Terminate() {
+    // a pending map has to finish before its buffer goes
+    while (readbackPending) device.tick();
+    if (earlyPipeline) earlyPipeline.release();
+    if (latePipeline) latePipeline.release();
+    if (finishEarlyPipeline) finishEarlyPipeline.release();
+    if (finishLatePipeline) finishLatePipeline.release();
+    if (frameBindGroup) frameBindGroup.release();
+    if (bindGroupLayout) bindGroupLayout.release();
+    if (frameBindGroupLayout) frameBindGroupLayout.release();
+    if (statsBuffer) {
+        statsBuffer.destroy();
+        statsBuffer.release();
+    }
+    if (readbackBuffer) {
+        readbackBuffer.destroy();
+        readbackBuffer.release();
+    }
+}
+
+void GpuCulling::SetDepthPyramid(const DepthPyramid& depthPyramid) {
+    if (frameBindGroup) frameBindGroup.release();
+    std::vector<BindGroupEntry> bindings(2);
+    bindings[0].binding = 0;
+    bindings[0].textureView = depthPyramid.GetView();
+
+    bindings[1].binding = 1;
+    bindings[1].buffer = statsBuffer;
+    bindings[1].offset = 0;
+    bindings[1].size = sizeof(OcclusionStats);
+
+    BindGroupDescriptor bindGroupDesc;
+    bindGroupDesc.layout = frameBindGroupLayout;
+    bindGroupDesc.entryCount = bindings.size();
+    bindGroupDesc.entries = bindings.data();
+    frameBindGroup = device.createBindGroup(bindGroupDesc);
+}
+
+BindGroupLayout GpuCulling::GetBindGroupLayout() const {
+    return bindGroupLayout;
+}
+
+void GpuCulling::BeginFrame(CommandEncoder encoder) {
+    encoder.clearBuffer(statsBuffer, 0, sizeof(OcclusionStats));
+}
+
+void GpuCulling::Dispatch(ComputePassEncoder computePass, BindGroup bindGroup, uint32_t instanceCount, CullPhase phase) const {
+    computePass.setBindGroup(0, bindGroup, 0, nullptr);
+    computePass.setBindGroup(1, frameBindGroup, 0, nullptr);
+    if (instanceCount > 0) {
+        computePass.setPipeline(phase == CullPhase::Early ? earlyPipeline : latePipeline);
+        computePass.dispatchWorkgroups((instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+    }
+    // runs even without instances, so the arguments never keep an old count
+    computePass.setPipeline(phase == CullPhase::Early ? finishEarlyPipeline : finishLatePipeline);
+    computePass.dispatchWorkgroups(1, 1, 1);
+}
+
+void GpuCulling::EndFrame(CommandEncoder encoder) {
+    // frames go by uncounted while the last copy is still being mapped
+    if (readbackPending) return;
+    encoder.copyBufferToBuffer(statsBuffer, 0, readbackBuffer, 0, sizeof(OcclusionStats));
+    statsQueued = true;
+}
+
+void GpuCulling::ReadStats() {
+    if (!statsQueued) return;
+    statsQueued = false;
+    readbackPending = true;
+    // the callback runs from a later device tick, TextureUploader::Poll ticks every frame
+    readbackCallback = readbackBuffer.mapAsync(MapMode::Read, 0, sizeof(OcclusionStats), [this](BufferMapAsyncStatus status) {
+        if (status == BufferMapAsyncStatus::Success) {
+            std::memcpy(&stats, readbackBuffer.getConstMappedRange(0, sizeof(OcclusionStats)), sizeof(OcclusionStats));
+            readbackBuffer.unmap();
+        }
+        readbackPending = false;
+    });
+}
+
+const OcclusionStats& GpuCulling::GetStats() const {
+    return stats;
+}
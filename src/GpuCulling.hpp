@@ -0,0 +1,50 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <cstdint>
+#include <memory>
+#include "DepthPyramid.hpp"
+#include "Helpers.hpp"
+
+using namespace wgpu;
+
+// the two halves of a frame's occlusion culling
+enum class CullPhase {
+    Early, // instances visible last frame, drawn before the depth pyramid is built
+    Late,  // every instance against the pyramid, the ones the early phase missed are drawn after
+};
+
+// Frustum and occlusion culls instances in compute passes. The survivors of a set are appended
+// to its visible lists and their count is written into its indirect draw arguments, so the CPU
+// issues the same few draws whether a set holds a hundred instances or a million.
+class GpuCulling {
+public:
+    // false when the shader could not be loaded
+    bool Initialize(Device device);
+    void Terminate();
+    // the pyramid the late phase tests against, before the first Dispatch
+    void SetDepthPyramid(const DepthPyramid& depthPyramid);
+    // bindings of one set: CullUniforms, instances, early visible list and indirect arguments,
+    // late visible list and indirect arguments, last frame's visibility
+    BindGroupLayout GetBindGroupLayout() const;
+    // clears the frame's counters, ahead of any Dispatch
+    void BeginFrame(CommandEncoder encoder);
+    // records one phase of the culling of a set into computePass
+    void Dispatch(ComputePassEncoder computePass, BindGroup bindGroup, uint32_t instanceCount, CullPhase phase) const;
+    // queues the frame's counters for reading, after the last Dispatch
+    void EndFrame(CommandEncoder encoder);
+    // maps what EndFrame queued, once the frame was submitted
+    void ReadStats();
+    // counters of the latest frame read back, a few frames behind the one being drawn
+    const OcclusionStats& GetStats() const;
+
+private:
+    ComputePipeline earlyPipeline, latePipeline, finishEarlyPipeline, finishLatePipeline;
+    BindGroupLayout bindGroupLayout, frameBindGroupLayout;
+    BindGroup frameBindGroup;
+    Buffer statsBuffer, readbackBuffer;
+    std::unique_ptr<BufferMapCallback> readbackCallback;
+    bool statsQueued = false;
+    bool readbackPending = false;
+    OcclusionStats stats;
+    Device device;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <glm/glm.hpp>
 
 struct Uniforms {
@@ -10,10 +11,12 @@ struct Uniforms {
     };
     glm::vec3 cameraPos;
     float time;
-    //float pad[3];
+    float aspect; // surface width over height, the projection scales y by it
+    float pad[3];
 };
 
-struct ObjectTransforms {
+// placement of a mesh on the CPU, composed down the mesh hierarchy
+struct MeshTransforms {
     glm::mat4x4 Rot= {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
@@ -34,6 +37,70 @@ struct ObjectTransforms {
     };
 };
 
+// glm is column major, the shaders take affine transforms as the top three rows
+inline void StoreAffineRows(const glm::mat4x4& transform, glm::vec4 rows[3]) {
+    const glm::mat4x4 transposed = glm::transpose(transform);
+    rows[0] = transposed[0];
+    rows[1] = transposed[1];
+    rows[2] = transposed[2];
+}
+
+// what the shaders see of an object, one slot of the TransformBuffer
+struct ObjectTransforms {
+    // rows of the affine 3x4 model matrix, the last row is always 0 0 0 1
+    glm::vec4 rows[3] = {
+        glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+        glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+        glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+    };
+    // packed vertex positions are unorm16 in the mesh AABB, position = offset + q * scale
+    glm::vec4 QuantOffset = glm::vec4(0.0f);
+    glm::vec4 QuantScale = glm::vec4(1.0f);
+};
+
+// one instance of an InstancedMesh, placed inside the mesh's own transform
+struct InstanceData {
+    // rows of an affine 3x4 matrix, the last row is always 0 0 0 1
+    glm::vec4 rows[3] = {
+        glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+        glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+        glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+    };
+    glm::vec4 color = glm::vec4(1.0f); // tints the material colour
+};
+
+// per InstancedMesh input of the culling pass, see culling.wgsl
+struct CullUniforms {
+    glm::mat4x4 viewProjection; // projects bounding boxes onto the depth pyramid
+    glm::vec4 planes[6];  // world space frustum, see Frustum
+    glm::vec4 rows[3];    // the mesh's model matrix, places every instance
+    glm::vec4 sphere;     // bounding sphere of the mesh, xyz centre and w radius
+    uint32_t instanceCount = 0;
+    uint32_t drawCount = 0;
+    uint32_t pad[2] = {};
+};
+
+// arguments of one drawIndexedIndirect as the GPU reads them
+struct DrawIndexedArgs {
+    uint32_t indexCount = 0;
+    uint32_t instanceCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t baseVertex = 0;
+    uint32_t firstInstance = 0;
+};
+
+// instances counted by the culling passes of one frame, over every InstancedMesh
+struct OcclusionStats {
+    uint32_t inFrustum = 0;
+    uint32_t earlyDrawn = 0; // visible last frame, drawn before the depth pyramid is built
+    uint32_t lateDrawn = 0;  // came into view this frame, drawn after testing against it
+    uint32_t occluded = 0;
+};
+
+struct MaterialUniforms {
+    glm::vec4 baseColor = glm::vec4(1.0f);
+};
+
 struct CameraState {
     glm::vec2 angles = {0.0f, 0.0f};
     float zoom;
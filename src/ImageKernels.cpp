@@ -0,0 +1,77 @@
+#include "ImageKernels.hpp"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_KERNELS_SSE2 1
+#endif
+
+namespace {
+// round(channel * alpha / 255) without a division, the SSE2 path does the same in 16 bit lanes
+uint8_t PremultiplyChannel(uint8_t channel, uint8_t alpha) {
+    const uint32_t product = uint32_t(channel) * alpha + 128;
+    return static_cast<uint8_t>((product + (product >> 8)) >> 8);
+}
+}
+
+void ImageKernels::ExpandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t pixelCount) {
+    size_t i = 0;
+#ifdef IMAGE_KERNELS_SSE2
+    // four pixels per step, the 16 byte load reaches into the next two
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+    for (; i + 6 <= pixelCount; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(rgb + 3 * i));
+        // shifting by whole pixels lines each one up at the bottom of a dword
+        const __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+        const __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+        _mm_storeu_si128((__m128i*)(rgba + 4 * i), _mm_or_si128(_mm_unpacklo_epi64(p01, p23), alpha));
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        rgba[4 * i + 0] = rgb[3 * i + 0];
+        rgba[4 * i + 1] = rgb[3 * i + 1];
+        rgba[4 * i + 2] = rgb[3 * i + 2];
+        rgba[4 * i + 3] = 255;
+    }
+}
+
+bool ImageKernels::HasTransparency(const uint8_t* rgba, size_t pixelCount) {
+    size_t i = 0;
+#ifdef IMAGE_KERNELS_SSE2
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+    for (; i + 4 <= pixelCount; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(rgba + 4 * i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha), alpha)) != 0xFFFF) return true;
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        if (rgba[4 * i + 3] != 255) return true;
+    }
+    return false;
+}
+
+void ImageKernels::PremultiplyAlpha(uint8_t* rgba, size_t pixelCount) {
+    size_t i = 0;
+#ifdef IMAGE_KERNELS_SSE2
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 4 <= pixelCount; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(rgba + 4 * i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha), alpha)) == 0xFFFF) continue;
+        // two pixels per register, each channel in a 16 bit lane next to a copy of its alpha
+        __m128i halves[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+        for (__m128i& pixels : halves) {
+            const __m128i coverage = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            const __m128i product = _mm_add_epi16(_mm_mullo_epi16(pixels, coverage), half);
+            pixels = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+        }
+        // alpha itself is kept as it was
+        const __m128i packed = _mm_packus_epi16(halves[0], halves[1]);
+        _mm_storeu_si128((__m128i*)(rgba + 4 * i), _mm_or_si128(_mm_andnot_si128(alpha, packed), _mm_and_si128(alpha, v)));
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        uint8_t* pixel = rgba + 4 * i;
+        if (pixel[3] == 255) continue;
+        for (int channel = 0; channel < 3; ++channel) pixel[channel] = PremultiplyChannel(pixel[channel], pixel[3]);
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Pixel conversions run on every decoded image. SSE2 where the compiler targets it,
+// with a scalar path for the tail and other targets that produces the same bytes.
+class ImageKernels {
+public:
+    static void ExpandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t pixelCount);
+    static bool HasTransparency(const uint8_t* rgba, size_t pixelCount);
+    // scales the stored colour bytes by alpha, colour maps are RGBA8Unorm and blended with
+    // One/OneMinusSrcAlpha, so these are the values the shader reads and the blend expects
+    static void PremultiplyAlpha(uint8_t* rgba, size_t pixelCount);
+};
@@ -0,0 +1,110 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "ImageLoader.hpp"
+#include "ImageKernels.hpp"
+#include "Ktx2.hpp"
+#include "TextureCodec.hpp"
+#include "Vfs.hpp"
+
+namespace {
+const fs::path TEXTURES_DIR = "assets/textures";
+
+// stb decodes to the file's own channel count, so RGB is widened by the SIMD kernel instead of stb's scalar loop
+void StoreRgba(const unsigned char* data, int channels, ImageData& image) {
+    const size_t pixelCount = size_t(image.width) * image.height;
+    image.pixels.resize(4 * pixelCount);
+    if (channels == 4) {
+        std::memcpy(image.pixels.data(), data, image.pixels.size());
+    }
+    else if (channels == 3) {
+        ImageKernels::ExpandRgbToRgba(data, image.pixels.data(), pixelCount);
+    }
+    else {
+        // grey, with or without alpha
+        for (size_t i = 0; i < pixelCount; ++i) {
+            const uint8_t grey = data[channels * i];
+            image.pixels[4 * i + 0] = grey;
+            image.pixels[4 * i + 1] = grey;
+            image.pixels[4 * i + 2] = grey;
+            image.pixels[4 * i + 3] = channels == 2 ? data[2 * i + 1] : 255;
+        }
+    }
+}
+
+bool TextureExists(const fs::path& path, bool normalMap) {
+    return Vfs::Exists(path) || Vfs::Exists(ImageLoader::CookedPath(path, normalMap));
+}
+}
+
+fs::path ImageLoader::ResolvePath(const fs::path& modelPath, std::string name, bool normalMap) {
+    if (name.empty()) return {};
+    std::replace(name.begin(), name.end(), '\\', '/');
+    fs::path path = fs::u8path(name);
+    if (path.is_relative()) path = modelPath.parent_path()/path;
+    if (TextureExists(path, normalMap)) return path;
+    // exported MTLs often point at the author's machine, look for the file among our textures
+    fs::path fallback = TEXTURES_DIR/fs::u8path(name).filename();
+    if (TextureExists(fallback, normalMap)) return fallback;
+    std::cerr << "Could not find texture " << name << std::endl;
+    return {};
+}
+
+fs::path ImageLoader::CookedPath(const fs::path& sourcePath, bool normalMap) {
+    // colour and normal maps cook differently, an image used as both gets two files
+    fs::path cookedPath = sourcePath;
+    cookedPath += normalMap ? ".normal.ktx2" : ".ktx2";
+    return cookedPath;
+}
+
+ImageData ImageLoader::Decode(const uint8_t* data, size_t size, const std::string& name) {
+    ImageData image;
+    int channels;
+    unsigned char *pixels = stbi_load_from_memory(data, int(size), &image.width, &image.height, &channels, 0);
+    if (pixels==nullptr) {
+        std::cerr << "Could not load texture " << name << std::endl;
+        return image;
+    }
+    StoreRgba(pixels, channels, image);
+    stbi_image_free(pixels);
+    return image;
+}
+
+void ImageLoader::Prepare(ImageData& image, const std::string& name, bool normalMap) {
+    if (!image.pixels.empty() && !TextureCodec::Transcode(image)) {
+        std::cerr << name << ": the device can't sample this format and there is no CPU decoder for it" << std::endl;
+        image = ImageData();
+        return;
+    }
+    if (normalMap) {
+        TextureCodec::PrepareNormalMap(image);
+        return;
+    }
+    // colour maps with transparency are stored premultiplied, so filtering and mip levels
+    // don't bleed the colour of texels nobody is meant to see; cooked ones already are
+    if (image.format == TextureFormat::RGBA8Unorm && !image.premultiplied &&
+        ImageKernels::HasTransparency(image.pixels.data(), image.pixels.size() / 4)) {
+        ImageKernels::PremultiplyAlpha(image.pixels.data(), image.pixels.size() / 4);
+        for (auto& mip : image.mips) ImageKernels::PremultiplyAlpha(mip.data(), mip.size() / 4);
+        image.premultiplied = true;
+    }
+}
+
+ImageData ImageLoader::Load(const fs::path& path, bool normalMap) {
+    ImageData image;
+    if (path.extension() == ".ktx2") {
+        if (!Ktx2::Load(path, image)) return ImageData();
+    }
+    else {
+        VfsFile file;
+        if (!Vfs::Open(path, file)) {
+            std::cerr << "Could not load texture " << path.string() << std::endl;
+            return ImageData();
+        }
+        image = Decode(file.Data(), file.Size(), path.string());
+    }
+    Prepare(image, path.string(), normalMap);
+    return image;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include "ResourceManager.hpp"
+
+namespace fs = std::filesystem;
+
+// Turns image files into ImageData the device can sample: PNG/JPG through stb, KTX2
+// containers as they are, then transcoding, normal map reduction and premultiplied alpha.
+// Shared by the App and the AssetCooker, so nothing in here touches the GPU.
+class ImageLoader {
+public:
+    // finds a texture named by a model, next to it or among the shared textures; a source
+    // only present in its cooked form still resolves to the source path
+    static fs::path ResolvePath(const fs::path& modelPath, std::string name, bool normalMap);
+    // where the cooker leaves the runtime ready form of a source image
+    static fs::path CookedPath(const fs::path& sourcePath, bool normalMap);
+
+    static ImageData Decode(const uint8_t* data, size_t size, const std::string& name);
+    // leaves a decoded image in a format the device can sample
+    static void Prepare(ImageData& image, const std::string& name, bool normalMap);
+    // reads a texture file and prepares it
+    static ImageData Load(const fs::path& path, bool normalMap);
+};
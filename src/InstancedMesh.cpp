@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "InstancedMesh.hpp"
+
+// instance buffers start this large and double from there
+constexpr uint32_t MIN_INSTANCE_CAPACITY = 256;
+// clean slots a write may carry along to save another call
+constexpr uint32_t DIRTY_GAP_INSTANCES = 16;
+constexpr uint32_t NO_SLOT = ~0u;
+
+InstancedMesh::InstancedMesh(Device device, Queue queue, BindGroupLayout instanceBindGroupLayout, const GpuCulling& culling, Mesh& mesh)
+    : device(device), queue(queue), bindGroupLayout(instanceBindGroupLayout), culling(&culling), mesh(&mesh) {
+    mesh.instanced = true;
+    // the whole set is placed by the mesh's transforms, kept apart from the shared TransformBuffer
+    BufferDescriptor bufferDesc;
+    bufferDesc.label = "instanced object transforms data";
+    bufferDesc.size = sizeof(ObjectTransforms);
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
+    bufferDesc.mappedAtCreation = false;
+    transformsBuffer = device.createBuffer(bufferDesc);
+    meshTransforms = mesh.GpuTransforms();
+    queue.writeBuffer(transformsBuffer, 0, &meshTransforms, sizeof(ObjectTransforms));
+
+    bufferDesc.label = "instance culling uniform data";
+    bufferDesc.size = sizeof(CullUniforms);
+    cullUniformBuffer = device.createBuffer(bufferDesc);
+    // room for the visible count and the arguments of the level with the most material ranges
+    bufferDesc.label = "instance draw arguments";
+    bufferDesc.size = sizeof(uint32_t) + std::max<size_t>(mesh.submeshes.size(), 1) * sizeof(DrawIndexedArgs);
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Storage | BufferUsage::Indirect;
+    drawBuffer = device.createBuffer(bufferDesc);
+    bufferDesc.label = "late instance draw arguments";
+    lateDrawBuffer = device.createBuffer(bufferDesc);
+    WriteDraws();
+    Reserve(MIN_INSTANCE_CAPACITY);
+}
+
+InstanceData InstancedMesh::MakeInstance(const glm::mat4x4& transform, const glm::vec4& color) {
+    InstanceData instance;
+    StoreAffineRows(transform, instance.rows);
+    instance.color = color;
+    return instance;
+}
+
+std::vector<InstanceId> InstancedMesh::Add(const std::vector<InstanceData>& added) {
+    std::vector<InstanceId> ids(added.size());
+    instances.reserve(instances.size() + added.size());
+    for (size_t i = 0; i < added.size(); ++i) {
+        InstanceId id;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        else {
+            id = InstanceId(idSlots.size());
+            idSlots.push_back(NO_SLOT);
+        }
+        const uint32_t slot = uint32_t(instances.size());
+        idSlots[id] = slot;
+        slotIds.push_back(id);
+        instances.push_back(added[i]);
+        dirty.Mark(slot);
+        ids[i] = id;
+    }
+    return ids;
+}
+
+void InstancedMesh::Remove(const std::vector<InstanceId>& ids) {
+    for (InstanceId id : ids) {
+        assert(id < idSlots.size() && idSlots[id] != NO_SLOT);
+        // the last instance moves into the hole, the array stays dense
+        const uint32_t slot = idSlots[id];
+        const uint32_t last = uint32_t(instances.size() - 1);
+        // the moved instance takes over the slot's visibility flag, which at worst draws it
+        // in the other phase for a frame
+        if (slot != last) {
+            instances[slot] = instances[last];
+            slotIds[slot] = slotIds[last];
+            idSlots[slotIds[slot]] = slot;
+            dirty.Mark(slot);
+        }
+        instances.pop_back();
+        slotIds.pop_back();
+        idSlots[id] = NO_SLOT;
+        freeIds.push_back(id);
+    }
+}
+
+void InstancedMesh::Update(const std::vector<InstanceId>& ids, const std::vector<InstanceData>& updated) {
+    assert(ids.size() == updated.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        assert(ids[i] < idSlots.size() && idSlots[ids[i]] != NO_SLOT);
+        const uint32_t slot = idSlots[ids[i]];
+        instances[slot] = updated[i];
+        dirty.Mark(slot);
+    }
+}
+
+const InstanceData& InstancedMesh::Get(InstanceId id) const {
+    assert(id < idSlots.size() && idSlots[id] != NO_SLOT);
+    return instances[idSlots[id]];
+}
+
+uint32_t InstancedMesh::InstanceCount() const {
+    return uint32_t(instances.size());
+}
+
+void InstancedMesh::SetLod(uint32_t lod) {
+    this->lod = lod;
+    WriteDraws();
+}
+
+void InstancedMesh::WriteDraws() {
+    // the instance counts are left to the culling pass
+    std::vector<DrawIndexedArgs> draws;
+    if (!mesh->lods.empty()) {
+        const MeshLod& level = mesh->lods[std::min<size_t>(lod, mesh->lods.size() - 1)];
+        for (uint32_t s = level.firstSubmesh; s < level.firstSubmesh + level.submeshCount; ++s) {
+            DrawIndexedArgs draw;
+            draw.indexCount = mesh->submeshes[s].indexCount;
+            draw.firstIndex = mesh->submeshes[s].firstIndex;
+            draws.push_back(draw);
+        }
+    }
+    drawCount = uint32_t(draws.size());
+    if (draws.empty()) return;
+    queue.writeBuffer(drawBuffer, sizeof(uint32_t), draws.data(), draws.size() * sizeof(DrawIndexedArgs));
+    queue.writeBuffer(lateDrawBuffer, sizeof(uint32_t), draws.data(), draws.size() * sizeof(DrawIndexedArgs));
+}
+
+void InstancedMesh::Reserve(uint32_t count) {
+    if (count <= capacity) return;
+    capacity = std::max({count, 2 * capacity, MIN_INSTANCE_CAPACITY});
+    if (instanceBuffer) {
+        instanceBuffer.destroy();
+        instanceBuffer.release();
+        visibleBuffer.destroy();
+        visibleBuffer.release();
+        lateVisibleBuffer.destroy();
+        lateVisibleBuffer.release();
+        visibilityBuffer.destroy();
+        visibilityBuffer.release();
+        bindGroup.release();
+        lateBindGroup.release();
+        cullBindGroup.release();
+    }
+    BufferDescriptor bufferDesc;
+    bufferDesc.label = "instance data";
+    bufferDesc.size = uint64_t(capacity) * sizeof(InstanceData);
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Storage;
+    bufferDesc.mappedAtCreation = false;
+    instanceBuffer = device.createBuffer(bufferDesc);
+    // indices of the instances that survived culling, written by the culling passes only
+    bufferDesc.label = "visible instances";
+    bufferDesc.size = uint64_t(capacity) * sizeof(uint32_t);
+    bufferDesc.usage = BufferUsage::Storage;
+    visibleBuffer = device.createBuffer(bufferDesc);
+    bufferDesc.label = "late visible instances";
+    lateVisibleBuffer = device.createBuffer(bufferDesc);
+    // starts out zeroed, the first frame draws everything in the late phase
+    bufferDesc.label = "instance visibility";
+    visibilityBuffer = device.createBuffer(bufferDesc);
+
+    std::vector<BindGroupEntry> bindings(3);
+    bindings[0].binding = 1;
+    bindings[0].buffer = instanceBuffer;
+    bindings[0].offset = 0;
+    bindings[0].size = instanceBuffer.getSize();
+
+    bindings[1].binding = 2;
+    bindings[1].buffer = transformsBuffer;
+    bindings[1].offset = 0;
+    bindings[1].size = sizeof(ObjectTransforms);
+
+    bindings[2].binding = 3;
+    bindings[2].buffer = visibleBuffer;
+    bindings[2].offset = 0;
+    bindings[2].size = visibleBuffer.getSize();
+
+    BindGroupDescriptor bindGroupDesc;
+    bindGroupDesc.layout = bindGroupLayout;
+    bindGroupDesc.entryCount = bindings.size();
+    bindGroupDesc.entries = bindings.data();
+    bindGroup = device.createBindGroup(bindGroupDesc);
+    bindings[2].buffer = lateVisibleBuffer;
+    lateBindGroup = device.createBindGroup(bindGroupDesc);
+
+    std::vector<BindGroupEntry> cullBindings(7);
+    cullBindings[0].binding = 0;
+    cullBindings[0].buffer = cullUniformBuffer;
+    cullBindings[0].offset = 0;
+    cullBindings[0].size = sizeof(CullUniforms);
+
+    cullBindings[1].binding = 1;
+    cullBindings[1].buffer = instanceBuffer;
+    cullBindings[1].offset = 0;
+    cullBindings[1].size = instanceBuffer.getSize();
+
+    cullBindings[2].binding = 2;
+    cullBindings[2].buffer = visibleBuffer;
+    cullBindings[2].offset = 0;
+    cullBindings[2].size = visibleBuffer.getSize();
+
+    cullBindings[3].binding = 3;
+    cullBindings[3].buffer = drawBuffer;
+    cullBindings[3].offset = 0;
+    cullBindings[3].size = drawBuffer.getSize();
+
+    cullBindings[4].binding = 4;
+    cullBindings[4].buffer = lateVisibleBuffer;
+    cullBindings[4].offset = 0;
+    cullBindings[4].size = lateVisibleBuffer.getSize();
+
+    cullBindings[5].binding = 5;
+    cullBindings[5].buffer = lateDrawBuffer;
+    cullBindings[5].offset = 0;
+    cullBindings[5].size = lateDrawBuffer.getSize();
+
+    cullBindings[6].binding = 6;
+    cullBindings[6].buffer = visibilityBuffer;
+    cullBindings[6].offset = 0;
+    cullBindings[6].size = visibilityBuffer.getSize();
+
+    bindGroupDesc.layout = culling->GetBindGroupLayout();
+    bindGroupDesc.entryCount = cullBindings.size();
+    bindGroupDesc.entries = cullBindings.data();
+    cullBindGroup = device.createBindGroup(bindGroupDesc);
+    // a new buffer starts out empty
+    dirty.MarkAll();
+}
+
+void InstancedMesh::Upload() {
+    const ObjectTransforms transforms = mesh->GpuTransforms();
+    if (std::memcmp(&transforms, &meshTransforms, sizeof(ObjectTransforms)) != 0) {
+        meshTransforms = transforms;
+        queue.writeBuffer(transformsBuffer, 0, &meshTransforms, sizeof(ObjectTransforms));
+    }
+    Reserve(uint32_t(instances.size()));
+    dirty.Flush(uint32_t(instances.size()), DIRTY_GAP_INSTANCES, [this](uint32_t first, uint32_t count) {
+        queue.writeBuffer(instanceBuffer, uint64_t(first) * sizeof(InstanceData), &instances[first],
+            size_t(count) * sizeof(InstanceData));
+    });
+}
+
+void InstancedMesh::Cull(ComputePassEncoder computePass, const Frustum& frustum, const glm::mat4x4& viewProjection, CullPhase phase) {
+    CullUniforms uniforms;
+    uniforms.viewProjection = viewProjection;
+    for (int i = 0; i < 6; ++i) uniforms.planes[i] = frustum.planes[i];
+    for (int i = 0; i < 3; ++i) uniforms.rows[i] = meshTransforms.rows[i];
+    uniforms.sphere = glm::vec4(mesh->sphere.center, mesh->sphere.radius);
+    uniforms.instanceCount = uint32_t(instances.size());
+    uniforms.drawCount = drawCount;
+    queue.writeBuffer(cullUniformBuffer, 0, &uniforms, sizeof(CullUniforms));
+    culling->Dispatch(computePass, cullBindGroup, uniforms.instanceCount, phase);
+}
+
+void InstancedMesh::Draw(RenderPassEncoder renderPass, CullPhase phase) const {
+    if (instances.empty() || drawCount == 0) return;
+    const bool late = phase == CullPhase::Late;
+    renderPass.setBindGroup(1, late ? lateBindGroup : bindGroup, 0, nullptr);
+    renderPass.setVertexBuffer(0, mesh->vertexBuffer, 0, mesh->vertexBuffer.getSize());
+    renderPass.setIndexBuffer(mesh->indexBuffer, mesh->indexFormat, 0, mesh->indexBuffer.getSize());
+    // one indirect draw per material range of the level, covering whatever the culling phase kept
+    const MeshLod& level = mesh->lods[std::min<size_t>(lod, mesh->lods.size() - 1)];
+    for (uint32_t i = 0; i < drawCount; ++i) {
+        const Submesh& submesh = mesh->submeshes[level.firstSubmesh + i];
+        if (submesh.indexCount == 0) continue;
+        renderPass.setBindGroup(2, mesh->materials[submesh.material].bindGroup, 0, nullptr);
+        renderPass.drawIndexedIndirect(late ? lateDrawBuffer : drawBuffer, sizeof(uint32_t) + uint64_t(i) * sizeof(DrawIndexedArgs));
+    }
+}
+
+void InstancedMesh::Terminate() {
+    transformsBuffer.release();
+    cullUniformBuffer.release();
+    drawBuffer.destroy();
+    drawBuffer.release();
+    lateDrawBuffer.destroy();
+    lateDrawBuffer.release();
+    instanceBuffer.destroy();
+    instanceBuffer.release();
+    visibleBuffer.destroy();
+    visibleBuffer.release();
+    lateVisibleBuffer.destroy();
+    lateVisibleBuffer.release();
+    visibilityBuffer.destroy();
+    visibilityBuffer.release();
+    bindGroup.release();
+    lateBindGroup.release();
+    cullBindGroup.release();
+}
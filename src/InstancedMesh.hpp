@@ -0,0 +1,68 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <vector>
+#include "DirtyRanges.hpp"
+#include "GpuCulling.hpp"
+#include "Helpers.hpp"
+#include "Mesh.hpp"
+
+using namespace wgpu;
+
+using InstanceId = uint32_t;
+
+// One mesh drawn many times: the instances live in a storage buffer, compute passes cull
+// them against the frustum and the depth pyramid, and every material range of the mesh is
+// one indirect draw over the survivors of each phase. Ids stay valid until removed, the instances are kept dense so culling
+// covers exactly the live ones. Changes are gathered on the CPU and only the dirty ranges
+// are uploaded.
+class InstancedMesh {
+public:
+    // mesh provides geometry, materials and the transform of the whole set, and is not drawn on its own
+    InstancedMesh(Device device, Queue queue, BindGroupLayout instanceBindGroupLayout, const GpuCulling& culling, Mesh& mesh);
+    static InstanceData MakeInstance(const glm::mat4x4& transform, const glm::vec4& color = glm::vec4(1.0f));
+
+    std::vector<InstanceId> Add(const std::vector<InstanceData>& instances);
+    void Remove(const std::vector<InstanceId>& ids);
+    void Update(const std::vector<InstanceId>& ids, const std::vector<InstanceData>& instances);
+    const InstanceData& Get(InstanceId id) const;
+    uint32_t InstanceCount() const;
+    // level of the mesh every instance is drawn with, coarse ones keep large sets cheap
+    void SetLod(uint32_t lod);
+
+    // writes the dirty ranges, call once per frame before Cull
+    void Upload();
+    // records one phase of the culling of this frame's instances, Draw of the same phase draws what it keeps
+    void Cull(ComputePassEncoder computePass, const Frustum& frustum, const glm::mat4x4& viewProjection, CullPhase phase);
+    // expects the instanced pipeline and group 0 to be bound
+    void Draw(RenderPassEncoder renderPass, CullPhase phase) const;
+    void Terminate();
+
+private:
+    Device device;
+    Queue queue;
+    BindGroupLayout bindGroupLayout;
+    const GpuCulling* culling;
+    Mesh* mesh;
+    uint32_t lod = 0;
+    uint32_t drawCount = 0; // material ranges of the level, one indirect draw each
+    Buffer transformsBuffer;
+    ObjectTransforms meshTransforms; // as last written to transformsBuffer
+    Buffer instanceBuffer;
+    Buffer visibleBuffer, lateVisibleBuffer;
+    // one flag per slot, whether the late phase found it visible last frame
+    Buffer visibilityBuffer;
+    Buffer cullUniformBuffer;
+    // visible count followed by the DrawIndexedArgs of each range
+    Buffer drawBuffer, lateDrawBuffer;
+    BindGroup bindGroup, lateBindGroup, cullBindGroup;
+    uint32_t capacity = 0;
+    // dense instance array and the id of each slot, idSlots maps back
+    std::vector<InstanceData> instances;
+    std::vector<InstanceId> slotIds;
+    std::vector<uint32_t> idSlots;
+    std::vector<InstanceId> freeIds;
+    DirtyRanges dirty;
+
+    void WriteDraws();
+    void Reserve(uint32_t count);
+};
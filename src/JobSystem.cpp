@@ -0,0 +1,79 @@
+#include "JobSystem.hpp"
+#include <algorithm>
+
+JobSystem& JobSystem::Get() {
+    // the calling thread takes part in ParallelFor, so one core is left for it
+    static JobSystem instance(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return instance;
+}
+
+JobSystem::JobSystem(unsigned workerCount) {
+    workerCount = std::max(1u, workerCount);
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&JobSystem::WorkerLoop, this);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::Enqueue(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void JobSystem::WorkerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping && jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) return;
+    if (count == 1) {
+        body(0);
+        return;
+    }
+    // indices are claimed from a shared counter, by helpers and the caller alike. A helper
+    // dequeued after the loop finished claims nothing, so it never touches body
+    struct Loop {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+    };
+    auto loop = std::make_shared<Loop>();
+    auto run = [loop, &body, count]() {
+        for (size_t i = loop->next.fetch_add(1, std::memory_order_relaxed); i < count; i = loop->next.fetch_add(1, std::memory_order_relaxed)) {
+            body(i);
+            loop->done.fetch_add(1, std::memory_order_release);
+        }
+    };
+    const size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i) Enqueue(run);
+    run();
+    // only indices already running elsewhere are left, the caller never picks up unrelated
+    // jobs such as a loader's, which could take long or block on the render thread
+    while (loop->done.load(std::memory_order_acquire) < count) std::this_thread::yield();
+}
+
+unsigned JobSystem::ThreadCount() const {
+    return static_cast<unsigned>(workers.size()) + 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads shared by the loaders. A thread waiting on a
+// ParallelFor works through that loop's own indices and nothing else, so nested
+// loops cannot deadlock and a frame never ends up running a queued load.
+class JobSystem {
+public:
+    static JobSystem& Get();
+    explicit JobSystem(unsigned workerCount);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    template<typename Function>
+    auto Submit(Function&& function) -> std::future<decltype(function())> {
+        using Result = decltype(function());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> future = task->get_future();
+        Enqueue([task]() { (*task)(); });
+        return future;
+    }
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+    unsigned ThreadCount() const;
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    void Enqueue(std::function<void()> job);
+    void WorkerLoop();
+};
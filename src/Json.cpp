@@ -0,0 +1,303 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "Json.hpp"
+
+namespace {
+// deeper documents are rejected instead of overflowing the stack
+constexpr int JSON_MAX_DEPTH = 256;
+
+const JsonValue& NullValue() {
+    static const JsonValue value;
+    return value;
+}
+
+void AppendUtf8(std::string& out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        out += char(codepoint);
+    }
+    else if (codepoint < 0x800) {
+        out += char(0xC0 | (codepoint >> 6));
+        out += char(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000) {
+        out += char(0xE0 | (codepoint >> 12));
+        out += char(0x80 | ((codepoint >> 6) & 0x3F));
+        out += char(0x80 | (codepoint & 0x3F));
+    }
+    else {
+        out += char(0xF0 | (codepoint >> 18));
+        out += char(0x80 | ((codepoint >> 12) & 0x3F));
+        out += char(0x80 | ((codepoint >> 6) & 0x3F));
+        out += char(0x80 | (codepoint & 0x3F));
+    }
+}
+}
+
+// recursive descent over the text, errors carry the byte offset they were found at
+class JsonReader {
+public:
+    JsonReader(const char* text, size_t size) : text(text), end(text + size), cursor(text) {
+    }
+
+    bool ReadDocument(JsonValue& value) {
+        SkipWhitespace();
+        if (!ReadValue(value, 0)) return false;
+        SkipWhitespace();
+        if (cursor != end) return Fail("unexpected data after the document");
+        return true;
+    }
+
+    std::string error;
+
+private:
+    const char* text;
+    const char* end;
+    const char* cursor;
+
+    bool Fail(const char* message) {
+        error = std::string(message) + " at byte " + std::to_string(cursor - text);
+        return false;
+    }
+
+    void SkipWhitespace() {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')) ++cursor;
+    }
+
+    bool Consume(const char* literal) {
+        const size_t length = std::strlen(literal);
+        if (size_t(end - cursor) < length || std::memcmp(cursor, literal, length) != 0) return false;
+        cursor += length;
+        return true;
+    }
+
+    bool ReadValue(JsonValue& value, int depth) {
+        if (depth > JSON_MAX_DEPTH) return Fail("nesting too deep");
+        if (cursor == end) return Fail("unexpected end of input");
+        switch (*cursor) {
+        case '{': return ReadObject(value, depth);
+        case '[': return ReadArray(value, depth);
+        case '"':
+            value.type = JsonValue::Type::String;
+            return ReadString(value.string);
+        case 't':
+        case 'f':
+            value.type = JsonValue::Type::Bool;
+            value.boolean = *cursor == 't';
+            if (Consume(value.boolean ? "true" : "false")) return true;
+            return Fail("invalid literal");
+        case 'n':
+            value.type = JsonValue::Type::Null;
+            if (Consume("null")) return true;
+            return Fail("invalid literal");
+        default:
+            return ReadNumber(value);
+        }
+    }
+
+    bool ReadObject(JsonValue& value, int depth) {
+        value.type = JsonValue::Type::Object;
+        ++cursor;
+        SkipWhitespace();
+        if (cursor < end && *cursor == '}') {
+            ++cursor;
+            return true;
+        }
+        while (true) {
+            SkipWhitespace();
+            if (cursor == end || *cursor != '"') return Fail("expected a member name");
+            value.members.emplace_back();
+            if (!ReadString(value.members.back().first)) return false;
+            SkipWhitespace();
+            if (cursor == end || *cursor != ':') return Fail("expected ':'");
+            ++cursor;
+            SkipWhitespace();
+            if (!ReadValue(value.members.back().second, depth + 1)) return false;
+            SkipWhitespace();
+            if (cursor < end && *cursor == ',') {
+                ++cursor;
+                continue;
+            }
+            if (cursor < end && *cursor == '}') {
+                ++cursor;
+                return true;
+            }
+            return Fail("expected ',' or '}'");
+        }
+    }
+
+    bool ReadArray(JsonValue& value, int depth) {
+        value.type = JsonValue::Type::Array;
+        ++cursor;
+        SkipWhitespace();
+        if (cursor < end && *cursor == ']') {
+            ++cursor;
+            return true;
+        }
+        while (true) {
+            SkipWhitespace();
+            value.elements.emplace_back();
+            if (!ReadValue(value.elements.back(), depth + 1)) return false;
+            SkipWhitespace();
+            if (cursor < end && *cursor == ',') {
+                ++cursor;
+                continue;
+            }
+            if (cursor < end && *cursor == ']') {
+                ++cursor;
+                return true;
+            }
+            return Fail("expected ',' or ']'");
+        }
+    }
+
+    bool ReadHex4(uint32_t& codepoint) {
+        if (end - cursor < 4) return Fail("truncated \\u escape");
+        codepoint = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *cursor++;
+            codepoint <<= 4;
+            if (c >= '0' && c <= '9') codepoint |= uint32_t(c - '0');
+            else if (c >= 'a' && c <= 'f') codepoint |= uint32_t(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') codepoint |= uint32_t(c - 'A' + 10);
+            else return Fail("invalid \\u escape");
+        }
+        return true;
+    }
+
+    bool ReadString(std::string& out) {
+        ++cursor;
+        while (cursor < end && *cursor != '"') {
+            const char c = *cursor++;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (cursor == end) break;
+            switch (*cursor++) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t codepoint = 0;
+                if (!ReadHex4(codepoint)) return false;
+                // characters outside the BMP come as a surrogate pair
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 && Consume("\\u")) {
+                    uint32_t low = 0;
+                    if (!ReadHex4(low)) return false;
+                    if (low < 0xDC00 || low >= 0xE000) return Fail("invalid surrogate pair");
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, codepoint);
+                break;
+            }
+            default:
+                return Fail("invalid escape");
+            }
+        }
+        if (cursor == end) return Fail("unterminated string");
+        ++cursor;
+        return true;
+    }
+
+    bool ReadNumber(JsonValue& value) {
+        // strtod needs a terminated string and the input is a mapped file
+        const char* start = cursor;
+        while (cursor < end && (std::strchr("+-.eE", *cursor) != nullptr || (*cursor >= '0' && *cursor <= '9'))) ++cursor;
+        if (cursor == start) return Fail("unexpected character");
+        const std::string token(start, cursor);
+        char* parsed = nullptr;
+        value.type = JsonValue::Type::Number;
+        value.number = std::strtod(token.c_str(), &parsed);
+        if (parsed != token.c_str() + token.size()) {
+            cursor = start;
+            return Fail("invalid number");
+        }
+        return true;
+    }
+};
+
+bool JsonValue::Parse(const char* text, size_t size, JsonValue& value, std::string& error) {
+    value = JsonValue();
+    JsonReader reader(text, size);
+    if (!reader.ReadDocument(value)) {
+        error = reader.error;
+        value = JsonValue();
+        return false;
+    }
+    return true;
+}
+
+JsonValue::Type JsonValue::GetType() const {
+    return type;
+}
+
+bool JsonValue::IsNull() const {
+    return type == Type::Null;
+}
+
+bool JsonValue::IsNumber() const {
+    return type == Type::Number;
+}
+
+bool JsonValue::IsString() const {
+    return type == Type::String;
+}
+
+bool JsonValue::IsArray() const {
+    return type == Type::Array;
+}
+
+bool JsonValue::IsObject() const {
+    return type == Type::Object;
+}
+
+bool JsonValue::Has(const std::string& key) const {
+    for (const auto& member : members) {
+        if (member.first == key) return true;
+    }
+    return false;
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const {
+    // glTF objects have a handful of members, a linear scan beats building a map
+    for (const auto& member : members) {
+        if (member.first == key) return member.second;
+    }
+    return NullValue();
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    return index < elements.size() ? elements[index] : NullValue();
+}
+
+size_t JsonValue::Size() const {
+    return type == Type::Array ? elements.size() : type == Type::Object ? members.size() : 0;
+}
+
+bool JsonValue::AsBool(bool fallback) const {
+    return type == Type::Bool ? boolean : fallback;
+}
+
+double JsonValue::AsNumber(double fallback) const {
+    return type == Type::Number ? number : fallback;
+}
+
+int JsonValue::AsInt(int fallback) const {
+    if (type != Type::Number || number < double(INT32_MIN) || number > double(INT32_MAX)) return fallback;
+    return static_cast<int>(number);
+}
+
+const std::string& JsonValue::AsString() const {
+    static const std::string empty;
+    return type == Type::String ? string : empty;
+}
+
+const std::vector<std::pair<std::string, JsonValue>>& JsonValue::Members() const {
+    return members;
+}
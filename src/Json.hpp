@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Read-only JSON document tree, enough for asset descriptions like glTF. Numbers are kept
+// as doubles and object members in file order; lookups of missing members or elements
+// return a null value, so optional fields can be read without checking first.
+class JsonValue {
+public:
+    enum class Type {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    static bool Parse(const char* text, size_t size, JsonValue& value, std::string& error);
+
+    Type GetType() const;
+    bool IsNull() const;
+    bool IsNumber() const;
+    bool IsString() const;
+    bool IsArray() const;
+    bool IsObject() const;
+    bool Has(const std::string& key) const;
+    const JsonValue& operator[](const std::string& key) const;
+    const JsonValue& operator[](size_t index) const;
+    // elements of an array or members of an object, 0 for anything else
+    size_t Size() const;
+    bool AsBool(bool fallback = false) const;
+    double AsNumber(double fallback = 0.0) const;
+    int AsInt(int fallback = -1) const;
+    const std::string& AsString() const;
+    const std::vector<std::pair<std::string, JsonValue>>& Members() const;
+
+private:
+    friend class JsonReader;
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+};
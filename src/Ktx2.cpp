@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "Ktx2.hpp"
+#include "TextureCodec.hpp"
+#include "Vfs.hpp"
+
+using namespace wgpu;
+
+namespace {
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Ktx2Header {
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth, pixelHeight, pixelDepth;
+    uint32_t layerCount, faceCount, levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset, dfdByteLength;
+    uint32_t kvdByteOffset, kvdByteLength;
+    uint64_t sgdByteOffset, sgdByteLength;
+};
+
+struct Ktx2Level {
+    uint64_t byteOffset, byteLength, uncompressedByteLength;
+};
+
+// sRGB variants map to the plain formats, colour maps are sampled raw like the PNGs
+bool FormatFromVulkan(uint32_t vkFormat, TextureFormat& format) {
+    switch (vkFormat) {
+    case 16: format = TextureFormat::RG8Unorm; return true;            // R8G8_UNORM
+    case 37: case 43: format = TextureFormat::RGBA8Unorm; return true; // R8G8B8A8_UNORM/SRGB
+    case 141: format = TextureFormat::BC5RGUnorm; return true;         // BC5_UNORM_BLOCK
+    case 145: case 146: format = TextureFormat::BC7RGBAUnorm; return true;
+    case 151: case 152: format = TextureFormat::ETC2RGBA8Unorm; return true;
+    case 157: case 158: format = TextureFormat::ASTC4x4Unorm; return true;
+    default: return false;
+    }
+}
+
+// Data Format Descriptor: one basic block, then a sample per channel or block half
+constexpr uint32_t DFD_BLOCK_HEADER_SIZE = 24;
+constexpr uint32_t DFD_SAMPLE_SIZE = 16;
+constexpr uint8_t DFD_MODEL_RGBSDA = 1;
+constexpr uint8_t DFD_MODEL_BC5 = 132;
+constexpr uint8_t DFD_PRIMARIES_BT709 = 1;
+constexpr uint8_t DFD_TRANSFER_LINEAR = 1;
+constexpr uint8_t DFD_TRANSFER_SRGB = 2;
+constexpr uint8_t DFD_FLAG_ALPHA_PREMULTIPLIED = 1;
+constexpr uint8_t DFD_CHANNEL_ALPHA = 15;
+constexpr uint8_t DFD_QUALIFIER_LINEAR = 0x10;
+// offset of the flags byte from the start of the descriptor, past its total size
+constexpr uint32_t DFD_FLAGS_OFFSET = 4 + 11;
+
+struct DfdSample {
+    uint16_t bitOffset;
+    uint8_t bitLength; // minus one
+    uint8_t channelType;
+    uint8_t samplePosition[4];
+    uint32_t sampleLower, sampleUpper;
+};
+
+template <typename T>
+void WriteValue(std::vector<uint8_t>& out, const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool DescribeFormat(TextureFormat format, uint32_t& vkFormat, uint8_t& model, uint8_t& transfer, uint8_t& blockSize,
+    uint8_t& bytesPerBlock, std::vector<DfdSample>& samples) {
+    samples.clear();
+    switch (format) {
+    case TextureFormat::RGBA8Unorm:
+        // colour maps hold sRGB encoded values, they are sampled raw all the same
+        vkFormat = 43;
+        model = DFD_MODEL_RGBSDA;
+        transfer = DFD_TRANSFER_SRGB;
+        blockSize = 1;
+        bytesPerBlock = 4;
+        for (uint8_t channel = 0; channel < 4; ++channel) {
+            const uint8_t type = channel == 3 ? uint8_t(DFD_CHANNEL_ALPHA | DFD_QUALIFIER_LINEAR) : channel;
+            samples.push_back({uint16_t(8 * channel), 7, type, {}, 0, 255});
+        }
+        return true;
+    case TextureFormat::RG8Unorm:
+        vkFormat = 16;
+        model = DFD_MODEL_RGBSDA;
+        transfer = DFD_TRANSFER_LINEAR;
+        blockSize = 1;
+        bytesPerBlock = 2;
+        for (uint8_t channel = 0; channel < 2; ++channel) samples.push_back({uint16_t(8 * channel), 7, channel, {}, 0, 255});
+        return true;
+    case TextureFormat::BC5RGUnorm:
+        vkFormat = 141;
+        model = DFD_MODEL_BC5;
+        transfer = DFD_TRANSFER_LINEAR;
+        blockSize = 4;
+        bytesPerBlock = 16;
+        for (uint8_t channel = 0; channel < 2; ++channel) samples.push_back({uint16_t(64 * channel), 63, channel, {}, 0, 0xFFFFFFFFu});
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+bool Ktx2::Load(const fs::path& path, ImageData& image) {
+    VfsFile file;
+    if (!Vfs::Open(path, file)) {
+        std::cerr << "Could not open " << path.string() << std::endl;
+        return false;
+    }
+    const uint8_t* data = file.Data();
+    const size_t size = file.Size();
+    Ktx2Header header;
+    if (size < sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header)
+        || std::memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        std::cerr << path.string() << " is not a KTX2 file" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, data + sizeof(KTX2_IDENTIFIER), sizeof(Ktx2Header));
+    TextureFormat format = TextureFormat::Undefined;
+    if (!FormatFromVulkan(header.vkFormat, format)) {
+        std::cerr << path.string() << ": unsupported vkFormat " << header.vkFormat << std::endl;
+        return false;
+    }
+    if (header.supercompressionScheme != 0) {
+        std::cerr << path.string() << ": supercompressed KTX2 is not supported" << std::endl;
+        return false;
+    }
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1
+        || header.layerCount > 1 || header.faceCount != 1) {
+        std::cerr << path.string() << ": only single 2D images are supported" << std::endl;
+        return false;
+    }
+    // zero levels asks the loader to build the chain itself
+    const uint32_t levelCount = std::max(1u, header.levelCount);
+    const size_t levelIndexOffset = sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header);
+    if (levelCount > 32 || size < levelIndexOffset + levelCount * sizeof(Ktx2Level)) {
+        std::cerr << path.string() << ": truncated level index" << std::endl;
+        return false;
+    }
+
+    image = ImageData();
+    image.width = int(header.pixelWidth);
+    image.height = int(header.pixelHeight);
+    image.format = format;
+    if (header.dfdByteLength > DFD_FLAGS_OFFSET && header.dfdByteOffset <= size && size - header.dfdByteOffset >= header.dfdByteLength) {
+        image.premultiplied = (data[header.dfdByteOffset + DFD_FLAGS_OFFSET] & DFD_FLAG_ALPHA_PREMULTIPLIED) != 0;
+    }
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        Ktx2Level entry;
+        std::memcpy(&entry, data + levelIndexOffset + level * sizeof(Ktx2Level), sizeof(Ktx2Level));
+        const uint32_t width = std::max(1u, header.pixelWidth >> level);
+        const uint32_t height = std::max(1u, header.pixelHeight >> level);
+        const size_t expected = TextureCodec::LevelLayout(format, width, height).size;
+        if (entry.byteLength != expected || entry.byteOffset > size || size - entry.byteOffset < entry.byteLength) {
+            std::cerr << path.string() << ": level " << level << " is out of range" << std::endl;
+            return false;
+        }
+        std::vector<uint8_t> bytes(data + entry.byteOffset, data + entry.byteOffset + entry.byteLength);
+        if (level == 0) image.pixels = std::move(bytes);
+        else image.mips.push_back(std::move(bytes));
+    }
+    return true;
+}
+
+bool Ktx2::Save(const fs::path& path, const ImageData& image) {
+    Ktx2Header header = {};
+    uint8_t model, transfer, blockSize, bytesPerBlock;
+    std::vector<DfdSample> samples;
+    if (image.pixels.empty() || !DescribeFormat(image.format, header.vkFormat, model, transfer, blockSize, bytesPerBlock, samples)) {
+        std::cerr << path.string() << ": nothing the KTX2 writer can store" << std::endl;
+        return false;
+    }
+    header.typeSize = 1;
+    header.pixelWidth = uint32_t(image.width);
+    header.pixelHeight = uint32_t(image.height);
+    header.faceCount = 1;
+    header.levelCount = uint32_t(1 + image.mips.size());
+
+    std::vector<uint8_t> dfd;
+    const uint32_t blockLength = DFD_BLOCK_HEADER_SIZE + DFD_SAMPLE_SIZE * uint32_t(samples.size());
+    WriteValue(dfd, uint32_t(sizeof(uint32_t) + blockLength));
+    WriteValue(dfd, uint32_t(0)); // Khronos vendor, basic descriptor type
+    WriteValue(dfd, uint16_t(2)); // descriptor version
+    WriteValue(dfd, uint16_t(blockLength));
+    dfd.push_back(model);
+    dfd.push_back(DFD_PRIMARIES_BT709);
+    dfd.push_back(transfer);
+    dfd.push_back(image.premultiplied ? DFD_FLAG_ALPHA_PREMULTIPLIED : 0);
+    const uint8_t dimensions[4] = {uint8_t(blockSize - 1), uint8_t(blockSize - 1), 0, 0};
+    dfd.insert(dfd.end(), dimensions, dimensions + 4);
+    const uint8_t bytesPlane[8] = {bytesPerBlock};
+    dfd.insert(dfd.end(), bytesPlane, bytesPlane + 8);
+    for (const DfdSample& sample : samples) WriteValue(dfd, sample);
+
+    const size_t levelIndexOffset = sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header);
+    header.dfdByteOffset = uint32_t(levelIndexOffset + header.levelCount * sizeof(Ktx2Level));
+    header.dfdByteLength = uint32_t(dfd.size());
+
+    // levels are stored smallest first, each on a multiple of the block size and of 4
+    const size_t alignment = bytesPerBlock % 4 == 0 ? bytesPerBlock : 4;
+    std::vector<Ktx2Level> levels(header.levelCount);
+    size_t offset = header.dfdByteOffset + header.dfdByteLength;
+    for (uint32_t level = header.levelCount; level-- > 0;) {
+        const std::vector<uint8_t>& bytes = level == 0 ? image.pixels : image.mips[level - 1];
+        offset = AlignUp(offset, alignment);
+        levels[level] = {offset, bytes.size(), bytes.size()};
+        offset += bytes.size();
+    }
+
+    std::vector<uint8_t> out(offset, 0);
+    std::memcpy(out.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    std::memcpy(out.data() + sizeof(KTX2_IDENTIFIER), &header, sizeof(Ktx2Header));
+    std::memcpy(out.data() + levelIndexOffset, levels.data(), levels.size() * sizeof(Ktx2Level));
+    std::memcpy(out.data() + header.dfdByteOffset, dfd.data(), dfd.size());
+    for (uint32_t level = 0; level < header.levelCount; ++level) {
+        const std::vector<uint8_t>& bytes = level == 0 ? image.pixels : image.mips[level - 1];
+        std::memcpy(out.data() + levels[level].byteOffset, bytes.data(), bytes.size());
+    }
+
+    // write to a temporary file first so a crash never leaves a half written texture behind
+    const fs::path tempPath = UniqueTempPath(path);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(out.data()), out.size())) {
+            std::cerr << "Could not write " << path.string() << std::endl;
+            file.close();
+            std::error_code error;
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Could not write " << path.string() << ": " << error.message() << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <filesystem>
+#include "ResourceManager.hpp"
+
+namespace fs = std::filesystem;
+
+// Reader for KTX2 containers holding a single 2D image, with or without a mip chain.
+// Supports the uncompressed RGBA8/RG8 formats and BC5, BC7, ETC2 and ASTC 4x4 blocks;
+// supercompressed files (BasisLZ, Zstandard) are rejected. The writer covers what the
+// AssetCooker produces: RGBA8, RG8 and BC5.
+class Ktx2 {
+public:
+    static bool Load(const fs::path& path, ImageData& image);
+    static bool Save(const fs::path& path, const ImageData& image);
+};
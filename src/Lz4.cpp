@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cstring>
+#include "Lz4.hpp"
+
+namespace {
+constexpr size_t MIN_MATCH = 4;
+// the format ends on literals: the last match starts 12 bytes and ends 5 bytes before the end
+constexpr size_t MATCH_START_LIMIT = 12;
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_BITS = 16;
+// misses in a row before the search starts skipping ahead, keeps incompressible data fast
+constexpr uint32_t SKIP_TRIGGER = 6;
+
+uint32_t Read32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void WriteLength(std::vector<uint8_t>& out, size_t length) {
+    for (; length >= 255; length -= 255) out.push_back(255);
+    out.push_back(uint8_t(length));
+}
+
+void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    const size_t matchCode = matchLength - MIN_MATCH;
+    out.push_back(uint8_t((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalCount >= 15) WriteLength(out, literalCount - 15);
+    out.insert(out.end(), literals, literals + literalCount);
+    out.push_back(uint8_t(offset));
+    out.push_back(uint8_t(offset >> 8));
+    if (matchCode >= 15) WriteLength(out, matchCode - 15);
+}
+
+bool ReadLength(const uint8_t*& p, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (p == end) return false;
+        byte = *p++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+}
+
+std::vector<uint8_t> Lz4::Compress(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> out;
+    out.reserve(size + size / 255 + 16);
+    size_t anchor = 0;
+    if (size > MATCH_START_LIMIT) {
+        // positions of the last sequence seen with each hash, a stale entry only costs a compare
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        const size_t matchStartLimit = size - MATCH_START_LIMIT;
+        const size_t matchEndLimit = size - LAST_LITERALS;
+        size_t i = 1;
+        uint32_t misses = 0;
+        while (i < matchStartLimit) {
+            const uint32_t sequence = Read32(data + i);
+            const uint32_t hash = Hash(sequence);
+            size_t candidate = table[hash];
+            table[hash] = uint32_t(i);
+            if (i - candidate > MAX_OFFSET || Read32(data + candidate) != sequence) {
+                i += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+            // grow the match back into the pending literals, then forward
+            size_t start = i;
+            while (start > anchor && candidate > 0 && data[start - 1] == data[candidate - 1]) {
+                --start;
+                --candidate;
+            }
+            size_t length = i - start + MIN_MATCH;
+            while (start + length < matchEndLimit && data[start + length] == data[candidate + length]) ++length;
+            WriteSequence(out, data + anchor, start - anchor, start - candidate, length);
+            i = start + length;
+            anchor = i;
+            // the position just before the match end is a likely start for the next one
+            if (i - 2 < matchStartLimit) table[Hash(Read32(data + i - 2))] = uint32_t(i - 2);
+        }
+    }
+    const size_t literalCount = size - anchor;
+    out.push_back(uint8_t(std::min<size_t>(literalCount, 15) << 4));
+    if (literalCount >= 15) WriteLength(out, literalCount - 15);
+    out.insert(out.end(), data + anchor, data + size);
+    return out;
+}
+
+bool Lz4::Decompress(const uint8_t* block, size_t blockSize, uint8_t* out, size_t size) {
+    const uint8_t* p = block;
+    const uint8_t* end = block + blockSize;
+    size_t written = 0;
+    while (p < end) {
+        const uint8_t token = *p++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(p, end, literalCount)) return false;
+        if (literalCount > size_t(end - p) || literalCount > size - written) return false;
+        // an empty block is a lone token without literals, and out may be null then
+        if (literalCount > 0) std::memcpy(out + written, p, literalCount);
+        p += literalCount;
+        written += literalCount;
+        // the last sequence has no match
+        if (p == end) break;
+        if (end - p < 2) return false;
+        const size_t offset = p[0] | (size_t(p[1]) << 8);
+        p += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(p, end, matchLength)) return false;
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > written || matchLength > size - written) return false;
+        uint8_t* target = out + written;
+        const uint8_t* source = target - offset;
+        // a match overlapping its own output repeats the last offset bytes, copied in doubling runs
+        std::memcpy(target, source, std::min(offset, matchLength));
+        for (size_t done = std::min(offset, matchLength); done < matchLength;) {
+            const size_t run = std::min(done, matchLength - done);
+            std::memcpy(target + done, target, run);
+            done += run;
+        }
+        written += matchLength;
+    }
+    return written == size;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LZ4 block format: greedy matching over a hash of 4 byte sequences on the way in,
+// a bounds checked copy loop on the way out. Blocks carry no sizes, the caller keeps them.
+class Lz4 {
+public:
+    static std::vector<uint8_t> Compress(const uint8_t* data, size_t size);
+    // false unless the block decodes to exactly size bytes
+    static bool Decompress(const uint8_t* block, size_t blockSize, uint8_t* out, size_t size);
+};
@@ -46,6 +46,14 @@ void MainWindow::OnMouseMove(double x, double y){
     }
 }
 void MainWindow::OnMouseButton(int button, int action, int mods){
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        double xpos, ypos;
+        glfwGetCursorPos(window, &xpos, &ypos);
+        if (Mesh* mesh = gpu->Pick(xpos, ypos)) {
+            const glm::vec3 center = mesh->worldSphere.center;
+            std::cout << "Picked the mesh at " << center.x << ", " << center.y << ", " << center.z << std::endl;
+        }
+    }
     if (button == GLFW_MOUSE_BUTTON_LEFT||GLFW_MOUSE_BUTTON_RIGHT){
         switch(action) {
         case GLFW_PRESS:
@@ -0,0 +1,144 @@
+#include <atomic>
+#include <string>
+#include "MappedFile.hpp"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    MoveFrom(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        Close();
+        MoveFrom(other);
+    }
+    return *this;
+}
+
+void MappedFile::MoveFrom(MappedFile& other) {
+    data = other.data;
+    size = other.size;
+    open = other.open;
+#ifdef _WIN32
+    fileHandle = other.fileHandle;
+    mappingHandle = other.mappingHandle;
+    other.fileHandle = nullptr;
+    other.mappingHandle = nullptr;
+#endif
+    other.data = nullptr;
+    other.size = 0;
+    other.open = false;
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const fs::path& path) {
+    Close();
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    size = static_cast<size_t>(fileSize.QuadPart);
+    open = true;
+    // empty files cannot be mapped, they are simply open with no data
+    if (size == 0) return true;
+    mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        Close();
+        return false;
+    }
+    data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != nullptr) CloseHandle(fileHandle);
+    data = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    size = 0;
+    open = false;
+}
+#else
+bool MappedFile::Open(const fs::path& path) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+    open = true;
+    // empty files cannot be mapped, they are simply open with no data
+    if (size > 0) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            size = 0;
+            open = false;
+            return false;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const uint8_t*>(mapping);
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) munmap(const_cast<uint8_t*>(data), size);
+    data = nullptr;
+    size = 0;
+    open = false;
+}
+#endif
+
+bool MappedFile::IsOpen() const {
+    return open;
+}
+
+const uint8_t* MappedFile::Data() const {
+    return data;
+}
+
+size_t MappedFile::Size() const {
+    return size;
+}
+
+fs::path UniqueTempPath(const fs::path& path) {
+    static std::atomic<uint64_t> counter(0);
+#ifdef _WIN32
+    const uint64_t process = GetCurrentProcessId();
+#else
+    const uint64_t process = static_cast<uint64_t>(getpid());
+#endif
+    fs::path tempPath = path;
+    tempPath += "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+    return tempPath;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+
+namespace fs = std::filesystem;
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool Open(const fs::path& path);
+    void Close();
+    bool IsOpen() const;
+    const uint8_t* Data() const;
+    size_t Size() const;
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool open = false;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+    void MoveFrom(MappedFile& other);
+};
+
+// A name next to path to write it under before renaming it into place, unique per process
+// and call so concurrent writers of the same file never share one
+fs::path UniqueTempPath(const fs::path& path);
@@ -1,45 +1,65 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <webgpu/webgpu.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <unordered_set>
 #include "Mesh.hpp"
+#include "GeometryCache.hpp"
+#include "ImageLoader.hpp"
+#include "JobSystem.hpp"
+#include "TextureCodec.hpp"
+#include "Vfs.hpp"
 
 namespace fs = std::filesystem;
 
-auto RESOURCE_DIR = fs::path{"assets/textures"};
 auto MODELS_DIR = fs::path{"assets/models"};
+// registry key formats name the channel layout, the stored texture may be its block compressed form
+const TextureFormat COLOR_TEXTURE_FORMAT = TextureFormat::RGBA8Unorm;
+const TextureFormat NORMAL_TEXTURE_FORMAT = TextureFormat::RG8Unorm;
+// triangles a level may have to stand in for the mesh as an occluder
+constexpr uint32_t MAX_OCCLUDER_TRIANGLES = 512;
 
-Texture LoadTexture(const fs::path& path, Device device, TextureView* pTextureView){
+// box around the transformed corners of bounds, built a column of the matrix at a time
+static Bounds TransformBounds(const Bounds& bounds, const glm::mat4x4& model) {
+    if (bounds.min.x > bounds.max.x) return bounds;
+    Bounds transformed;
+    transformed.min = transformed.max = glm::vec3(model[3]);
+    for (int axis = 0; axis < 3; ++axis) {
+        const glm::vec3 a = glm::vec3(model[axis]) * bounds.min[axis];
+        const glm::vec3 b = glm::vec3(model[axis]) * bounds.max[axis];
+        transformed.min += glm::min(a, b);
+        transformed.max += glm::max(a, b);
+    }
+    return transformed;
+}
+
+// the largest axis scale keeps the sphere around the geometry under non uniform scale
+static BoundingSphere TransformSphere(const BoundingSphere& sphere, const glm::mat4x4& model) {
+    const float scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))});
+    return BoundingSphere{glm::vec3(model * glm::vec4(sphere.center, 1.0f)), sphere.radius * scale};
+}
+
+Texture LoadTexture(const ImageData& image, Device device, TextureUploader& uploader, TextureView* pTextureView){
     // create texture
-    int width, height, channels;
-    unsigned char *data = stbi_load(path.string().c_str(), &width, &height, &channels, 4);
-    if (data==nullptr) return nullptr;
+    if (image.pixels.empty()) return nullptr;
+    // RGBA8 images that don't ship their own chain get one generated on the GPU
+    const bool generateMips = image.format == TextureFormat::RGBA8Unorm && image.mips.empty();
     TextureDescriptor textureDesc;
     textureDesc.dimension = TextureDimension::_2D;
-    textureDesc.format = TextureFormat::RGBA8Unorm; // by convention for bmp, png and jpg file. Be careful with other formats.
-    textureDesc.mipLevelCount = 1;
+    textureDesc.format = image.format;
+    textureDesc.mipLevelCount = generateMips ? MipmapGenerator::MipLevelCount(image.width, image.height) : 1 + image.mips.size();
     textureDesc.sampleCount = 1;
-    textureDesc.size = { (unsigned int)width, (unsigned int)height, 1 };
-    textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst;
+    textureDesc.size = { (unsigned int)image.width, (unsigned int)image.height, 1 };
+    textureDesc.usage = TextureUsage::TextureBinding | uploader.RequiredUsage(generateMips);
     textureDesc.viewFormatCount = 0;
     textureDesc.viewFormats = nullptr;
     Texture texture = device.createTexture(textureDesc);
-    // load texture to gpu
-    ImageCopyTexture destination;
-    destination.texture = texture;
-    destination.mipLevel = 0;
-    destination.origin = { 0, 0, 0 }; // equivalent of the offset argument of Queue::writeBuffer
-    destination.aspect = TextureAspect::All; // only relevant for depth/Stencil textures
-    TextureDataLayout source;
-    source.offset = 0;
-    source.bytesPerRow = 4 *textureDesc.size.width;
-    source.rowsPerImage = textureDesc.size.height;
-    Queue queue = device.getQueue();
-    queue.writeTexture(destination, data, 4 * textureDesc.size.width * textureDesc.size.height, source, textureDesc.size);
-    queue.release();
+    // the levels are staged now and copied with the rest of the frame's textures
+    uploader.Upload(texture, image, textureDesc.mipLevelCount, generateMips);
 
     TextureViewDescriptor textureViewDesc;
     textureViewDesc.aspect = TextureAspect::All;
@@ -50,18 +70,214 @@ Texture LoadTexture(const fs::path& path, Device device, TextureView* pTextureVi
     textureViewDesc.dimension = TextureViewDimension::_2D;
     textureViewDesc.format = textureDesc.format;
     *pTextureView = texture.createView(textureViewDesc);
-
-    stbi_image_free(data);
     return texture;
 }
 
-Mesh::Mesh(Device device, Queue queue, BindGroupLayout bindGroupLayout, const std::filesystem::path& path, Mesh* parent) {
+std::string TextureName(const TextureSource& source) {
+    return source.path.empty() ? source.key : source.path.string();
+}
+
+TextureHandle CreateTexture(const ImageData& image, const TextureSource& source, Device device, TextureUploader& uploader) {
+    TextureHandle handle = std::make_shared<GpuTexture>();
+    handle->texture = LoadTexture(image, device, uploader, &handle->view);
+    if (!handle->texture) return nullptr;
+    size_t bytes = image.pixels.size();
+    for (const auto& mip : image.mips) bytes += mip.size();
+    if (image.mips.empty()) bytes = bytes * 4 / 3; // chain generated on the GPU
+    std::cout << "Uploaded texture " << TextureName(source)
+        << " (" << image.width << "x" << image.height << ", "
+        << (TextureCodec::IsCompressed(image.format) ? "block compressed, " : "") << bytes / 1024 << " KB)" << std::endl;
+    return handle;
+}
+
+TextureSource ResolveTexture(const fs::path& objPath, const std::string& name, bool normalMap) {
+    TextureSource source{normalMap ? DEFAULT_NORMAL_TEXTURE : DEFAULT_WHITE_TEXTURE, {}, normalMap};
+    fs::path path = ImageLoader::ResolvePath(objPath, name, normalMap);
+    if (path.empty()) return source;
+    // the cooked form ships its mip chain and is already compressed or premultiplied
+    const fs::path cookedPath = ImageLoader::CookedPath(path, normalMap);
+    if (Vfs::Exists(cookedPath)) path = cookedPath;
+    source.key = ResourceManager::textureKey(path, normalMap ? NORMAL_TEXTURE_FORMAT : COLOR_TEXTURE_FORMAT);
+    source.path = path;
+    return source;
+}
+
+// glTF images are files next to the asset or live inside it, embedded ones are keyed by their index
+TextureSource ResolveGltfTexture(const fs::path& sourcePath, const GltfFile& file, int image, bool normalMap) {
+    TextureSource source{normalMap ? DEFAULT_NORMAL_TEXTURE : DEFAULT_WHITE_TEXTURE, {}, normalMap};
+    if (image < 0) return source;
+    const std::string uri = file.ImageUri(image);
+    if (!uri.empty()) return ResolveTexture(sourcePath, uri, normalMap);
+    source.key = ResourceManager::textureKey(sourcePath/("image" + std::to_string(image)),
+        normalMap ? NORMAL_TEXTURE_FORMAT : COLOR_TEXTURE_FORMAT);
+    source.gltfImage = image;
+    return source;
+}
+
+// reads the image behind a texture source, embedded glTF images come out of the payload's scene
+ImageData DecodeTexture(const TextureSource& source, const MeshPayload& payload) {
+    if (source.gltfImage < 0) return ImageLoader::Load(source.path, source.normalMap);
+    std::vector<uint8_t> storage;
+    const uint8_t* data;
+    size_t size;
+    if (!payload.scene || !payload.scene->file->ImageBytes(source.gltfImage, storage, data, size)) {
+        std::cerr << "Could not find texture " << TextureName(source) << std::endl;
+        return ImageData();
+    }
+    ImageData image = ImageLoader::Decode(data, size, TextureName(source));
+    ImageLoader::Prepare(image, TextureName(source), source.normalMap);
+    return image;
+}
+
+// Decodes the textures of a payload tree that aren't resident yet, one job per image. Each
+// image goes to the first payload using it; the tree is uploaded in that order, so the
+// payloads after it find the texture resident.
+void DecodeTextures(MeshPayload& root) {
+    struct ImageJob {
+        MeshPayload* payload;
+        TextureSource source;
+        ImageData image;
+        double milliseconds = 0.0;
+    };
+    std::vector<ImageJob> jobs;
+    std::unordered_set<std::string> scheduled;
+    std::vector<MeshPayload*> stack{&root};
+    while (!stack.empty()) {
+        MeshPayload* payload = stack.back();
+        stack.pop_back();
+        for (const MaterialTextures& textures : payload->textures) {
+            for (const TextureSource* source : {&textures.diffuse, &textures.normal}) {
+                if (source->key == DEFAULT_WHITE_TEXTURE || source->key == DEFAULT_NORMAL_TEXTURE) continue;
+                if (ResourceManager::isTextureResident(source->key) || !scheduled.insert(source->key).second) continue;
+                jobs.push_back({payload, *source, {}});
+            }
+        }
+        for (auto child = payload->children.rbegin(); child != payload->children.rend(); ++child) stack.push_back(&*child);
+    }
+    if (jobs.empty()) return;
+
+    auto start = std::chrono::steady_clock::now();
+    JobSystem::Get().ParallelFor(jobs.size(), [&jobs](size_t i) {
+        auto decodeStart = std::chrono::steady_clock::now();
+        jobs[i].image = DecodeTexture(jobs[i].source, *jobs[i].payload);
+        jobs[i].milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+    });
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::unordered_set<std::string> failed;
+    for (ImageJob& job : jobs) {
+        if (job.image.pixels.empty()) {
+            failed.insert(job.source.key);
+            continue;
+        }
+        std::cout << TextureName(job.source) << ": decoded " << job.image.width << "x" << job.image.height
+            << " in " << job.milliseconds << " ms" << std::endl;
+        job.payload->images.emplace(job.source.key, std::move(job.image));
+    }
+    std::cout << root.path.string() << ": " << jobs.size() << " textures decoded in " << milliseconds << " ms on "
+        << JobSystem::Get().ThreadCount() << " threads" << std::endl;
+    if (failed.empty()) return;
+    // materials whose texture didn't decode fall back to the defaults
+    stack.push_back(&root);
+    while (!stack.empty()) {
+        MeshPayload* payload = stack.back();
+        stack.pop_back();
+        for (MaterialTextures& textures : payload->textures) {
+            if (failed.count(textures.diffuse.key)) textures.diffuse = {DEFAULT_WHITE_TEXTURE, {}, false};
+            if (failed.count(textures.normal.key)) textures.normal = {DEFAULT_NORMAL_TEXTURE, {}, true};
+        }
+        for (auto& child : payload->children) stack.push_back(&child);
+    }
+}
+
+void PackPayloadVertices(MeshPayload& payload, const VertexAttributes* vertices, uint32_t vertexCount, const Bounds& bounds) {
+    payload.packedVertices = ResourceManager::packVertices(vertices, vertexCount, bounds);
+    std::cout << payload.path.string() << ": vertices packed " << sizeof(VertexAttributes) << " -> " << sizeof(PackedVertex)
+        << " bytes, " << vertexCount * sizeof(VertexAttributes) / 1024 << " KB -> "
+        << payload.packedVertices.size() * sizeof(PackedVertex) / 1024 << " KB" << std::endl;
+}
+
+// one payload per glTF node, children nested below their parent
+void BuildNodePayload(const fs::path& sourcePath, const std::shared_ptr<const GltfScene>& scene,
+    const std::vector<std::vector<int>>& children, int node, MeshPayload& payload) {
+    const GltfNode& gltfNode = scene->nodes[node];
+    payload.scene = scene;
+    payload.sceneMesh = gltfNode.mesh;
+    payload.localMatrix = gltfNode.matrix;
+    if (gltfNode.mesh >= 0) {
+        const GltfMesh& mesh = scene->meshes[gltfNode.mesh];
+        if (payload.vertexLayout == VertexLayout::Packed) PackPayloadVertices(payload, mesh.vertices, mesh.vertexCount, mesh.bounds);
+        for (uint32_t material : mesh.materials) {
+            const GltfMaterial& gltfMaterial = scene->materials[material];
+            MaterialTextures textures;
+            textures.diffuse = ResolveGltfTexture(sourcePath, *scene->file, gltfMaterial.diffuseImage, false);
+            textures.normal = ResolveGltfTexture(sourcePath, *scene->file, gltfMaterial.normalImage, true);
+            payload.textures.push_back(textures);
+        }
+    }
+    for (int child : children[node]) {
+        payload.children.emplace_back();
+        MeshPayload& childPayload = payload.children.back();
+        childPayload.path = payload.path;
+        childPayload.vertexLayout = payload.vertexLayout;
+        BuildNodePayload(sourcePath, scene, children, child, childPayload);
+    }
+}
+
+MeshPayload Mesh::LoadPayload(const std::filesystem::path& path, VertexLayout vertexLayout) {
+    // runs on a worker thread, so no GPU calls in here
+    MeshPayload payload;
+    payload.path = path;
+    payload.vertexLayout = vertexLayout;
+    const fs::path sourcePath = MODELS_DIR/path;
+    if (path.extension() == ".gltf" || path.extension() == ".glb") {
+        // the payload is an empty root the scene's root nodes hang from, so it can be placed as a whole
+        auto scene = std::make_shared<GltfScene>();
+        ResourceManager::loadGltf(sourcePath, *scene);
+        payload.scene = scene;
+        std::vector<std::vector<int>> children(scene->nodes.size());
+        for (size_t n = 0; n < scene->nodes.size(); ++n) {
+            const int parent = scene->nodes[n].parent;
+            if (parent >= 0) children[parent].push_back(int(n));
+        }
+        for (size_t n = 0; n < scene->nodes.size(); ++n) {
+            if (scene->nodes[n].parent >= 0) continue;
+            payload.children.emplace_back();
+            MeshPayload& child = payload.children.back();
+            child.path = path;
+            child.vertexLayout = vertexLayout;
+            BuildNodePayload(sourcePath, scene, children, int(n), child);
+        }
+        DecodeTextures(payload);
+        return payload;
+    }
+    if (!payload.geometry.Load(sourcePath)) {
+        GeometryData geometry;
+        ResourceManager::loadGeometryObj(sourcePath, geometry);
+        payload.geometry.Store(sourcePath, geometry);
+    }
+    for (const auto& material : payload.geometry.Materials()) {
+        MaterialTextures textures;
+        textures.diffuse = ResolveTexture(sourcePath, material.diffuseTexture, false);
+        textures.normal = ResolveTexture(sourcePath, material.normalTexture, true);
+        payload.textures.push_back(textures);
+    }
+    DecodeTextures(payload);
+    return payload;
+}
+
+Mesh::Mesh(Device device, Queue queue, TransformBuffer& transformBuffer, BindGroupLayout materialBindGroupLayout, TextureUploader& uploader, const MeshPayload& payload, Mesh* parent) {
     this->device = device;
     this->queue = queue;
-    this->parent = parent;
-    InitializeTexture();
-    InitializeBuffers(path);
-    InitializeBinding(bindGroupLayout);
+    this->parent = nullptr;
+    this->transformBuffer = &transformBuffer;
+    transformSlot = transformBuffer.Allocate();
+    std::vector<MaterialData> materialData;
+    InitializeBuffers(payload, materialData);
+    UpdateTransforms();
+    InitializeMaterials(materialBindGroupLayout, materialData, payload, uploader);
+    if (payload.localMatrix) SetLocalMatrix(*payload.localMatrix);
+    if (parent != nullptr) SetParent(parent);
 }
 
 void Mesh::SetTransforms(glm::vec3 scale, glm::vec3 translate, glm::vec3 rotate) {
@@ -70,24 +286,118 @@ void Mesh::SetTransforms(glm::vec3 scale, glm::vec3 translate, glm::vec3 rotate)
     localTransforms.Scale=S;
     localTransforms.Trans=T;
     localTransforms.Rot=localTransforms.Trans*localTransforms.Scale;
+    localMatrix.reset();
+    UpdateTransforms();
+}
+
+void Mesh::SetLocalMatrix(const glm::mat4x4& matrix) {
+    localMatrix = matrix;
     UpdateTransforms();
 }
 
 void Mesh::UpdateTransforms() {
-    if(parent!=nullptr){
+    if(localMatrix){
+        // imported nodes carry rotations, so they compose whole matrices; scale and translation
+        // are pulled back out for children placed with SetTransforms
+        glm::mat4x4 model = (parent!=nullptr ? parent->globalTransforms.Rot : glm::mat4x4(1.0f)) * *localMatrix;
+        globalTransforms.Trans=glm::translate(glm::mat4x4(1.0), glm::vec3(model[3]));
+        globalTransforms.Scale=glm::scale(glm::mat4x4(1.0), glm::vec3(
+            glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        globalTransforms.Rot = model;
+    }
+    else if(parent!=nullptr){
         globalTransforms.Scale=parent->globalTransforms.Scale*localTransforms.Scale;
         globalTransforms.Trans=parent->globalTransforms.Trans*localTransforms.Trans;
+        globalTransforms.Rot = globalTransforms.Trans*globalTransforms.Scale;
     }
     else{
         globalTransforms.Scale=localTransforms.Scale;
         globalTransforms.Trans=localTransforms.Trans;
+        globalTransforms.Rot = globalTransforms.Trans*globalTransforms.Scale;
     }
-    globalTransforms.Rot = globalTransforms.Trans*globalTransforms.Scale;
+    worldBounds = TransformBounds(bounds, globalTransforms.Rot);
+    worldSphere = TransformSphere(sphere, globalTransforms.Rot);
+    transformBuffer->Set(transformSlot, GpuTransforms());
+    if (sceneBvh != nullptr) sceneBvh->Update(sceneObject, worldBounds);
     for(auto child:children){
         child->UpdateTransforms();
     }
 }
 
+void Mesh::SetSceneBvh(SceneBvh* bvh, uint32_t object) {
+    sceneBvh = bvh;
+    sceneObject = object;
+}
+
+ObjectTransforms Mesh::GpuTransforms() const {
+    ObjectTransforms transforms;
+    StoreAffineRows(globalTransforms.Rot, transforms.rows);
+    transforms.QuantOffset = quantOffset;
+    transforms.QuantScale = quantScale;
+    return transforms;
+}
+
+void Mesh::SelectLod(const glm::vec3& cameraPosition, float projectionScale, float errorThreshold, float hysteresis) {
+    const float distance = glm::length(worldSphere.center - cameraPosition);
+    const float radius = worldSphere.radius;
+    if (distance <= radius || sphere.radius <= 0.0f) {
+        lod = 0;
+        return;
+    }
+    // errors are measured in the mesh, so they shrink with the projected bounding sphere
+    const float projectedRadius = radius / distance * projectionScale;
+    auto coarsest = [&](float threshold) {
+        uint32_t level = 0;
+        while (level + 1 < lods.size() && lods[level + 1].error / sphere.radius * projectedRadius <= threshold) ++level;
+        return level;
+    };
+    // a narrower band to go coarser than to go back keeps the level from flickering
+    lod = std::clamp(lod, coarsest(errorThreshold * (1.0f - hysteresis)), coarsest(errorThreshold * (1.0f + hysteresis)));
+}
+
+void Mesh::CullMeshlets(const Frustum& frustum, const glm::vec3& cameraPosition, MeshletCullStats& stats) {
+    drawRanges.clear();
+    // meshlet bounds are in object space, so the frustum and the camera move there instead
+    const glm::mat4x4& model = globalTransforms.Rot;
+    const Frustum localFrustum = frustum.Transformed(model);
+    const glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+    const bool visible = localFrustum.IntersectsSphere(sphere.center, sphere.radius);
+    // from inside the mesh the back faces are what shows
+    const bool inside = glm::length(camera - sphere.center) <= sphere.radius;
+    const MeshLod& level = lods[lod];
+    for (uint32_t s = level.firstSubmesh; s < level.firstSubmesh + level.submeshCount; ++s) {
+        const Submesh& submesh = submeshes[s];
+        if (submesh.meshletCount == 0) {
+            if (visible) drawRanges.push_back(DrawRange{submesh.firstIndex, submesh.indexCount, submesh.material});
+            continue;
+        }
+        stats.total += submesh.meshletCount;
+        if (!visible) {
+            stats.frustumCulled += submesh.meshletCount;
+            continue;
+        }
+        for (uint32_t m = submesh.firstMeshlet; m < submesh.firstMeshlet + submesh.meshletCount; ++m) {
+            const Meshlet& meshlet = meshlets[m];
+            if (!localFrustum.IntersectsSphere(meshlet.center, meshlet.radius)) {
+                ++stats.frustumCulled;
+                continue;
+            }
+            if (!inside && ConeBackFacing(meshlet.center, meshlet.radius, meshlet.coneAxis, meshlet.coneCutoff, camera)) {
+                ++stats.backfaceCulled;
+                continue;
+            }
+            // meshlets that follow each other in the index buffer share one draw
+            DrawRange* last = drawRanges.empty() ? nullptr : &drawRanges.back();
+            if (last && last->material == submesh.material && last->firstIndex + last->indexCount == meshlet.firstIndex) {
+                last->indexCount += meshlet.indexCount;
+            }
+            else {
+                drawRanges.push_back(DrawRange{meshlet.firstIndex, meshlet.indexCount, submesh.material});
+            }
+        }
+    }
+}
+
 Mesh* Mesh::GetParent() {
     return parent;
 }
@@ -96,65 +406,185 @@ std::vector<Mesh*> Mesh::GetChildren() {
     return children;
 }
 
-void Mesh::AddChild(Mesh* child) {
-    children.push_back(child);
+void Mesh::SetParent(Mesh* parent) {
+    this->parent = parent;
+    parent->AddChild(this);
+    UpdateTransforms();
 }
 
-void Mesh::InitializeTexture() {
-    texView = nullptr;
-    normalTexView = nullptr;
-    texture = LoadTexture(RESOURCE_DIR/"asteroid.png", device, &texView);
-    normalTexture = LoadTexture(RESOURCE_DIR/"asteroid_normal.png", device, &normalTexView);
-    //TODO: change so that texture path won't be hardcoded
+void Mesh::AddChild(Mesh* child) {
+    children.push_back(child);
 }
 
-void Mesh::InitializeBuffers(const std::filesystem::path& path) {
-    ResourceManager::loadGeometryObj(MODELS_DIR/path, vertexData);
-    vertexCount = static_cast<int>(vertexData.size());
+void Mesh::InitializeBuffers(const MeshPayload& payload, std::vector<MaterialData>& materialData) {
+    const VertexAttributes* vertices = nullptr;
+    const PackedVertex* packedVertices = payload.packedVertices.data();
+    const void* indices = nullptr;
+    uint64_t indexSize = 0;
+    if (payload.scene) {
+        // glTF meshes come without LODs or meshlets, nodes without a mesh keep everything empty
+        vertexCount = 0;
+        indexCount = 0;
+        indexFormat = IndexFormat::Uint16;
+        submeshes.clear();
+        if (payload.sceneMesh >= 0) {
+            const GltfMesh& mesh = payload.scene->meshes[payload.sceneMesh];
+            vertices = mesh.vertices;
+            vertexCount = mesh.vertexCount;
+            indices = mesh.indices;
+            indexCount = mesh.indexCount;
+            indexSize = mesh.indexSize;
+            indexFormat = mesh.indexFormat;
+            bounds = mesh.bounds;
+            sphere = mesh.sphere;
+            submeshes = mesh.submeshes;
+            for (uint32_t material : mesh.materials) materialData.push_back(payload.scene->materials[material].data);
+        }
+    }
+    else {
+        const GeometryCache& cache = payload.geometry;
+        vertices = cache.Vertices();
+        packedVertices = cache.PackedVertices();
+        vertexCount = cache.VertexCount();
+        indices = cache.Indices();
+        indexCount = cache.IndexCount();
+        indexSize = cache.IndexSize();
+        indexFormat = cache.GetIndexFormat();
+        bounds = cache.GetBounds();
+        sphere = cache.GetBoundingSphere();
+        submeshes = cache.Submeshes();
+        lods = cache.Lods();
+        meshlets = cache.Meshlets();
+        materialData = cache.Materials();
+    }
+    if (lods.empty()) lods.push_back(MeshLod{0, uint32_t(submeshes.size()), 0.0f});
 
+    // vertices upload straight from the cache blob or the mapped glTF, packed glTF ones from the payload
+    const bool packed = payload.vertexLayout == VertexLayout::Packed;
     BufferDescriptor bufferDesc;
     bufferDesc.label = "vertex data";
     bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Vertex;
-    bufferDesc.size = vertexData.size() * sizeof(VertexAttributes);
+    bufferDesc.size = vertexCount * (packed ? sizeof(PackedVertex) : sizeof(VertexAttributes));
     bufferDesc.mappedAtCreation = false;
     vertexBuffer = device.createBuffer(bufferDesc);
-    queue.writeBuffer(vertexBuffer, 0, vertexData.data(), bufferDesc.size);
+    if (bufferDesc.size > 0) {
+        if (packed) queue.writeBuffer(vertexBuffer, 0, packedVertices, bufferDesc.size);
+        else queue.writeBuffer(vertexBuffer, 0, vertices, bufferDesc.size);
+    }
+    if (packed) {
+        // travels with the transforms to the shader
+        quantOffset = glm::vec4(bounds.min, 0.0f);
+        quantScale = glm::vec4(glm::max(bounds.max - bounds.min, glm::vec3(0.0f)), 0.0f);
+    }
+
+    // the finest level within budget occludes on the CPU, compacted to the vertices it uses
+    occluderPositions.clear();
+    occluderIndices.clear();
+    for (const MeshLod& level : lods) {
+        uint32_t levelIndexCount = 0;
+        for (uint32_t s = level.firstSubmesh; s < level.firstSubmesh + level.submeshCount; ++s) levelIndexCount += submeshes[s].indexCount;
+        if (levelIndexCount / 3 > MAX_OCCLUDER_TRIANGLES) continue;
+        std::unordered_map<uint32_t, uint32_t> remap;
+        for (uint32_t s = level.firstSubmesh; s < level.firstSubmesh + level.submeshCount; ++s) {
+            for (uint32_t i = submeshes[s].firstIndex; i < submeshes[s].firstIndex + submeshes[s].indexCount; ++i) {
+                const uint32_t index = indexFormat == IndexFormat::Uint16 ? static_cast<const uint16_t*>(indices)[i] : static_cast<const uint32_t*>(indices)[i];
+                auto [slot, added] = remap.try_emplace(index, uint32_t(occluderPositions.size()));
+                if (added) {
+                    if (vertices != nullptr) {
+                        const auto& position = vertices[index].position;
+                        occluderPositions.push_back(glm::vec3(position[0], position[1], position[2]));
+                    }
+                    else {
+                        const uint16_t* position = packedVertices[index].position;
+                        occluderPositions.push_back(glm::vec3(quantOffset) + glm::vec3(position[0], position[1], position[2]) / 65535.0f * glm::vec3(quantScale));
+                    }
+                }
+                occluderIndices.push_back(slot->second);
+            }
+        }
+        break;
+    }
 
-    bufferDesc.label = "object transforms data";
-    bufferDesc.size = sizeof(ObjectTransforms);
-    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
+    bufferDesc.label = "index data";
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Index;
+    bufferDesc.size = indexSize;
     bufferDesc.mappedAtCreation = false;
-    transformsBuffer = device.createBuffer(bufferDesc);
-    queue.writeBuffer(transformsBuffer, 0, &globalTransforms, bufferDesc.size);
+    indexBuffer = device.createBuffer(bufferDesc);
+    if (bufferDesc.size > 0) queue.writeBuffer(indexBuffer, 0, indices, bufferDesc.size);
+}
+
+TextureHandle Mesh::AcquireTexture(const TextureSource& source, const MeshPayload& payload, TextureUploader& uploader) {
+    return ResourceManager::acquireTexture(source.key, [&]() -> TextureHandle {
+        ImageData image;
+        if (source.key == DEFAULT_WHITE_TEXTURE) image = ResourceManager::solidImage(255, 255, 255, 255);
+        else if (source.key == DEFAULT_NORMAL_TEXTURE) {
+            image = ResourceManager::solidImage(128, 128, 255, 255);
+            TextureCodec::PrepareNormalMap(image);
+        }
+        else {
+            auto decoded = payload.images.find(source.key);
+            if (decoded != payload.images.end()) {
+                return CreateTexture(decoded->second, source, device, uploader);
+            }
+            // the last user released it after the payload was built
+            image = DecodeTexture(source, payload);
+        }
+        return CreateTexture(image, source, device, uploader);
+    });
 }
 
-void Mesh::InitializeBinding(BindGroupLayout bindGroupLayout) {
-    // Create a binding
-    std::vector<BindGroupEntry> bindings(3);
+void Mesh::InitializeMaterials(BindGroupLayout materialBindGroupLayout, const std::vector<MaterialData>& materialData,
+    const MeshPayload& payload, TextureUploader& uploader) {
+    for (size_t i = 0; i < materialData.size(); ++i) {
+        const MaterialData& data = materialData[i];
+        const MaterialTextures textures = i < payload.textures.size() ? payload.textures[i]
+            : MaterialTextures{{DEFAULT_WHITE_TEXTURE, {}, false}, {DEFAULT_NORMAL_TEXTURE, {}, true}};
+        MeshMaterial material;
+        material.diffuseTexture = AcquireTexture(textures.diffuse, payload, uploader);
+        if (!material.diffuseTexture) material.diffuseTexture = AcquireTexture({DEFAULT_WHITE_TEXTURE, {}, false}, payload, uploader);
+        material.normalTexture = AcquireTexture(textures.normal, payload, uploader);
+        if (!material.normalTexture) material.normalTexture = AcquireTexture({DEFAULT_NORMAL_TEXTURE, {}, true}, payload, uploader);
+        MaterialUniforms uniforms;
+        uniforms.baseColor = glm::vec4(data.diffuse, 1.0f);
+
+        BufferDescriptor bufferDesc;
+        bufferDesc.label = "material data";
+        bufferDesc.size = sizeof(MaterialUniforms);
+        bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
+        bufferDesc.mappedAtCreation = false;
+        material.uniformBuffer = device.createBuffer(bufferDesc);
+        queue.writeBuffer(material.uniformBuffer, 0, &uniforms, sizeof(MaterialUniforms));
 
-    bindings[0].binding = 0;
-    bindings[0].textureView = texView;
+        std::vector<BindGroupEntry> bindings(3);
+        bindings[0].binding = 0;
+        bindings[0].textureView = material.diffuseTexture->view;
 
-    bindings[1].binding = 1;
-    bindings[1].buffer = transformsBuffer;
-    bindings[1].offset = 0;
-    bindings[1].size = sizeof(ObjectTransforms);
+        bindings[1].binding = 1;
+        bindings[1].buffer = material.uniformBuffer;
+        bindings[1].offset = 0;
+        bindings[1].size = sizeof(MaterialUniforms);
 
-    bindings[2].binding = 2;
-    bindings[2].textureView = normalTexView;
+        bindings[2].binding = 2;
+        bindings[2].textureView = material.normalTexture->view;
 
-    BindGroupDescriptor bindGroupDesc;
-    bindGroupDesc.layout = bindGroupLayout;
-    bindGroupDesc.entryCount = bindings.size();
-    bindGroupDesc.entries = bindings.data();
-    bindGroup = device.createBindGroup(bindGroupDesc);
+        BindGroupDescriptor bindGroupDesc;
+        bindGroupDesc.layout = materialBindGroupLayout;
+        bindGroupDesc.entryCount = bindings.size();
+        bindGroupDesc.entries = bindings.data();
+        material.bindGroup = device.createBindGroup(bindGroupDesc);
+        materials.push_back(material);
+    }
 }
 
 void Mesh::Terminate() {
     vertexBuffer.release();
-    transformsBuffer.release();
-    bindGroup.release();
-    texture.destroy();
-    texture.release();
-    texView.release();
+    indexBuffer.release();
+    transformBuffer->Free(transformSlot);
+    for (auto& material : materials) {
+        material.bindGroup.release();
+        material.uniformBuffer.release();
+        // the registry frees the GPU texture once no mesh holds it anymore
+        material.diffuseTexture.reset();
+        material.normalTexture.reset();
+    }
 }
\ No newline at end of file
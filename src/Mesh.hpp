@@ -1,25 +1,104 @@
+#pragma once
 #include <vector>
+#include <string>
+#include <memory>
+#include <optional>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include "Helpers.hpp"
 #include "ResourceManager.hpp"
+#include "GeometryCache.hpp"
+#include "Gltf.hpp"
+#include "TextureUploader.hpp"
+#include "TransformBuffer.hpp"
+#include "Culling.hpp"
+#include "SceneBvh.hpp"
 
 using namespace wgpu;
 
+// registry key of a material texture and the file it comes from, no path for the defaults
+struct TextureSource {
+    std::string key;
+    fs::path path;
+    bool normalMap = false;
+    int gltfImage = -1; // image embedded in the payload's glTF scene, path is empty then
+};
+
+struct MaterialTextures {
+    TextureSource diffuse, normal;
+};
+
+// CPU side of a mesh, produced on a worker thread and uploaded on the render thread
+struct MeshPayload {
+    fs::path path;
+    GeometryCache geometry;
+    // glTF meshes upload from the scene instead of a cache, nodes without a mesh have no geometry
+    std::shared_ptr<const GltfScene> scene;
+    int sceneMesh = -1;
+    // node transform relative to the parent, unset for meshes placed with SetTransforms
+    std::optional<glm::mat4x4> localMatrix;
+    // nodes below this one, uploaded with it
+    std::vector<MeshPayload> children;
+    VertexLayout vertexLayout = VertexLayout::Full;
+    std::vector<PackedVertex> packedVertices; // glTF meshes with VertexLayout::Packed, caches carry their own
+    std::vector<MaterialTextures> textures;
+    // images of textures that were not resident yet when the payload was built, by key
+    std::unordered_map<std::string, ImageData> images;
+};
+
+// part of the index buffer drawn with one material after culling
+struct DrawRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t material;
+};
+
+struct MeshMaterial {
+    Buffer uniformBuffer;
+    BindGroup bindGroup;
+    TextureHandle diffuseTexture, normalTexture;
+};
+
 class Mesh{
 public:
-    BindGroup bindGroup;
-    Texture texture, normalTexture;
-    TextureView texView, normalTexView;
-    Buffer vertexBuffer;
-    uint32_t vertexCount;
-    std::vector<VertexAttributes> vertexData;
-    ObjectTransforms localTransforms, globalTransforms;
-    Buffer transformsBuffer;
-
-    Mesh(Device device, Queue queue, BindGroupLayout bindGroupLayout, const std::filesystem::path& path, Mesh* parent=nullptr);
+    Buffer vertexBuffer, indexBuffer;
+    uint32_t vertexCount, indexCount;
+    IndexFormat indexFormat;
+    Bounds bounds;
+    BoundingSphere sphere;
+    // bounds and sphere through globalTransforms, kept up to date by UpdateTransforms
+    Bounds worldBounds;
+    BoundingSphere worldSphere;
+    std::vector<Submesh> submeshes;
+    std::vector<MeshLod> lods;
+    uint32_t lod = 0; // level drawn this frame
+    std::vector<Meshlet> meshlets;
+    std::vector<DrawRange> drawRanges; // what survived CullMeshlets
+    std::vector<MeshMaterial> materials;
+    MeshTransforms localTransforms, globalTransforms;
+    uint32_t transformSlot; // slot in the TransformBuffer, drawn as the first instance
+    bool instanced = false; // drawn through an InstancedMesh, not on its own
+    // object space triangles of a low level the OcclusionBuffer rasterizes, empty when every level is too dense
+    std::vector<glm::vec3> occluderPositions;
+    std::vector<uint32_t> occluderIndices;
+
+    static MeshPayload LoadPayload(const std::filesystem::path& path, VertexLayout vertexLayout = VertexLayout::Full);
+    Mesh(Device device, Queue queue, TransformBuffer& transformBuffer, BindGroupLayout materialBindGroupLayout, TextureUploader& uploader, const MeshPayload& payload, Mesh* parent=nullptr);
     void SetTransforms(glm::vec3 scale=glm::vec3(1.0f,1.0f,1.0f), glm::vec3 translate=glm::vec3(1.0f,1.0f,1.0f), glm::vec3 rotate=glm::vec3(0.0f,0.0f,0.0f));
+    // full local transform of an imported node, replaces the scale and translation
+    void SetLocalMatrix(const glm::mat4x4& matrix);
+    // recomputes the global transforms of this mesh and its children and hands them to the TransformBuffer
     void UpdateTransforms();
+    // the BVH refitted with worldBounds whenever the mesh moves, object is its id there
+    void SetSceneBvh(SceneBvh* bvh, uint32_t object);
+    ObjectTransforms GpuTransforms() const;
+    // picks the coarsest level whose error covers at most errorThreshold pixels, projectionScale
+    // turns size over distance into pixels and hysteresis keeps the level stable near a switch
+    void SelectLod(const glm::vec3& cameraPosition, float projectionScale, float errorThreshold, float hysteresis);
+    // culls the meshlets of the selected level against a world space frustum and fills drawRanges
+    void CullMeshlets(const Frustum& frustum, const glm::vec3& cameraPosition, MeshletCullStats& stats);
     Mesh* GetParent();
+    void SetParent(Mesh* parent);
     std::vector<Mesh*> GetChildren();
     void AddChild(Mesh* child);
     void Terminate();
@@ -28,7 +107,14 @@ private:
     Device device;
     Mesh* parent;
     std::vector<Mesh*> children;
-    void InitializeTexture();
-    void InitializeBuffers(const std::filesystem::path& path);
-    void InitializeBinding(BindGroupLayout bindGroupLayout);
+    TransformBuffer* transformBuffer;
+    SceneBvh* sceneBvh = nullptr;
+    uint32_t sceneObject = 0;
+    // packed vertex positions are unorm16 in the mesh AABB, see ObjectTransforms
+    glm::vec4 quantOffset = glm::vec4(0.0f), quantScale = glm::vec4(1.0f);
+    std::optional<glm::mat4x4> localMatrix;
+    void InitializeBuffers(const MeshPayload& payload, std::vector<MaterialData>& materialData);
+    void InitializeMaterials(BindGroupLayout materialBindGroupLayout, const std::vector<MaterialData>& materialData,
+        const MeshPayload& payload, TextureUploader& uploader);
+    TextureHandle AcquireTexture(const TextureSource& source, const MeshPayload& payload, TextureUploader& uploader);
 };
\ No newline at end of file
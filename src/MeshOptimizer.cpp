@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include "MeshOptimizer.hpp"
+#include "JobSystem.hpp"
+
+namespace {
+// a common post-transform cache size, Tipsify is not sensitive to the exact value
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+// overdraw clusters may cost this much more ACMR than the cache optimized order
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+// triangles of a meshlet must face within about 84 degrees of its axis for a normal cone
+constexpr float MESHLET_MIN_CONE_DOT = 0.1f;
+
+// FIFO cache model, a vertex is cached while fewer than size vertices were inserted after it
+struct FifoCache {
+    std::vector<uint32_t> insertedAt;
+    uint32_t size;
+    uint32_t time;
+    FifoCache(size_t vertexCount, uint32_t size) : insertedAt(vertexCount, 0), size(size), time(size + 1) {}
+    uint32_t Access(uint32_t vertex) {
+        if (time - insertedAt[vertex] <= size) return 0;
+        insertedAt[vertex] = time++;
+        return 1;
+    }
+    uint32_t AccessTriangle(const uint32_t* triangle) {
+        return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]);
+    }
+    void Flush() {
+        time += size + 1;
+    }
+};
+
+glm::vec3 Position(const std::vector<VertexAttributes>& vertices, uint32_t index) {
+    const auto& p = vertices[index].position;
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+// Grows meshlets over shared positions: starting from the earliest triangle left in the
+// cache and overdraw optimized order, it adds the neighbour that brings the fewest new
+// vertices, then the one closest to the meshlet that faces its way. Compact, flat meshlets
+// get tight spheres and narrow normal cones.
+void BuildSubmeshMeshlets(uint32_t* indices, size_t indexCount, const std::vector<VertexAttributes>& vertices,
+    uint32_t firstIndex, std::vector<Meshlet>& meshlets) {
+    const uint32_t triangleCount = uint32_t(indexCount / 3);
+    if (triangleCount == 0) return;
+    const std::vector<uint32_t> input(indices, indices + indexCount);
+
+    // the vertices this range uses, and the positions they sit on so hard edges and uv seams
+    // don't stop a meshlet from growing
+    std::unordered_map<uint32_t, uint32_t> localVertices;
+    std::map<std::array<float, 3>, uint32_t> localPositions;
+    std::vector<uint32_t> localIndices(indexCount), positionIndices(indexCount);
+    for (size_t i = 0; i < indexCount; ++i) {
+        localIndices[i] = localVertices.emplace(input[i], uint32_t(localVertices.size())).first->second;
+        positionIndices[i] = localPositions.emplace(vertices[input[i]].position, uint32_t(localPositions.size())).first->second;
+    }
+    const size_t vertexCount = localVertices.size();
+    const size_t positionCount = localPositions.size();
+    std::vector<uint32_t> offsets(positionCount + 1, 0);
+    for (uint32_t index : positionIndices) offsets[index + 1]++;
+    for (size_t p = 0; p < positionCount; ++p) offsets[p + 1] += offsets[p];
+    std::vector<uint32_t> adjacency(indexCount);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) adjacency[fill[positionIndices[i]]++] = uint32_t(i / 3);
+
+    std::vector<glm::vec3> centroids(triangleCount), normals(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        const glm::vec3 p0 = Position(vertices, input[3 * t]);
+        const glm::vec3 p1 = Position(vertices, input[3 * t + 1]);
+        const glm::vec3 p2 = Position(vertices, input[3 * t + 2]);
+        centroids[t] = (p0 + p1 + p2) / 3.0f;
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> stamp(vertexCount, ~0u), positionStamp(positionCount, ~0u);
+    std::vector<uint32_t> meshletPositions;
+    uint32_t meshletVertexCount = 0;
+    uint32_t cursor = 0;
+    uint32_t written = 0;
+    while (written < triangleCount) {
+        while (emitted[cursor]) ++cursor;
+        Meshlet meshlet = {};
+        meshlet.firstIndex = firstIndex + 3 * written;
+        const uint32_t id = uint32_t(meshlets.size());
+        meshletPositions.clear();
+        meshletVertexCount = 0;
+        glm::vec3 centroidSum(0.0f), normalSum(0.0f);
+        uint32_t triangle = cursor;
+        while (true) {
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; ++corner) {
+                const uint32_t vertex = localIndices[3 * triangle + corner];
+                const uint32_t position = positionIndices[3 * triangle + corner];
+                indices[3 * written + corner] = input[3 * triangle + corner];
+                if (stamp[vertex] != id) {
+                    stamp[vertex] = id;
+                    ++meshletVertexCount;
+                }
+                if (positionStamp[position] != id) {
+                    positionStamp[position] = id;
+                    meshletPositions.push_back(position);
+                }
+            }
+            ++written;
+            meshlet.indexCount += 3;
+            centroidSum += centroids[triangle];
+            normalSum += normals[triangle];
+            if (meshlet.indexCount == 3 * MESHLET_MAX_TRIANGLES) break;
+
+            const glm::vec3 center = centroidSum * (3.0f / meshlet.indexCount);
+            const float normalLength = glm::length(normalSum);
+            const glm::vec3 axis = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+            uint32_t best = ~0u;
+            uint32_t bestNew = 4;
+            float bestScore = std::numeric_limits<float>::max();
+            for (uint32_t position : meshletPositions) {
+                for (uint32_t a = offsets[position]; a < offsets[position + 1]; ++a) {
+                    const uint32_t candidate = adjacency[a];
+                    if (emitted[candidate]) continue;
+                    uint32_t newVertices = 0;
+                    for (int corner = 0; corner < 3; ++corner) {
+                        newVertices += stamp[localIndices[3 * candidate + corner]] != id ? 1 : 0;
+                    }
+                    if (meshletVertexCount + newVertices > MESHLET_MAX_VERTICES || newVertices > bestNew) continue;
+                    const float score = glm::length(centroids[candidate] - center) * (2.0f - glm::dot(normals[candidate], axis));
+                    if (newVertices < bestNew || score < bestScore) {
+                        best = candidate;
+                        bestNew = newVertices;
+                        bestScore = score;
+                    }
+                }
+            }
+            if (best == ~0u) break;
+            triangle = best;
+        }
+        meshlet.vertexCount = meshletVertexCount;
+        meshlets.push_back(meshlet);
+    }
+}
+
+// Normal cones only hide what can't be seen if the mesh is closed and consistently wound,
+// as the pipeline draws both sides. Returns 1 for outward facing triangles, -1 for inward
+// facing ones and 0 when the back of the surface may show.
+float SurfaceOrientation(const GeometryData& geometry, const Submesh& first, const Submesh& last) {
+    // positions rather than vertices, uv seams and hard edges split vertices but not the surface
+    std::map<std::array<float, 3>, uint32_t> positions;
+    std::vector<uint32_t> position(geometry.vertices.size());
+    for (size_t v = 0; v < geometry.vertices.size(); ++v) {
+        position[v] = positions.emplace(geometry.vertices[v].position, uint32_t(positions.size())).first->second;
+    }
+    std::vector<uint64_t> edges;
+    double volume = 0.0;
+    for (uint32_t i = first.firstIndex; i < last.firstIndex + last.indexCount; i += 3) {
+        for (int corner = 0; corner < 3; ++corner) {
+            const uint64_t a = position[geometry.indices[i + corner]];
+            const uint64_t b = position[geometry.indices[i + (corner + 1) % 3]];
+            edges.push_back(a << 32 | b);
+        }
+        const glm::dvec3 p0 = Position(geometry.vertices, geometry.indices[i]);
+        const glm::dvec3 p1 = Position(geometry.vertices, geometry.indices[i + 1]);
+        const glm::dvec3 p2 = Position(geometry.vertices, geometry.indices[i + 2]);
+        volume += glm::dot(p0, glm::cross(p1, p2));
+    }
+    // every directed edge must be unique and have its twin running the other way
+    std::sort(edges.begin(), edges.end());
+    for (size_t e = 0; e < edges.size(); ++e) {
+        if (e > 0 && edges[e] == edges[e - 1]) return 0.0f;
+        const uint64_t twin = (edges[e] & 0xffffffffull) << 32 | edges[e] >> 32;
+        if (!std::binary_search(edges.begin(), edges.end(), twin)) return 0.0f;
+    }
+    if (volume == 0.0) return 0.0f;
+    return volume > 0.0 ? 1.0f : -1.0f;
+}
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+    VertexCacheStats stats;
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t uniqueVertices = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        stats.misses += cache.Access(indices[i]);
+        if (!referenced[indices[i]]) {
+            referenced[indices[i]] = true;
+            ++uniqueVertices;
+        }
+    }
+    if (indexCount > 0) stats.acmr = float(stats.misses) / float(indexCount / 3);
+    if (uniqueVertices > 0) stats.atvr = float(stats.misses) / float(uniqueVertices);
+    return stats;
+}
+
+// Tipsify (Sander et al. 2007): fan around a vertex, then continue from the candidate that
+// will still be in the cache, falling back to the dead-end stack and the input order
+void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize,
+    std::vector<uint32_t>* clusters) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return;
+    const std::vector<uint32_t> input(indices, indices + indexCount);
+
+    // vertex to triangle adjacency
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : input) liveTriangles[index]++;
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] = offsets[v] + liveTriangles[v];
+    std::vector<uint32_t> adjacency(indexCount);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) adjacency[fill[input[i]]++] = uint32_t(i / 3);
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    size_t outputTriangles = 0;
+    size_t cursor = 0;
+    if (clusters) clusters->assign(1, 0);
+
+    int64_t fanning = input[0];
+    while (fanning >= 0) {
+        candidates.clear();
+        for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle]) continue;
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; ++corner) {
+                const uint32_t vertex = input[3 * triangle + corner];
+                indices[3 * outputTriangles + corner] = vertex;
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                if (time - cacheTime[vertex] > cacheSize) cacheTime[vertex] = time++;
+            }
+            ++outputTriangles;
+        }
+
+        // prefer the oldest candidate whose remaining fan still fits in the cache
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates) {
+            if (liveTriangles[vertex] == 0) continue;
+            int64_t priority = 0;
+            if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) priority = time - cacheTime[vertex];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        if (next < 0) {
+            while (!deadEnd.empty() && next < 0) {
+                const uint32_t vertex = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[vertex] > 0) next = vertex;
+            }
+            while (next < 0 && cursor < indexCount) {
+                const uint32_t vertex = input[cursor++];
+                if (liveTriangles[vertex] > 0) next = vertex;
+            }
+            // the cache is cold after a jump, which makes it a safe place to cut clusters
+            if (next >= 0 && clusters) clusters->push_back(uint32_t(outputTriangles));
+        }
+        fanning = next;
+    }
+}
+
+// Sander et al. 2007: splits the cache optimized order into clusters that are cheap to
+// reorder, then draws the ones facing away from the mesh center first
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<VertexAttributes>& vertices,
+    const std::vector<uint32_t>& hardClusters, uint32_t cacheSize, float threshold) {
+    const uint32_t triangleCount = uint32_t(indexCount / 3);
+    if (triangleCount == 0) return;
+
+    // soft boundaries where the cluster so far is already as cache friendly as the whole
+    std::vector<uint32_t> clusters;
+    FifoCache cache(vertices.size(), cacheSize);
+    for (size_t c = 0; c < hardClusters.size(); ++c) {
+        const uint32_t start = hardClusters[c];
+        const uint32_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+        if (start >= end) continue;
+        cache.Flush();
+        uint32_t misses = 0;
+        for (uint32_t t = start; t < end; ++t) misses += cache.AccessTriangle(&indices[3 * t]);
+        const float clusterThreshold = threshold * float(misses) / float(end - start);
+
+        cache.Flush();
+        clusters.push_back(start);
+        uint32_t clusterStart = start;
+        uint32_t clusterMisses = 0;
+        for (uint32_t t = start; t < end; ++t) {
+            clusterMisses += cache.AccessTriangle(&indices[3 * t]);
+            if (t + 1 < end && float(clusterMisses) <= clusterThreshold * float(t + 1 - clusterStart)) {
+                clusters.push_back(t + 1);
+                clusterStart = t + 1;
+                clusterMisses = 0;
+                cache.Flush();
+            }
+        }
+    }
+
+    // area weighted centroid and normal of every cluster and of the whole range
+    std::vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+    std::vector<float> areas(clusters.size(), 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        for (uint32_t t = clusters[c]; t < end; ++t) {
+            const glm::vec3 p0 = Position(vertices, indices[3 * t]);
+            const glm::vec3 p1 = Position(vertices, indices[3 * t + 1]);
+            const glm::vec3 p2 = Position(vertices, indices[3 * t + 2]);
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(normal);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+    std::vector<float> keys(clusters.size(), 0.0f);
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        const float normalLength = glm::length(normals[c]);
+        if (areas[c] <= 0.0f || normalLength <= 0.0f) continue;
+        keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+    }
+
+    std::vector<uint32_t> order(clusters.size());
+    for (uint32_t c = 0; c < order.size(); ++c) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    const std::vector<uint32_t> source(indices, indices + indexCount);
+    size_t written = 0;
+    for (uint32_t c : order) {
+        const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        std::copy(source.begin() + 3 * size_t(clusters[c]), source.begin() + 3 * size_t(end), indices + written);
+        written += 3 * size_t(end - clusters[c]);
+    }
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GeometryData& geometry) {
+    // vertices in order of first use, anything unreferenced keeps its place at the end
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(geometry.vertices.size(), unused);
+    std::vector<VertexAttributes> vertices;
+    vertices.reserve(geometry.vertices.size());
+    for (uint32_t& index : geometry.indices) {
+        if (remap[index] == unused) {
+            remap[index] = uint32_t(vertices.size());
+            vertices.push_back(geometry.vertices[index]);
+        }
+        index = remap[index];
+    }
+    for (size_t v = 0; v < geometry.vertices.size(); ++v) {
+        if (remap[v] == unused) vertices.push_back(geometry.vertices[v]);
+    }
+    geometry.vertices.swap(vertices);
+}
+
+void MeshOptimizer::Optimize(GeometryData& geometry) {
+    if (geometry.indices.empty()) return;
+    auto start = std::chrono::steady_clock::now();
+    const size_t vertexCount = geometry.vertices.size();
+    const VertexCacheStats before = AnalyzeVertexCache(geometry.indices.data(), geometry.indices.size(), vertexCount, VERTEX_CACHE_SIZE);
+
+    // submeshes are independent index ranges, so they can be reordered side by side
+    JobSystem::Get().ParallelFor(geometry.submeshes.size(), [&](size_t s) {
+        const Submesh& submesh = geometry.submeshes[s];
+        uint32_t* indices = geometry.indices.data() + submesh.firstIndex;
+        std::vector<uint32_t> clusters;
+        OptimizeVertexCache(indices, submesh.indexCount, vertexCount, VERTEX_CACHE_SIZE, &clusters);
+        OptimizeOverdraw(indices, submesh.indexCount, geometry.vertices, clusters, VERTEX_CACHE_SIZE, OVERDRAW_THRESHOLD);
+    });
+    OptimizeVertexFetch(geometry);
+
+    const VertexCacheStats after = AnalyzeVertexCache(geometry.indices.data(), geometry.indices.size(), vertexCount, VERTEX_CACHE_SIZE);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Mesh optimized in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms: ACMR "
+        << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+void MeshOptimizer::ComputeMeshletBounds(const GeometryData& geometry, float orientation, Meshlet& meshlet) {
+    Bounds bounds;
+    glm::vec3 normalSum(0.0f);
+    for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+        const glm::vec3 p0 = Position(geometry.vertices, geometry.indices[i]);
+        const glm::vec3 p1 = Position(geometry.vertices, geometry.indices[i + 1]);
+        const glm::vec3 p2 = Position(geometry.vertices, geometry.indices[i + 2]);
+        bounds.min = glm::min(bounds.min, glm::min(p0, glm::min(p1, p2)));
+        bounds.max = glm::max(bounds.max, glm::max(p0, glm::max(p1, p2)));
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f) normalSum += normal / length;
+    }
+    meshlet.center = 0.5f * (bounds.min + bounds.max);
+    meshlet.radius = 0.0f;
+    for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(Position(geometry.vertices, geometry.indices[i]) - meshlet.center));
+    }
+
+    // the cone has to contain every triangle normal, wide cones never cull anything
+    meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    const float axisLength = glm::length(normalSum);
+    if (orientation == 0.0f || axisLength <= 0.0f) return;
+    const glm::vec3 axis = normalSum / axisLength;
+    float minDot = 1.0f;
+    for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+        const glm::vec3 p0 = Position(geometry.vertices, geometry.indices[i]);
+        const glm::vec3 p1 = Position(geometry.vertices, geometry.indices[i + 1]);
+        const glm::vec3 p2 = Position(geometry.vertices, geometry.indices[i + 2]);
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f) minDot = std::min(minDot, glm::dot(axis, normal / length));
+    }
+    if (minDot <= MESHLET_MIN_CONE_DOT) return;
+    meshlet.coneAxis = axis * orientation;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void MeshOptimizer::BuildMeshlets(GeometryData& geometry) {
+    geometry.meshlets.clear();
+    if (geometry.submeshes.empty()) return;
+    // the full mesh decides for every level, simplification keeps borders where they are
+    const Submesh& fullLast = geometry.lods.empty() ? geometry.submeshes.back()
+        : geometry.submeshes[geometry.lods[0].firstSubmesh + geometry.lods[0].submeshCount - 1];
+    const float orientation = SurfaceOrientation(geometry, geometry.submeshes.front(), fullLast);
+
+    // ranges are independent, each one is regrouped in place and gets its meshlets appended
+    std::vector<std::vector<Meshlet>> submeshMeshlets(geometry.submeshes.size());
+    JobSystem::Get().ParallelFor(geometry.submeshes.size(), [&](size_t s) {
+        const Submesh& submesh = geometry.submeshes[s];
+        BuildSubmeshMeshlets(geometry.indices.data() + submesh.firstIndex, submesh.indexCount, geometry.vertices,
+            submesh.firstIndex, submeshMeshlets[s]);
+    });
+    for (size_t s = 0; s < geometry.submeshes.size(); ++s) {
+        geometry.submeshes[s].firstMeshlet = uint32_t(geometry.meshlets.size());
+        geometry.submeshes[s].meshletCount = uint32_t(submeshMeshlets[s].size());
+        geometry.meshlets.insert(geometry.meshlets.end(), submeshMeshlets[s].begin(), submeshMeshlets[s].end());
+    }
+    // the triangles moved, so vertices follow the new first use order
+    OptimizeVertexFetch(geometry);
+    JobSystem::Get().ParallelFor(geometry.meshlets.size(), [&](size_t m) {
+        ComputeMeshletBounds(geometry, orientation, geometry.meshlets[m]);
+    });
+
+    size_t cones = 0;
+    for (const Meshlet& meshlet : geometry.meshlets) cones += meshlet.coneCutoff < 1.0f ? 1 : 0;
+    std::cout << geometry.meshlets.size() << " meshlets, " << float(geometry.indices.size() / 3) / geometry.meshlets.size()
+        << " triangles each on average, " << cones << " with a normal cone"
+        << (orientation == 0.0f ? " (open or inconsistently wound surface)" : "") << std::endl;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ResourceManager.hpp"
+
+// post-transform cache efficiency of an index buffer under a FIFO cache
+struct VertexCacheStats {
+    uint32_t misses = 0;
+    float acmr = 0.0f; // average cache miss ratio, transformed vertices per triangle
+    float atvr = 0.0f; // average transform to vertex ratio, 1.0 is ideal
+};
+
+// meshlet limits, small enough for a workgroup to hold a meshlet's vertices
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Offline style reordering run once at load time, the result lands in the geometry cache.
+// Triangles are reordered per submesh with Tipsify for the post-transform cache, then its
+// clusters are sorted outside in to help early-z. Vertices finally follow first use so
+// fetches walk the vertex buffer linearly.
+class MeshOptimizer {
+public:
+    static void Optimize(GeometryData& geometry);
+
+    static VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize);
+    static void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize,
+        std::vector<uint32_t>* clusters);
+    static void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<VertexAttributes>& vertices,
+        const std::vector<uint32_t>& hardClusters, uint32_t cacheSize, float threshold);
+    static void OptimizeVertexFetch(GeometryData& geometry);
+    // regroups the triangles of every submesh into meshlets, run after Optimize
+    static void BuildMeshlets(GeometryData& geometry);
+    static void ComputeMeshletBounds(const GeometryData& geometry, float orientation, Meshlet& meshlet);
+};
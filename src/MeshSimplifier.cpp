@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include "MeshSimplifier.hpp"
+
+namespace {
+// share of the full triangle count each coarser level aims for
+constexpr float LOD_RATIOS[] = {0.5f, 0.25f, 0.125f, 0.0625f};
+// largest allowed deviation from the full mesh, relative to the bounding sphere radius
+constexpr double LOD_MAX_ERROR = 0.05;
+// a level that is not at least this much smaller than the previous one ends the chain
+constexpr float LOD_MIN_REDUCTION = 0.9f;
+// attribute change against squared relative distance when ordering collapses
+constexpr double ATTRIBUTE_WEIGHT = 1e-3;
+// attribute change a vertex may pile up, roughly a 40 degree normal rotation
+constexpr double ATTRIBUTE_MAX_ERROR = 0.5;
+
+// sum of squared distances to a set of area weighted planes
+struct Quadric {
+    double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    static Quadric FromPlane(const glm::dvec3& n, double d, double w) {
+        Quadric q;
+        q.a00 = w * n.x * n.x; q.a11 = w * n.y * n.y; q.a22 = w * n.z * n.z;
+        q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z; q.a12 = w * n.y * n.z;
+        q.b0 = w * n.x * d; q.b1 = w * n.y * d; q.b2 = w * n.z * d;
+        q.c = w * d * d;
+        q.weight = w;
+        return q;
+    }
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00; a11 += q.a11; a22 += q.a22;
+        a01 += q.a01; a02 += q.a02; a12 += q.a12;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+    // weighted mean squared distance of p to the planes
+    double Error(const glm::dvec3& p) const {
+        const double e = p.x * (a00 * p.x + a01 * p.y + a02 * p.z) + p.y * (a01 * p.x + a11 * p.y + a12 * p.z) +
+            p.z * (a02 * p.x + a12 * p.y + a22 * p.z) + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return weight > 0.0 ? std::max(0.0, e) / weight : 0.0;
+    }
+};
+
+// moves every vertex at one position onto the vertices of a neighbouring position
+struct Collapse {
+    uint32_t from, to;
+    double error;      // squared, relative to the mesh radius
+    double attribute;  // attribute change of the worst wedge
+    double cost;
+};
+
+double AttributeDistance(const VertexAttributes& a, const VertexAttributes& b) {
+    double distance = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        distance += double(a.normal[i] - b.normal[i]) * (a.normal[i] - b.normal[i]);
+        distance += double(a.color[i] - b.color[i]) * (a.color[i] - b.color[i]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        distance += double(a.texCoords[i] - b.texCoords[i]) * (a.texCoords[i] - b.texCoords[i]);
+    }
+    return distance;
+}
+
+// Vertices that share a position but differ in attributes are wedges of one position.
+// Collapses work on positions and move each wedge to the wedge it shares an edge with.
+class Simplifier {
+public:
+    Simplifier(const std::vector<VertexAttributes>& vertices, const std::vector<uint32_t>& indices,
+        const std::vector<uint32_t>& triangleSubmesh, float radius);
+    // collapses until targetTriangles are left or nothing fits in maxError, relative to the radius
+    void Simplify(size_t targetTriangles, double maxError);
+    size_t TriangleCount() const { return indices.size() / 3; }
+    const std::vector<uint32_t>& Indices() const { return indices; }
+    const std::vector<uint32_t>& TriangleSubmesh() const { return triangleSubmesh; }
+    // object space error of the current triangles
+    float Error() const { return float(std::sqrt(error) * radius); }
+
+private:
+    const std::vector<VertexAttributes>& vertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> triangleSubmesh;
+    double radius;
+    double error = 0.0;
+
+    std::vector<uint32_t> position;  // vertex to position
+    std::vector<uint32_t> wedgeOffsets, wedges;
+    std::vector<glm::dvec3> points;
+    std::vector<Quadric> quadrics;
+    std::vector<double> attributeError;
+    std::vector<bool> locked;
+
+    // current triangles around every vertex
+    std::vector<uint32_t> fanOffsets, fans;
+
+    void BuildPositions();
+    void BuildQuadrics();
+    void LockVertices();
+    void BuildFans();
+    bool MapWedges(uint32_t from, uint32_t to, std::vector<uint32_t>& mapping, double& attribute) const;
+    bool Flips(uint32_t from, uint32_t to) const;
+};
+
+Simplifier::Simplifier(const std::vector<VertexAttributes>& vertices, const std::vector<uint32_t>& indices,
+    const std::vector<uint32_t>& triangleSubmesh, float radius)
+    : vertices(vertices), indices(indices), triangleSubmesh(triangleSubmesh), radius(radius) {
+    BuildPositions();
+    BuildQuadrics();
+    LockVertices();
+}
+
+void Simplifier::BuildPositions() {
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return vertices[a].position < vertices[b].position; });
+    position.assign(vertices.size(), 0);
+    wedgeOffsets.clear();
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i == 0 || vertices[order[i]].position != vertices[order[i - 1]].position) {
+            wedgeOffsets.push_back(uint32_t(i));
+            const auto& p = vertices[order[i]].position;
+            points.push_back(glm::dvec3(p[0], p[1], p[2]));
+        }
+        position[order[i]] = uint32_t(wedgeOffsets.size() - 1);
+    }
+    wedgeOffsets.push_back(uint32_t(order.size()));
+    wedges = order;
+}
+
+void Simplifier::BuildQuadrics() {
+    quadrics.assign(points.size(), Quadric());
+    attributeError.assign(points.size(), 0.0);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const uint32_t p[3] = {position[indices[i]], position[indices[i + 1]], position[indices[i + 2]]};
+        const glm::dvec3 normal = glm::cross(points[p[1]] - points[p[0]], points[p[2]] - points[p[0]]);
+        const double area = glm::length(normal);
+        if (area <= 0.0) continue;
+        const glm::dvec3 n = normal / area;
+        const Quadric plane = Quadric::FromPlane(n, -glm::dot(n, points[p[0]]), area);
+        for (uint32_t corner : p) quadrics[corner] += plane;
+    }
+}
+
+void Simplifier::LockVertices() {
+    locked.assign(points.size(), false);
+    // edges between positions, a < b
+    struct Edge {
+        uint32_t a, b;
+    };
+    std::vector<Edge> edges;
+    edges.reserve(indices.size());
+    std::vector<uint32_t> positionSubmesh(points.size(), ~0u);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        const uint32_t v0 = indices[i];
+        const uint32_t v1 = indices[i - i % 3 + (i + 1) % 3];
+        const uint32_t a = position[v0], b = position[v1];
+        if (a != b) edges.push_back(Edge{std::min(a, b), std::max(a, b)});
+        // vertices on a material boundary keep the boundary where it is
+        const uint32_t submesh = triangleSubmesh[i / 3];
+        if (positionSubmesh[a] != ~0u && positionSubmesh[a] != submesh) locked[a] = true;
+        positionSubmesh[a] = submesh;
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+        return x.a != y.a ? x.a < y.a : x.b < y.b;
+    });
+    for (size_t start = 0, end; start < edges.size(); start = end) {
+        for (end = start + 1; end < edges.size() && edges[end].a == edges[start].a && edges[end].b == edges[start].b; ++end) {}
+        // open borders and non manifold edges keep their shape
+        if (end - start != 2) locked[edges[start].a] = locked[edges[start].b] = true;
+    }
+}
+
+void Simplifier::BuildFans() {
+    fanOffsets.assign(vertices.size() + 1, 0);
+    for (uint32_t index : indices) fanOffsets[index + 1]++;
+    for (size_t v = 0; v < vertices.size(); ++v) fanOffsets[v + 1] += fanOffsets[v];
+    fans.resize(indices.size());
+    std::vector<uint32_t> fill(fanOffsets.begin(), fanOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) fans[fill[indices[i]]++] = uint32_t(i / 3);
+}
+
+bool Simplifier::MapWedges(uint32_t from, uint32_t to, std::vector<uint32_t>& mapping, double& attribute) const {
+    mapping.clear();
+    attribute = 0.0;
+    for (uint32_t w = wedgeOffsets[from]; w < wedgeOffsets[from + 1]; ++w) {
+        const uint32_t vertex = wedges[w];
+        // unused wedges can stay where they are
+        if (fanOffsets[vertex] == fanOffsets[vertex + 1]) continue;
+        // a wedge follows the target wedge it shares an edge with, on hard edges and seams
+        // that it doesn't touch the closest one, either way the attribute change is the cost
+        uint32_t target = ~0u;
+        double distance = std::numeric_limits<double>::max();
+        for (uint32_t f = fanOffsets[vertex]; f < fanOffsets[vertex + 1]; ++f) {
+            const uint32_t* triangle = &indices[3 * fans[f]];
+            for (int corner = 0; corner < 3; ++corner) {
+                if (position[triangle[corner]] != to) continue;
+                const double d = AttributeDistance(vertices[vertex], vertices[triangle[corner]]);
+                if (d < distance) {
+                    distance = d;
+                    target = triangle[corner];
+                }
+            }
+        }
+        for (uint32_t t = wedgeOffsets[to]; target == ~0u && t < wedgeOffsets[to + 1]; ++t) {
+            const double d = AttributeDistance(vertices[vertex], vertices[wedges[t]]);
+            if (d < distance) {
+                distance = d;
+                target = wedges[t];
+            }
+        }
+        mapping.push_back(vertex);
+        mapping.push_back(target);
+        attribute = std::max(attribute, distance);
+    }
+    return !mapping.empty();
+}
+
+bool Simplifier::Flips(uint32_t from, uint32_t to) const {
+    for (uint32_t w = wedgeOffsets[from]; w < wedgeOffsets[from + 1]; ++w) {
+        const uint32_t vertex = wedges[w];
+        for (uint32_t f = fanOffsets[vertex]; f < fanOffsets[vertex + 1]; ++f) {
+            const uint32_t* triangle = &indices[3 * fans[f]];
+            glm::dvec3 before[3], after[3];
+            bool degenerate = false;
+            for (int corner = 0; corner < 3; ++corner) {
+                const uint32_t p = position[triangle[corner]];
+                degenerate = degenerate || p == to;
+                before[corner] = points[p];
+                after[corner] = p == from ? points[to] : points[p];
+            }
+            if (degenerate) continue;
+            const glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+            const glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(n0, n1) <= 0.0) return true;
+        }
+    }
+    return false;
+}
+
+void Simplifier::Simplify(size_t targetTriangles, double maxError) {
+    const double maxErrorSquared = maxError * maxError;
+    const double inverseRadiusSquared = radius > 0.0 ? 1.0 / (radius * radius) : 0.0;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> mapping;
+    std::vector<uint32_t> remap(vertices.size());
+    std::vector<bool> touched(points.size());
+    // every pass collapses independent neighbourhoods cheapest first, then rebuilds the fans
+    while (TriangleCount() > targetTriangles) {
+        BuildFans();
+        collapses.clear();
+        for (size_t i = 0; i < indices.size(); ++i) {
+            const uint32_t a = position[indices[i]];
+            const uint32_t b = position[indices[i - i % 3 + (i + 1) % 3]];
+            if (a == b) continue;
+            if (!locked[a]) collapses.push_back(Collapse{a, b, 0.0, 0.0, 0.0});
+            if (!locked[b]) collapses.push_back(Collapse{b, a, 0.0, 0.0, 0.0});
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+            return x.from != y.from ? x.from < y.from : x.to < y.to;
+        });
+        collapses.erase(std::unique(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+            return x.from == y.from && x.to == y.to;
+        }), collapses.end());
+        size_t valid = 0;
+        for (Collapse collapse : collapses) {
+            collapse.error = quadrics[collapse.from].Error(points[collapse.to]) * inverseRadiusSquared;
+            if (collapse.error > maxErrorSquared) continue;
+            if (!MapWedges(collapse.from, collapse.to, mapping, collapse.attribute)) continue;
+            if (attributeError[collapse.from] + collapse.attribute > ATTRIBUTE_MAX_ERROR) continue;
+            collapse.cost = collapse.error + ATTRIBUTE_WEIGHT * collapse.attribute;
+            collapses[valid++] = collapse;
+        }
+        collapses.resize(valid);
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+        const size_t needed = TriangleCount() - targetTriangles;
+        size_t removed = 0;
+        size_t performed = 0;
+        for (const Collapse& collapse : collapses) {
+            if (removed >= needed) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            double attribute;
+            if (!MapWedges(collapse.from, collapse.to, mapping, attribute) || Flips(collapse.from, collapse.to)) continue;
+            for (size_t i = 0; i < mapping.size(); i += 2) remap[mapping[i]] = mapping[i + 1];
+            quadrics[collapse.to] += quadrics[collapse.from];
+            attributeError[collapse.to] = std::max(attributeError[collapse.to], attributeError[collapse.from] + attribute);
+            error = std::max(error, collapse.error);
+            ++performed;
+            // the fans around both ends are stale for the rest of this pass
+            touched[collapse.from] = touched[collapse.to] = true;
+            for (uint32_t w = wedgeOffsets[collapse.from]; w < wedgeOffsets[collapse.from + 1]; ++w) {
+                const uint32_t vertex = wedges[w];
+                for (uint32_t f = fanOffsets[vertex]; f < fanOffsets[vertex + 1]; ++f) {
+                    const uint32_t* triangle = &indices[3 * fans[f]];
+                    bool degenerate = false;
+                    for (int corner = 0; corner < 3; ++corner) {
+                        touched[position[triangle[corner]]] = true;
+                        degenerate = degenerate || position[triangle[corner]] == collapse.to;
+                    }
+                    if (degenerate) ++removed;
+                }
+            }
+        }
+        if (performed == 0) break;
+
+        size_t written = 0;
+        for (size_t t = 0; t < TriangleCount(); ++t) {
+            const uint32_t a = remap[indices[3 * t]], b = remap[indices[3 * t + 1]], c = remap[indices[3 * t + 2]];
+            if (position[a] == position[b] || position[b] == position[c] || position[a] == position[c]) continue;
+            indices[3 * written] = a;
+            indices[3 * written + 1] = b;
+            indices[3 * written + 2] = c;
+            triangleSubmesh[written++] = triangleSubmesh[t];
+        }
+        indices.resize(3 * written);
+        triangleSubmesh.resize(written);
+    }
+}
+}
+
+void MeshSimplifier::BuildLods(GeometryData& geometry) {
+    geometry.lods.assign(1, MeshLod{0, uint32_t(geometry.submeshes.size()), 0.0f});
+    if (geometry.indices.empty() || geometry.sphere.radius <= 0.0f) return;
+    auto start = std::chrono::steady_clock::now();
+    const size_t fullTriangles = geometry.indices.size() / 3;
+    std::vector<uint32_t> triangleSubmesh(fullTriangles);
+    for (uint32_t s = 0; s < geometry.submeshes.size(); ++s) {
+        const Submesh& submesh = geometry.submeshes[s];
+        std::fill_n(triangleSubmesh.begin() + submesh.firstIndex / 3, submesh.indexCount / 3, s);
+    }
+
+    // one simplifier runs down the whole chain so errors stay measured against the full mesh
+    Simplifier simplifier(geometry.vertices, geometry.indices, triangleSubmesh, geometry.sphere.radius);
+    const size_t baseSubmeshes = geometry.submeshes.size();
+    size_t previousTriangles = fullTriangles;
+    for (float ratio : LOD_RATIOS) {
+        simplifier.Simplify(size_t(fullTriangles * ratio), LOD_MAX_ERROR);
+        const size_t triangles = simplifier.TriangleCount();
+        if (triangles == 0 || triangles > previousTriangles * LOD_MIN_REDUCTION) break;
+        previousTriangles = triangles;
+
+        MeshLod lod{uint32_t(geometry.submeshes.size()), 0, simplifier.Error()};
+        const std::vector<uint32_t>& indices = simplifier.Indices();
+        const std::vector<uint32_t>& submeshes = simplifier.TriangleSubmesh();
+        for (size_t t = 0; t < triangles; ++t) {
+            if (t == 0 || submeshes[t] != submeshes[t - 1]) {
+                const uint32_t material = geometry.submeshes[submeshes[t]].material;
+                geometry.submeshes.push_back(Submesh{uint32_t(geometry.indices.size()), 0, material});
+                ++lod.submeshCount;
+            }
+            geometry.submeshes.back().indexCount += 3;
+            geometry.indices.insert(geometry.indices.end(), indices.begin() + 3 * t, indices.begin() + 3 * t + 3);
+        }
+        geometry.lods.push_back(lod);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "LOD chain built in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms: "
+        << fullTriangles << " triangles";
+    for (size_t l = 1; l < geometry.lods.size(); ++l) {
+        const MeshLod& lod = geometry.lods[l];
+        const Submesh& last = geometry.submeshes[lod.firstSubmesh + lod.submeshCount - 1];
+        const uint32_t indexCount = last.firstIndex + last.indexCount - geometry.submeshes[lod.firstSubmesh].firstIndex;
+        std::cout << " -> " << indexCount / 3 << " (error " << lod.error << ")";
+    }
+    std::cout << (geometry.submeshes.size() == baseSubmeshes ? ", nothing to simplify" : "") << std::endl;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "ResourceManager.hpp"
+
+// Builds the LOD chain of a mesh at load time with quadric error metric edge collapse
+// (Garland and Heckbert 1997). Collapses are half edge, so every level only needs its
+// own index ranges and shares the vertex buffer of the full mesh. Collapses are ordered
+// by geometric error plus the change of normal, colour and uv they cause, and both are
+// bounded. Open borders and material boundaries stay in place.
+class MeshSimplifier {
+public:
+    // fills geometry.lods, appending the indices and submeshes of every coarser level
+    static void BuildLods(GeometryData& geometry);
+};
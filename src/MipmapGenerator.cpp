@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <iostream>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2 1
+#endif
+#include "MipmapGenerator.hpp"
+#include "JobSystem.hpp"
+
+// rows of the destination level handled by one job in the CPU fallback
+constexpr size_t DOWNSAMPLE_ROWS_PER_JOB = 64;
+
+void MipmapGenerator::Initialize(Device device, Queue queue, bool useCompute) {
+    this->device = device;
+    this->queue = queue;
+    this->useCompute = useCompute;
+    if (!useCompute) {
+        std::cout << "Generating mipmaps on the CPU" << std::endl;
+        return;
+    }
+    std::vector<BindGroupLayoutEntry> bindingLayoutEntries(2, Default);
+    bindingLayoutEntries[0].binding = 0;
+    bindingLayoutEntries[0].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[0].texture.sampleType = TextureSampleType::Float;
+    bindingLayoutEntries[0].texture.viewDimension = TextureViewDimension::_2D;
+
+    bindingLayoutEntries[1].binding = 1;
+    bindingLayoutEntries[1].visibility = ShaderStage::Compute;
+    bindingLayoutEntries[1].storageTexture.access = StorageTextureAccess::WriteOnly;
+    bindingLayoutEntries[1].storageTexture.format = TextureFormat::RGBA8Unorm;
+    bindingLayoutEntries[1].storageTexture.viewDimension = TextureViewDimension::_2D;
+
+    BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+    bindGroupLayoutDesc.entryCount = bindingLayoutEntries.size();
+    bindGroupLayoutDesc.entries = bindingLayoutEntries.data();
+    bindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+
+    PipelineLayoutDescriptor layoutDesc{};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout*)&bindGroupLayout;
+    PipelineLayout layout = device.createPipelineLayout(layoutDesc);
+
+    ShaderModule shaderModule = ResourceManager::loadShaderModule("src/mipmap.wgsl", device);
+    if (shaderModule == nullptr) {
+        std::cerr << "Could not load mipmap shader, falling back to the CPU" << std::endl;
+        layout.release();
+        bindGroupLayout.release();
+        bindGroupLayout = nullptr;
+        this->useCompute = false;
+        return;
+    }
+    ComputePipelineDescriptor pipelineDesc;
+    pipelineDesc.label = "Mipmap pipeline";
+    pipelineDesc.layout = layout;
+    pipelineDesc.compute.module = shaderModule;
+    pipelineDesc.compute.entryPoint = "cs_main";
+    pipelineDesc.compute.constantCount = 0;
+    pipelineDesc.compute.constants = nullptr;
+    pipeline = device.createComputePipeline(pipelineDesc);
+    shaderModule.release();
+    layout.release();
+}
+
+void MipmapGenerator::Terminate() {
+    if (pipeline) pipeline.release();
+    if (bindGroupLayout) bindGroupLayout.release();
+}
+
+TextureUsage MipmapGenerator::RequiredUsage() const {
+    return useCompute ? TextureUsage::StorageBinding : TextureUsage::None;
+}
+
+bool MipmapGenerator::UsesCompute() const {
+    return useCompute;
+}
+
+uint32_t MipmapGenerator::MipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+void MipmapGenerator::Generate(Texture texture, const ImageData& image, uint32_t mipLevelCount) {
+    if (mipLevelCount <= 1) return;
+    if (useCompute) GenerateCompute(texture, mipLevelCount);
+    else GenerateCpu(texture, image, mipLevelCount);
+}
+
+void MipmapGenerator::GenerateCompute(Texture texture, uint32_t mipLevelCount) {
+    std::vector<TextureView> views;
+    std::vector<BindGroup> bindGroups;
+    TextureViewDescriptor viewDesc;
+    viewDesc.aspect = TextureAspect::All;
+    viewDesc.baseArrayLayer = 0;
+    viewDesc.arrayLayerCount = 1;
+    viewDesc.mipLevelCount = 1;
+    viewDesc.dimension = TextureViewDimension::_2D;
+    viewDesc.format = TextureFormat::RGBA8Unorm;
+    for (uint32_t level = 0; level < mipLevelCount; ++level) {
+        viewDesc.baseMipLevel = level;
+        views.push_back(texture.createView(viewDesc));
+    }
+
+    CommandEncoderDescriptor encoderDesc = {};
+    encoderDesc.label = "Mipmap command encoder";
+    CommandEncoder encoder = device.createCommandEncoder(encoderDesc);
+    ComputePassDescriptor computePassDesc;
+    computePassDesc.timestampWrites = nullptr;
+    ComputePassEncoder computePass = encoder.beginComputePass(computePassDesc);
+    computePass.setPipeline(pipeline);
+    uint32_t width = texture.getWidth();
+    uint32_t height = texture.getHeight();
+    for (uint32_t level = 1; level < mipLevelCount; ++level) {
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+        std::vector<BindGroupEntry> bindings(2);
+        bindings[0].binding = 0;
+        bindings[0].textureView = views[level - 1];
+        bindings[1].binding = 1;
+        bindings[1].textureView = views[level];
+
+        BindGroupDescriptor bindGroupDesc;
+        bindGroupDesc.layout = bindGroupLayout;
+        bindGroupDesc.entryCount = bindings.size();
+        bindGroupDesc.entries = bindings.data();
+        bindGroups.push_back(device.createBindGroup(bindGroupDesc));
+        // each dispatch sees the level written by the previous one
+        computePass.setBindGroup(0, bindGroups.back(), 0, nullptr);
+        computePass.dispatchWorkgroups((width + 7) / 8, (height + 7) / 8, 1);
+    }
+    computePass.end();
+    CommandBufferDescriptor cmdBufferDescriptor = {};
+    cmdBufferDescriptor.label = "Mipmap command buffer";
+    CommandBuffer command = encoder.finish(cmdBufferDescriptor);
+    queue.submit(1, &command);
+
+    command.release();
+    computePass.release();
+    encoder.release();
+    for (auto& bindGroup : bindGroups) bindGroup.release();
+    for (auto& view : views) view.release();
+}
+
+void MipmapGenerator::GenerateCpu(Texture texture, const ImageData& image, uint32_t mipLevelCount) {
+    ImageData level = image;
+    for (uint32_t mipLevel = 1; mipLevel < mipLevelCount; ++mipLevel) {
+        level = Downsample(level);
+        ImageCopyTexture destination;
+        destination.texture = texture;
+        destination.mipLevel = mipLevel;
+        destination.origin = { 0, 0, 0 };
+        destination.aspect = TextureAspect::All;
+        TextureDataLayout source;
+        source.offset = 0;
+        source.bytesPerRow = 4 * level.width;
+        source.rowsPerImage = level.height;
+        queue.writeTexture(destination, level.pixels.data(), level.pixels.size(), source,
+            { (uint32_t)level.width, (uint32_t)level.height, 1 });
+    }
+}
+
+// averages the 2x2 block at (x, y) of the source, clamping at odd edges
+static void DownsamplePixel(const ImageData& image, int x, int y, uint8_t* out) {
+    const int x1 = std::min(x + 1, image.width - 1);
+    const int y1 = std::min(y + 1, image.height - 1);
+    const uint8_t* a = &image.pixels[4 * ((size_t)y * image.width + x)];
+    const uint8_t* b = &image.pixels[4 * ((size_t)y * image.width + x1)];
+    const uint8_t* c = &image.pixels[4 * ((size_t)y1 * image.width + x)];
+    const uint8_t* d = &image.pixels[4 * ((size_t)y1 * image.width + x1)];
+    for (int channel = 0; channel < 4; ++channel) {
+        out[channel] = (uint8_t)((a[channel] + b[channel] + c[channel] + d[channel] + 2) >> 2);
+    }
+}
+
+static void DownsampleRow(const ImageData& image, ImageData& result, int y) {
+    uint8_t* out = &result.pixels[4 * (size_t)y * result.width];
+    int x = 0;
+#ifdef MIPMAP_SSE2
+    // four destination pixels per step, needs two full source rows
+    if (image.width > 1 && image.height > 1) {
+        const uint8_t* row0 = &image.pixels[4 * (size_t)(2 * y) * image.width];
+        const uint8_t* row1 = row0 + 4 * (size_t)image.width;
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; x + 4 <= result.width; x += 4) {
+            __m128i half[2];
+            for (int i = 0; i < 2; ++i) {
+                __m128i top = _mm_loadu_si128((const __m128i*)(row0 + 8 * x + 16 * i));
+                __m128i bottom = _mm_loadu_si128((const __m128i*)(row1 + 8 * x + 16 * i));
+                // vertical sums, two source pixels per register
+                __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+                __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+                // horizontal sums of neighbouring pixels land in the low halves
+                left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+                right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+                half[i] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(left, right), rounding), 2);
+            }
+            _mm_storeu_si128((__m128i*)(out + 4 * x), _mm_packus_epi16(half[0], half[1]));
+        }
+    }
+#endif
+    for (; x < result.width; ++x) {
+        DownsamplePixel(image, 2 * x, 2 * y, out + 4 * x);
+    }
+}
+
+ImageData MipmapGenerator::Downsample(const ImageData& image) {
+    ImageData result;
+    result.width = std::max(1, image.width / 2);
+    result.height = std::max(1, image.height / 2);
+    result.pixels.resize(4 * (size_t)result.width * result.height);
+    const size_t rows = result.height;
+    const size_t jobs = (rows + DOWNSAMPLE_ROWS_PER_JOB - 1) / DOWNSAMPLE_ROWS_PER_JOB;
+    JobSystem::Get().ParallelFor(jobs, [&](size_t job) {
+        const size_t end = std::min(rows, (job + 1) * DOWNSAMPLE_ROWS_PER_JOB);
+        for (size_t y = job * DOWNSAMPLE_ROWS_PER_JOB; y < end; ++y) {
+            DownsampleRow(image, result, (int)y);
+        }
+    });
+    return result;
+}
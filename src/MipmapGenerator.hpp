@@ -0,0 +1,32 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <cstdint>
+#include "ResourceManager.hpp"
+
+using namespace wgpu;
+
+// Fills the mip chain of RGBA8 textures. Uses a compute downsample on real backends
+// and a CPU box filter when there is no GPU to run it on (null backend, headless runs).
+class MipmapGenerator {
+public:
+    void Initialize(Device device, Queue queue, bool useCompute);
+    void Terminate();
+    // usage flags textures need so Generate can write their lower levels
+    TextureUsage RequiredUsage() const;
+    // false when Generate fills the levels from a CPU chain
+    bool UsesCompute() const;
+    // expects level 0 of texture to hold image already
+    void Generate(Texture texture, const ImageData& image, uint32_t mipLevelCount);
+
+    static uint32_t MipLevelCount(uint32_t width, uint32_t height);
+    static ImageData Downsample(const ImageData& image);
+
+private:
+    Device device;
+    Queue queue;
+    bool useCompute = false;
+    ComputePipeline pipeline;
+    BindGroupLayout bindGroupLayout;
+    void GenerateCompute(Texture texture, uint32_t mipLevelCount);
+    void GenerateCpu(Texture texture, const ImageData& image, uint32_t mipLevelCount);
+};
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <string>
+#include "ObjParser.hpp"
+#include "Vfs.hpp"
+#include "JobSystem.hpp"
+
+namespace {
+constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+enum RelativeFlags : uint8_t {
+    RELATIVE_POSITION = 1,
+    RELATIVE_TEXCOORD = 2,
+    RELATIVE_NORMAL = 4
+};
+
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+    std::vector<float> positions;
+    std::vector<float> colors;
+    std::vector<float> normals;
+    std::vector<float> texCoords;
+    // polygon corners as written in the file, negative indices are kept relative to the chunk
+    std::vector<ObjIndex> corners;
+    std::vector<uint8_t> relative;
+    std::vector<uint32_t> faceSizes;
+    // usemtl names seen in this chunk, faces before the first one continue the previous chunk's material
+    std::vector<std::string> materialNames;
+    std::vector<int> faceMaterials;
+    std::vector<std::string> materialLibraries;
+    int currentMaterial = -1;
+    size_t triangleCount = 0;
+    size_t firstPosition = 0, firstNormal = 0, firstTexCoord = 0, firstTriangle = 0;
+};
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+const char* SkipSpaces(const char* p, const char* end) {
+    while (p < end && IsSpace(*p)) ++p;
+    return p;
+}
+
+bool Keyword(const char* token, const char* end, const char* keyword) {
+    const size_t length = std::strlen(keyword);
+    return size_t(end - token) > length && std::memcmp(token, keyword, length) == 0 && IsSpace(token[length]);
+}
+
+std::string Trim(const char* p, const char* end) {
+    p = SkipSpaces(p, end);
+    while (end > p && IsSpace(end[-1])) --end;
+    return std::string(p, end);
+}
+
+bool ParseFloat(const char*& p, const char* end, float& value) {
+    p = SkipSpaces(p, end);
+    if (p < end && *p == '+') ++p;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+bool ParseInt(const char*& p, const char* end, int& value) {
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+// turns a 1 based or negative OBJ index into a zero based one relative to the chunk start
+int ResolveIndex(int index, size_t localCount, bool& relative) {
+    relative = index < 0;
+    return index > 0 ? index - 1 : static_cast<int>(localCount) + index;
+}
+
+void ParseFace(const char* p, const char* end, ObjChunk& chunk) {
+    uint32_t faceSize = 0;
+    const size_t localPositions = chunk.positions.size() / 3;
+    const size_t localTexCoords = chunk.texCoords.size() / 2;
+    const size_t localNormals = chunk.normals.size() / 3;
+    while (true) {
+        p = SkipSpaces(p, end);
+        int value;
+        if (p >= end || !ParseInt(p, end, value)) break;
+        ObjIndex corner = {-1, -1, -1};
+        uint8_t relative = 0;
+        bool isRelative;
+        corner.position = ResolveIndex(value, localPositions, isRelative);
+        if (isRelative) relative |= RELATIVE_POSITION;
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/' && ParseInt(p, end, value)) {
+                corner.texCoord = ResolveIndex(value, localTexCoords, isRelative);
+                if (isRelative) relative |= RELATIVE_TEXCOORD;
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                if (ParseInt(p, end, value)) {
+                    corner.normal = ResolveIndex(value, localNormals, isRelative);
+                    if (isRelative) relative |= RELATIVE_NORMAL;
+                }
+            }
+        }
+        chunk.corners.push_back(corner);
+        chunk.relative.push_back(relative);
+        ++faceSize;
+    }
+    if (faceSize < 3) {
+        // degenerate face, tinyobj skips these as well
+        chunk.corners.resize(chunk.corners.size() - faceSize);
+        chunk.relative.resize(chunk.relative.size() - faceSize);
+        return;
+    }
+    chunk.faceSizes.push_back(faceSize);
+    chunk.faceMaterials.push_back(chunk.currentMaterial);
+    chunk.triangleCount += faceSize - 2;
+}
+
+void ParseChunk(ObjChunk& chunk) {
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+        if (lineEnd == nullptr) lineEnd = chunk.end;
+        const char* end = lineEnd;
+        if (end > p && end[-1] == '\r') --end;
+        const char* token = SkipSpaces(p, end);
+        p = lineEnd + 1;
+        if (end - token < 2) continue;
+        if (token[0] == 'v' && IsSpace(token[1])) {
+            const char* q = token + 2;
+            float x = 0.0f, y = 0.0f, z = 0.0f, r = 1.0f, g = 1.0f, b = 1.0f;
+            ParseFloat(q, end, x);
+            ParseFloat(q, end, y);
+            ParseFloat(q, end, z);
+            // optional per vertex colour, a lone fourth value is the w component
+            float values[3];
+            int extra = 0;
+            while (extra < 3 && ParseFloat(q, end, values[extra])) ++extra;
+            if (extra == 3) {
+                r = values[0];
+                g = values[1];
+                b = values[2];
+            }
+            chunk.positions.insert(chunk.positions.end(), {x, y, z});
+            chunk.colors.insert(chunk.colors.end(), {r, g, b});
+        }
+        else if (token[0] == 'v' && token[1] == 'n' && end - token > 2 && IsSpace(token[2])) {
+            const char* q = token + 3;
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            ParseFloat(q, end, x);
+            ParseFloat(q, end, y);
+            ParseFloat(q, end, z);
+            chunk.normals.insert(chunk.normals.end(), {x, y, z});
+        }
+        else if (token[0] == 'v' && token[1] == 't' && end - token > 2 && IsSpace(token[2])) {
+            const char* q = token + 3;
+            float u = 0.0f, v = 0.0f;
+            ParseFloat(q, end, u);
+            ParseFloat(q, end, v);
+            chunk.texCoords.insert(chunk.texCoords.end(), {u, v});
+        }
+        else if (token[0] == 'f' && IsSpace(token[1])) {
+            ParseFace(token + 2, end, chunk);
+        }
+        else if (Keyword(token, end, "usemtl")) {
+            std::string name = Trim(token + 6, end);
+            auto it = std::find(chunk.materialNames.begin(), chunk.materialNames.end(), name);
+            chunk.currentMaterial = static_cast<int>(it - chunk.materialNames.begin());
+            if (it == chunk.materialNames.end()) chunk.materialNames.push_back(name);
+        }
+        else if (Keyword(token, end, "mtllib")) {
+            chunk.materialLibraries.push_back(Trim(token + 6, end));
+        }
+    }
+}
+
+float SquaredDistance(const std::vector<float>& positions, int a, int b) {
+    if (a < 0 || b < 0 || size_t(3 * a + 2) >= positions.size() || size_t(3 * b + 2) >= positions.size()) return 0.0f;
+    float dx = positions[3 * b + 0] - positions[3 * a + 0];
+    float dy = positions[3 * b + 1] - positions[3 * a + 1];
+    float dz = positions[3 * b + 2] - positions[3 * a + 2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// resolves chunk relative indices and writes the triangulated corners at the chunk's output offset
+void TriangulateChunk(const ObjChunk& chunk, const std::vector<float>& positions,
+    const std::vector<int>& materialRemap, int inheritedMaterial, ObjIndex* out, int* outMaterials) {
+    std::vector<ObjIndex> face;
+    size_t corner = 0;
+    for (size_t f = 0; f < chunk.faceSizes.size(); ++f) {
+        const uint32_t faceSize = chunk.faceSizes[f];
+        const int localMaterial = chunk.faceMaterials[f];
+        const int material = localMaterial < 0 ? inheritedMaterial : materialRemap[localMaterial];
+        std::fill(outMaterials, outMaterials + faceSize - 2, material);
+        outMaterials += faceSize - 2;
+        face.assign(chunk.corners.begin() + corner, chunk.corners.begin() + corner + faceSize);
+        for (uint32_t i = 0; i < faceSize; ++i) {
+            const uint8_t relative = chunk.relative[corner + i];
+            face[i].position += static_cast<int>(relative & RELATIVE_POSITION ? chunk.firstPosition : 0);
+            face[i].texCoord += static_cast<int>(relative & RELATIVE_TEXCOORD ? chunk.firstTexCoord : 0);
+            face[i].normal += static_cast<int>(relative & RELATIVE_NORMAL ? chunk.firstNormal : 0);
+        }
+        corner += faceSize;
+        if (faceSize == 4) {
+            if (SquaredDistance(positions, face[0].position, face[2].position) <
+                SquaredDistance(positions, face[1].position, face[3].position)) {
+                *out++ = face[0]; *out++ = face[1]; *out++ = face[2];
+                *out++ = face[0]; *out++ = face[2]; *out++ = face[3];
+            }
+            else {
+                *out++ = face[0]; *out++ = face[1]; *out++ = face[3];
+                *out++ = face[1]; *out++ = face[2]; *out++ = face[3];
+            }
+            continue;
+        }
+        for (uint32_t i = 1; i + 1 < faceSize; ++i) {
+            *out++ = face[0]; *out++ = face[i]; *out++ = face[i + 1];
+        }
+    }
+}
+}
+
+bool ObjParser::Parse(const fs::path& path, ObjData& obj) {
+    VfsFile file;
+    if (!Vfs::Open(path, file)) {
+        std::cerr << "Could not open " << path.string() << std::endl;
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool ok = Parse(reinterpret_cast<const char*>(file.Data()), file.Size(), obj);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = file.Size() / (1024.0 * 1024.0);
+    std::cout << path.filename().string() << ": parsed " << megabytes << " MB in " << seconds * 1000.0
+        << " ms (" << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s)" << std::endl;
+    return ok;
+}
+
+bool ObjParser::Parse(const char* text, size_t size, ObjData& obj) {
+    obj = ObjData();
+    JobSystem& jobs = JobSystem::Get();
+    // split into line aligned chunks, a few per thread to even out the load
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(jobs.ThreadCount() * 4, size / MIN_CHUNK_SIZE));
+    std::vector<ObjChunk> chunks;
+    const char* end = text + size;
+    const char* begin = text;
+    for (size_t i = 0; i < chunkCount && begin < end; ++i) {
+        const char* chunkEnd = i + 1 == chunkCount ? end : std::max(begin, text + size * (i + 1) / chunkCount);
+        if (chunkEnd < end) {
+            const char* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', end - chunkEnd));
+            chunkEnd = newline == nullptr ? end : newline + 1;
+        }
+        ObjChunk chunk;
+        chunk.begin = begin;
+        chunk.end = chunkEnd;
+        chunks.push_back(std::move(chunk));
+        begin = chunkEnd;
+    }
+    jobs.ParallelFor(chunks.size(), [&chunks](size_t i) { ParseChunk(chunks[i]); });
+
+    size_t positionCount = 0, normalCount = 0, texCoordCount = 0, triangleCount = 0;
+    for (auto& chunk : chunks) {
+        chunk.firstPosition = positionCount;
+        chunk.firstNormal = normalCount;
+        chunk.firstTexCoord = texCoordCount;
+        chunk.firstTriangle = triangleCount;
+        positionCount += chunk.positions.size() / 3;
+        normalCount += chunk.normals.size() / 3;
+        texCoordCount += chunk.texCoords.size() / 2;
+        triangleCount += chunk.triangleCount;
+    }
+    obj.positions.resize(positionCount * 3);
+    obj.colors.resize(positionCount * 3);
+    obj.normals.resize(normalCount * 3);
+    obj.texCoords.resize(texCoordCount * 2);
+    obj.corners.resize(triangleCount * 3);
+    jobs.ParallelFor(chunks.size(), [&chunks, &obj](size_t i) {
+        const ObjChunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin() + chunk.firstPosition * 3);
+        std::copy(chunk.colors.begin(), chunk.colors.end(), obj.colors.begin() + chunk.firstPosition * 3);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + chunk.firstNormal * 3);
+        std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), obj.texCoords.begin() + chunk.firstTexCoord * 2);
+    });
+    // material names are merged in file order, each chunk inherits the material active where the previous one ended
+    std::vector<std::vector<int>> materialRemaps(chunks.size());
+    std::vector<int> inheritedMaterials(chunks.size());
+    int activeMaterial = -1;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        inheritedMaterials[i] = activeMaterial;
+        for (const auto& name : chunks[i].materialNames) {
+            auto it = std::find(obj.materialNames.begin(), obj.materialNames.end(), name);
+            materialRemaps[i].push_back(static_cast<int>(it - obj.materialNames.begin()));
+            if (it == obj.materialNames.end()) obj.materialNames.push_back(name);
+        }
+        if (chunks[i].currentMaterial >= 0) activeMaterial = materialRemaps[i][chunks[i].currentMaterial];
+        obj.materialLibraries.insert(obj.materialLibraries.end(), chunks[i].materialLibraries.begin(), chunks[i].materialLibraries.end());
+    }
+    obj.triangleMaterials.resize(triangleCount);
+    // quads need the merged positions to pick their diagonal
+    jobs.ParallelFor(chunks.size(), [&](size_t i) {
+        TriangulateChunk(chunks[i], obj.positions, materialRemaps[i], inheritedMaterials[i],
+            obj.corners.data() + chunks[i].firstTriangle * 3, obj.triangleMaterials.data() + chunks[i].firstTriangle);
+    });
+    return !obj.positions.empty();
+}
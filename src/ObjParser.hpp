@@ -0,0 +1,32 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// zero based, -1 when the face corner does not reference that attribute
+struct ObjIndex {
+    int position;
+    int texCoord;
+    int normal;
+};
+
+struct ObjData {
+    std::vector<float> positions;
+    std::vector<float> colors;
+    std::vector<float> normals;
+    std::vector<float> texCoords;
+    std::vector<ObjIndex> corners; // three per triangle
+    std::vector<std::string> materialLibraries;
+    std::vector<std::string> materialNames;
+    std::vector<int> triangleMaterials; // index into materialNames, -1 before the first usemtl
+};
+
+// Parses a memory mapped OBJ file in line aligned chunks on the job system.
+// Quads are split along the shorter diagonal like tinyobj does, larger polygons are fanned.
+class ObjParser {
+public:
+    static bool Parse(const fs::path& path, ObjData& obj);
+    static bool Parse(const char* text, size_t size, ObjData& obj);
+};
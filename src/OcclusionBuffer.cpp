@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "OcclusionBuffer.hpp"
+#include "JobSystem.hpp"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#endif
+
+static_assert(OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT == 32, "a tile's coverage mask is one uint32_t");
+constexpr uint32_t FULL_MASK = ~0u;
+// tile rows rasterized by one job, every job walks all triangles and keeps the ones in its band
+constexpr uint32_t BAND_TILE_ROWS = 4;
+// boxes tested by one job
+constexpr size_t CULL_CHUNK_BOUNDS = 256;
+// pixels every edge is pushed out by, so rounding never leaves a pixel centre on an edge two
+// triangles share uncovered by both
+constexpr float EDGE_TOLERANCE = 1.0f / 1024.0f;
+// twice the screen area in pixels below which a triangle covers nothing worth the setup
+constexpr float MIN_TRIANGLE_AREA = 1e-4f;
+
+namespace {
+// tile of a pixel coordinate, clamped to the screen before the conversion since boxes and
+// triangles near the camera project far past the range of any integer
+uint32_t TileOf(float pixel, uint32_t pixels, uint32_t tileSize) {
+    return uint32_t(std::min(std::max(pixel, 0.0f), float(pixels - 1))) / tileSize;
+}
+
+// bit y * OCCLUSION_TILE_WIDTH + x is set when pixel (x, y) of the tile at x0, y0 has its centre inside every edge
+uint32_t CoverageMask(const float* edgeA, const float* edgeB, const float* edgeC, float x0, float y0) {
+    uint32_t mask = 0;
+#if defined(OCCLUSION_SSE2)
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    for (uint32_t row = 0; row < OCCLUSION_TILE_HEIGHT; ++row) {
+        const float y = y0 + float(row) + 0.5f;
+        for (uint32_t column = 0; column < OCCLUSION_TILE_WIDTH; column += 4) {
+            const __m128 x = _mm_add_ps(_mm_set1_ps(x0 + float(column)), laneOffsets);
+            __m128 inside = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), x), _mm_set1_ps(edgeB[0] * y + edgeC[0])), zero);
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[1]), x), _mm_set1_ps(edgeB[1] * y + edgeC[1])), zero));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[2]), x), _mm_set1_ps(edgeB[2] * y + edgeC[2])), zero));
+            mask |= uint32_t(_mm_movemask_ps(inside)) << (row * OCCLUSION_TILE_WIDTH + column);
+        }
+    }
+#else
+    for (uint32_t row = 0; row < OCCLUSION_TILE_HEIGHT; ++row) {
+        const float y = y0 + float(row) + 0.5f;
+        for (uint32_t column = 0; column < OCCLUSION_TILE_WIDTH; ++column) {
+            const float x = x0 + float(column) + 0.5f;
+            bool inside = true;
+            for (int edge = 0; edge < 3; ++edge) inside = inside && edgeA[edge] * x + edgeB[edge] * y + edgeC[edge] > 0.0f;
+            if (inside) mask |= 1u << (row * OCCLUSION_TILE_WIDTH + column);
+        }
+    }
+#endif
+    return mask;
+}
+}
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+    : width(width), height(height), tilesX(width / OCCLUSION_TILE_WIDTH), tilesY(height / OCCLUSION_TILE_HEIGHT) {
+    assert(width % OCCLUSION_TILE_WIDTH == 0 && height % OCCLUSION_TILE_HEIGHT == 0);
+    tiles.resize(size_t(tilesX) * tilesY);
+}
+
+uint32_t OcclusionBuffer::Width() const {
+    return width;
+}
+
+uint32_t OcclusionBuffer::Height() const {
+    return height;
+}
+
+void OcclusionBuffer::Clear(const glm::mat4x4& viewProjection) {
+    this->viewProjection = viewProjection;
+    std::fill(tiles.begin(), tiles.end(), Tile());
+}
+
+void OcclusionBuffer::SetupTriangles(const Occluder& occluder, std::vector<Triangle>& triangles) const {
+    const glm::mat4x4 modelViewProjection = viewProjection * occluder.model;
+    const std::vector<glm::vec3>& positions = *occluder.positions;
+    const std::vector<uint32_t>& indices = *occluder.indices;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        glm::vec2 screen[3];
+        float depth[3];
+        bool clipped = false;
+        for (int corner = 0; corner < 3; ++corner) {
+            const glm::vec4 clip = modelViewProjection * glm::vec4(positions[indices[i + corner]], 1.0f);
+            // skipping an occluder is always safe, so nothing gets clipped
+            if (clip.w <= 0.0f || clip.z < 0.0f) {
+                clipped = true;
+                break;
+            }
+            screen[corner] = glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * width, (0.5f - clip.y / clip.w * 0.5f) * height);
+            depth[corner] = clip.z / clip.w;
+        }
+        if (clipped) continue;
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+        // both faces occlude, back facing ones are turned around
+        if (area < 0.0f) {
+            std::swap(screen[1], screen[2]);
+            std::swap(depth[1], depth[2]);
+            area = -area;
+        }
+        if (!(area > MIN_TRIANGLE_AREA)) continue;
+        const glm::vec2 low = glm::min(screen[0], glm::min(screen[1], screen[2]));
+        const glm::vec2 high = glm::max(screen[0], glm::max(screen[1], screen[2]));
+        if (high.x <= 0.0f || high.y <= 0.0f || low.x >= float(width) || low.y >= float(height)) continue;
+
+        Triangle triangle;
+        for (int edge = 0; edge < 3; ++edge) {
+            const glm::vec2& a = screen[edge];
+            const glm::vec2& b = screen[(edge + 1) % 3];
+            triangle.edgeA[edge] = a.y - b.y;
+            triangle.edgeB[edge] = b.x - a.x;
+            triangle.edgeC[edge] = -(triangle.edgeA[edge] * a.x + triangle.edgeB[edge] * a.y)
+                + EDGE_TOLERANCE * (std::abs(triangle.edgeA[edge]) + std::abs(triangle.edgeB[edge]));
+        }
+        const float depthX = ((depth[1] - depth[0]) * (screen[2].y - screen[0].y) - (depth[2] - depth[0]) * (screen[1].y - screen[0].y)) / area;
+        const float depthY = ((depth[2] - depth[0]) * (screen[1].x - screen[0].x) - (depth[1] - depth[0]) * (screen[2].x - screen[0].x)) / area;
+        triangle.depthPlane = glm::vec3(depthX, depthY, depth[0] - depthX * screen[0].x - depthY * screen[0].y);
+        triangle.maxDepth = std::max(depth[0], std::max(depth[1], depth[2]));
+        triangle.tileMinX = TileOf(low.x, width, OCCLUSION_TILE_WIDTH);
+        triangle.tileMinY = TileOf(low.y, height, OCCLUSION_TILE_HEIGHT);
+        triangle.tileMaxX = TileOf(high.x, width, OCCLUSION_TILE_WIDTH);
+        triangle.tileMaxY = TileOf(high.y, height, OCCLUSION_TILE_HEIGHT);
+        triangles.push_back(triangle);
+    }
+}
+
+void OcclusionBuffer::RasterizeTile(const Triangle& triangle, uint32_t tileX, uint32_t tileY) {
+    Tile& tile = tiles[size_t(tileY) * tilesX + tileX];
+    const float x0 = float(tileX * OCCLUSION_TILE_WIDTH);
+    const float y0 = float(tileY * OCCLUSION_TILE_HEIGHT);
+    // the farthest the triangle gets inside the tile, at the corner its depth plane rises towards
+    const float cornerX = triangle.depthPlane.x > 0.0f ? x0 + OCCLUSION_TILE_WIDTH : x0;
+    const float cornerY = triangle.depthPlane.y > 0.0f ? y0 + OCCLUSION_TILE_HEIGHT : y0;
+    const float depth = std::min(triangle.maxDepth,
+        triangle.depthPlane.x * cornerX + triangle.depthPlane.y * cornerY + triangle.depthPlane.z);
+    if (depth >= tile.depth) return;
+    const uint32_t coverage = CoverageMask(triangle.edgeA, triangle.edgeB, triangle.edgeC, x0, y0);
+    if (coverage == 0) return;
+    // a triangle much nearer than the working layer starts a new one, dropping pixels only loses occlusion
+    if (tile.mask != 0 && tile.workingDepth - depth > tile.depth - tile.workingDepth) {
+        tile.mask = 0;
+        tile.workingDepth = 0.0f;
+    }
+    tile.mask |= coverage;
+    tile.workingDepth = std::max(tile.workingDepth, depth);
+    if (tile.mask == FULL_MASK) {
+        tile.depth = tile.workingDepth;
+        tile.mask = 0;
+        tile.workingDepth = 0.0f;
+    }
+}
+
+void OcclusionBuffer::Rasterize(const std::vector<Occluder>& occluders) {
+    if (occluders.empty()) return;
+    if (occluderTriangles.size() < occluders.size()) occluderTriangles.resize(occluders.size());
+    JobSystem::Get().ParallelFor(occluders.size(), [&](size_t i) {
+        occluderTriangles[i].clear();
+        SetupTriangles(occluders[i], occluderTriangles[i]);
+    });
+    // bands own their tiles, so no two jobs ever touch the same one
+    const uint32_t bandCount = (tilesY + BAND_TILE_ROWS - 1) / BAND_TILE_ROWS;
+    JobSystem::Get().ParallelFor(bandCount, [&](size_t band) {
+        const uint32_t firstRow = uint32_t(band) * BAND_TILE_ROWS;
+        const uint32_t lastRow = std::min(firstRow + BAND_TILE_ROWS, tilesY) - 1;
+        for (size_t i = 0; i < occluders.size(); ++i) {
+            for (const Triangle& triangle : occluderTriangles[i]) {
+                if (triangle.tileMaxY < firstRow || triangle.tileMinY > lastRow) continue;
+                const uint32_t rowEnd = std::min(triangle.tileMaxY, lastRow);
+                for (uint32_t tileY = std::max(triangle.tileMinY, firstRow); tileY <= rowEnd; ++tileY) {
+                    for (uint32_t tileX = triangle.tileMinX; tileX <= triangle.tileMaxX; ++tileX) {
+                        RasterizeTile(triangle, tileX, tileY);
+                    }
+                }
+            }
+        }
+    });
+}
+
+bool OcclusionBuffer::IsVisible(const Bounds& bounds) const {
+    glm::vec2 low(std::numeric_limits<float>::max());
+    glm::vec2 high(std::numeric_limits<float>::lowest());
+    float nearest = 1.0f;
+    for (int corner = 0; corner < 8; ++corner) {
+        const glm::vec3 position((corner & 1) ? bounds.max.x : bounds.min.x, (corner & 2) ? bounds.max.y : bounds.min.y,
+            (corner & 4) ? bounds.max.z : bounds.min.z);
+        const glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+        // a box reaching past the near plane covers the camera, nothing can hide it
+        if (clip.w <= 0.0f || clip.z < 0.0f) return true;
+        const glm::vec2 screen((clip.x / clip.w * 0.5f + 0.5f) * width, (0.5f - clip.y / clip.w * 0.5f) * height);
+        low = glm::min(low, screen);
+        high = glm::max(high, screen);
+        nearest = std::min(nearest, clip.z / clip.w);
+    }
+    // off screen is the frustum's business
+    if (high.x <= 0.0f || high.y <= 0.0f || low.x >= float(width) || low.y >= float(height)) return true;
+    const uint32_t tileMinX = TileOf(low.x, width, OCCLUSION_TILE_WIDTH);
+    const uint32_t tileMinY = TileOf(low.y, height, OCCLUSION_TILE_HEIGHT);
+    const uint32_t tileMaxX = TileOf(high.x, width, OCCLUSION_TILE_WIDTH);
+    const uint32_t tileMaxY = TileOf(high.y, height, OCCLUSION_TILE_HEIGHT);
+    for (uint32_t tileY = tileMinY; tileY <= tileMaxY; ++tileY) {
+        for (uint32_t tileX = tileMinX; tileX <= tileMaxX; ++tileX) {
+            if (nearest < tiles[size_t(tileY) * tilesX + tileX].depth) return true;
+        }
+    }
+    return false;
+}
+
+uint32_t OcclusionBuffer::Cull(const std::vector<Bounds>& bounds, std::vector<uint8_t>& visible) const {
+    visible.resize(bounds.size());
+    const size_t chunkCount = (bounds.size() + CULL_CHUNK_BOUNDS - 1) / CULL_CHUNK_BOUNDS;
+    auto cullChunk = [&](size_t chunk) {
+        const size_t end = std::min(bounds.size(), (chunk + 1) * CULL_CHUNK_BOUNDS);
+        for (size_t i = chunk * CULL_CHUNK_BOUNDS; i < end; ++i) visible[i] = IsVisible(bounds[i]) ? 1 : 0;
+    };
+    if (chunkCount > 1) JobSystem::Get().ParallelFor(chunkCount, cullChunk);
+    else if (chunkCount == 1) cullChunk(0);
+    return uint32_t(std::count(visible.begin(), visible.end(), uint8_t(1)));
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ResourceManager.hpp"
+
+// pixels of one tile of the OcclusionBuffer, one bit each in its coverage mask
+constexpr uint32_t OCCLUSION_TILE_WIDTH = 8;
+constexpr uint32_t OCCLUSION_TILE_HEIGHT = 4;
+
+// triangles of one occluder in object space and the matrix placing them in the world
+struct Occluder {
+    const std::vector<glm::vec3>* positions = nullptr;
+    const std::vector<uint32_t>* indices = nullptr;
+    glm::mat4x4 model = glm::mat4x4(1.0f);
+};
+
+// Low resolution software depth buffer for deciding visibility on the CPU. Occluder triangles
+// are rasterized into tiles of 8x4 pixels with SIMD edge functions, bands of tile rows spread
+// over the JobSystem. A tile keeps no per pixel depth, just a reference depth everything in it
+// lies in front of, and a coverage mask of the pixels a nearer working layer has filled so far.
+// Once the mask is full the working layer becomes the new reference. Boxes test their nearest
+// depth against the reference of the tiles they touch, a handful of compares per object.
+class OcclusionBuffer {
+public:
+    // width a multiple of OCCLUSION_TILE_WIDTH, height of OCCLUSION_TILE_HEIGHT
+    OcclusionBuffer(uint32_t width, uint32_t height);
+    // empties the buffer for a frame seen through viewProjection, with 0 to w clip depth
+    void Clear(const glm::mat4x4& viewProjection);
+    // nearest occluders first leave the tightest depth, triangles crossing the near plane are skipped
+    void Rasterize(const std::vector<Occluder>& occluders);
+    // false only when everything the box covers on screen lies behind occluders
+    bool IsVisible(const Bounds& bounds) const;
+    // visible[i] tells whether bounds[i] is, returns how many are
+    uint32_t Cull(const std::vector<Bounds>& bounds, std::vector<uint8_t>& visible) const;
+    uint32_t Width() const;
+    uint32_t Height() const;
+
+private:
+    struct Tile {
+        uint32_t mask = 0;          // pixels of the working layer
+        float workingDepth = 0.0f;  // farthest depth of the working layer
+        float depth = 1.0f;         // reference depth covering the whole tile
+    };
+    // screen space triangle, edge functions are a * x + b * y + c and positive inside
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        glm::vec3 depthPlane;  // depth is x * depthPlane.x + y * depthPlane.y + depthPlane.z
+        float maxDepth;
+        uint32_t tileMinX, tileMinY, tileMaxX, tileMaxY;
+    };
+
+    uint32_t width, height, tilesX, tilesY;
+    glm::mat4x4 viewProjection = glm::mat4x4(1.0f);
+    std::vector<Tile> tiles;
+    // the set up triangles of each occluder, kept between frames for their capacity
+    std::vector<std::vector<Triangle>> occluderTriangles;
+
+    void SetupTriangles(const Occluder& occluder, std::vector<Triangle>& triangles) const;
+    void RasterizeTile(const Triangle& triangle, uint32_t tileX, uint32_t tileY);
+};
@@ -1,8 +1,14 @@
 #include "MainWindow.hpp"
 #include "Renderer.hpp"
+#include "Vfs.hpp"
 #include <iostream>
 
+// built with App --pack, its entries shadow the loose files under assets/ and src/
+const fs::path ASSET_PACK_PATH = "assets.pak";
+
 void Renderer::Run() {
+    std::error_code error;
+    if (fs::exists(ASSET_PACK_PATH, error)) Vfs::Mount(ASSET_PACK_PATH);
     MainWindow window = MainWindow(&gpu);
     window.Initialize();
     gpu.SetWindow(&window);
@@ -1,23 +1,306 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
-#include <fstream>
+#include <algorithm>
+#include <iostream>
 #include <sstream>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <map>
+#include <cstddef>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include "ResourceManager.hpp"
+#include "ObjParser.hpp"
+#include "Gltf.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "Vfs.hpp"
 
 using namespace wgpu;
 
+std::unordered_map<std::string, std::weak_ptr<GpuTexture>> ResourceManager::textures;
+std::mutex ResourceManager::texturesMutex;
+
+namespace {
+// VertexAttributes is 11 tightly packed floats, so welding can compare and hash raw bytes
+struct VertexHash {
+    size_t operator()(const VertexAttributes& v) const {
+        return static_cast<size_t>(ResourceManager::hashBytes(&v, sizeof(VertexAttributes)));
+    }
+};
+
+struct VertexEqual {
+    bool operator()(const VertexAttributes& a, const VertexAttributes& b) const {
+        return std::memcmp(&a, &b, sizeof(VertexAttributes)) == 0;
+    }
+};
+
+// vertex streams of a glTF primitive, attributes it doesn't have are empty accessors
+struct GltfStreams {
+    GltfAccessor position, normal, color, texCoords;
+};
+
+bool ReadGltfAttribute(const GltfFile& file, const JsonValue& attributes, const char* name, GltfAccessor& accessor) {
+    accessor = GltfAccessor();
+    return !attributes.Has(name) || file.Accessor(attributes[name].AsInt(), accessor);
+}
+
+bool ReadGltfStreams(const GltfFile& file, const JsonValue& primitive, GltfStreams& streams) {
+    const JsonValue& attributes = primitive["attributes"];
+    return ReadGltfAttribute(file, attributes, "POSITION", streams.position)
+        && streams.position.count > 0 && streams.position.components == 3
+        && ReadGltfAttribute(file, attributes, "NORMAL", streams.normal)
+        && ReadGltfAttribute(file, attributes, "COLOR_0", streams.color)
+        && ReadGltfAttribute(file, attributes, "TEXCOORD_0", streams.texCoords);
+}
+
+bool SameGltfStreams(const JsonValue& a, const JsonValue& b) {
+    for (const char* name : {"POSITION", "NORMAL", "COLOR_0", "TEXCOORD_0"}) {
+        if (a["attributes"][name].AsInt() != b["attributes"][name].AsInt()) return false;
+    }
+    return true;
+}
+
+// float streams interleaved at the offsets of VertexAttributes are already the runtime layout
+bool MatchesVertexLayout(const GltfStreams& streams) {
+    const uint8_t* base = streams.position.data;
+    auto matches = [&](const GltfAccessor& accessor, size_t offset, uint32_t components) {
+        return accessor.data == base + offset && accessor.componentType == GLTF_COMPONENT_FLOAT && !accessor.normalized
+            && accessor.components == components && accessor.count == streams.position.count
+            && accessor.stride == sizeof(VertexAttributes);
+    };
+    return base != nullptr && reinterpret_cast<uintptr_t>(base) % alignof(VertexAttributes) == 0
+        && matches(streams.position, offsetof(VertexAttributes, position), 3)
+        && matches(streams.normal, offsetof(VertexAttributes, normal), 3)
+        && matches(streams.color, offsetof(VertexAttributes, color), 3)
+        && matches(streams.texCoords, offsetof(VertexAttributes, texCoords), 2);
+}
+
+void AppendGltfVertices(const GltfStreams& streams, std::vector<VertexAttributes>& vertices) {
+    const bool colored = streams.color.count > 0;
+    for (size_t i = 0; i < streams.position.count; ++i) {
+        VertexAttributes vertex;
+        vertex.position = {streams.position.Read(i, 0), streams.position.Read(i, 1), streams.position.Read(i, 2)};
+        vertex.normal = {streams.normal.Read(i, 0), streams.normal.Read(i, 1), streams.normal.Read(i, 2)};
+        vertex.color = {colored ? streams.color.Read(i, 0) : 1.0f, colored ? streams.color.Read(i, 1) : 1.0f,
+            colored ? streams.color.Read(i, 2) : 1.0f};
+        // glTF uvs already start at the top left like the OBJ ones after their flip
+        vertex.texCoords = {streams.texCoords.Read(i, 0), streams.texCoords.Read(i, 1)};
+        vertices.push_back(vertex);
+    }
+}
+
+// index accessor that can go to the index buffer as it is: tight 16 or 32-bit triangles in range
+bool IndicesUploadable(const GltfAccessor& indices, size_t vertexCount) {
+    const size_t size = indices.componentType == GLTF_COMPONENT_UNSIGNED_SHORT ? sizeof(uint16_t)
+        : indices.componentType == GLTF_COMPONENT_UNSIGNED_INT ? sizeof(uint32_t) : 0;
+    if (size == 0 || indices.data == nullptr || indices.stride != size || indices.count % 3 != 0
+        || reinterpret_cast<uintptr_t>(indices.data) % size != 0
+        || ((indices.count * size + 3) & ~size_t(3)) > indices.available) return false;
+    for (size_t i = 0; i < indices.count; ++i) {
+        if (indices.ReadIndex(i) >= vertexCount) return false;
+    }
+    return true;
+}
+
+// triangle list of a primitive with strips and fans unrolled, triangles reaching past
+// vertexCount are dropped; false for points and lines
+bool ReadGltfTriangles(const GltfFile& file, const JsonValue& primitive, size_t vertexCount, std::vector<uint32_t>& triangles) {
+    GltfAccessor indices;
+    const bool indexed = primitive.Has("indices");
+    if (indexed && !file.Accessor(primitive["indices"].AsInt(), indices)) return false;
+    const size_t count = indexed ? indices.count : vertexCount;
+    auto corner = [&](size_t i) { return indexed ? indices.ReadIndex(i) : uint32_t(i); };
+    auto add = [&](uint32_t a, uint32_t b, uint32_t c) {
+        if (a < vertexCount && b < vertexCount && c < vertexCount) triangles.insert(triangles.end(), {a, b, c});
+    };
+    triangles.clear();
+    switch (primitive["mode"].AsInt(GLTF_MODE_TRIANGLES)) {
+    case GLTF_MODE_TRIANGLES:
+        for (size_t i = 0; i + 2 < count; i += 3) add(corner(i), corner(i + 1), corner(i + 2));
+        return true;
+    case GLTF_MODE_TRIANGLE_STRIP:
+        // every other triangle of a strip is wound the other way
+        for (size_t i = 0; i + 2 < count; ++i) {
+            if (i % 2 == 0) add(corner(i), corner(i + 1), corner(i + 2));
+            else add(corner(i + 1), corner(i), corner(i + 2));
+        }
+        return true;
+    case GLTF_MODE_TRIANGLE_FAN:
+        for (size_t i = 1; i + 1 < count; ++i) add(corner(0), corner(i), corner(i + 1));
+        return true;
+    default:
+        return false;
+    }
+}
+
+// the spec asks for flat normals when a primitive has none, area weighted smooth ones
+// are close enough for the welded meshes exporters write and keep the vertex count
+void GenerateNormals(std::vector<VertexAttributes>& vertices, const std::vector<uint32_t>& indices, const std::vector<bool>& missing) {
+    std::vector<glm::vec3> sums(vertices.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (!missing[a] && !missing[b] && !missing[c]) continue;
+        auto position = [&](uint32_t v) { return glm::vec3(vertices[v].position[0], vertices[v].position[1], vertices[v].position[2]); };
+        const glm::vec3 normal = glm::cross(position(b) - position(a), position(c) - position(a));
+        sums[a] += normal;
+        sums[b] += normal;
+        sums[c] += normal;
+    }
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        if (!missing[v]) continue;
+        const float length = glm::length(sums[v]);
+        const glm::vec3 normal = length > 0.0f ? sums[v] / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        vertices[v].normal = {normal.x, normal.y, normal.z};
+    }
+}
+
+uint32_t GltfMaterialSlot(const JsonValue& primitive, std::vector<GltfMaterial>& materials, int& defaultMaterial, GltfMesh& mesh) {
+    int material = primitive["material"].AsInt();
+    if (material < 0 || size_t(material) >= materials.size()) {
+        if (defaultMaterial < 0) {
+            defaultMaterial = int(materials.size());
+            materials.emplace_back();
+            materials.back().data.name = "default";
+        }
+        material = defaultMaterial;
+    }
+    auto it = std::find(mesh.materials.begin(), mesh.materials.end(), uint32_t(material));
+    if (it != mesh.materials.end()) return uint32_t(it - mesh.materials.begin());
+    mesh.materials.push_back(uint32_t(material));
+    return uint32_t(mesh.materials.size() - 1);
+}
+
+// primitives become submeshes of one vertex and index buffer. Streams and indices that already
+// have the runtime layout are referenced in the file, the rest is converted. inPlaceBytes
+// counts what is uploaded straight from the file.
+void BuildGltfMesh(const GltfFile& file, const JsonValue& description, std::vector<GltfMaterial>& materials,
+    int& defaultMaterial, GltfMesh& mesh, size_t& inPlaceBytes) {
+    mesh.name = description["name"].AsString();
+    const JsonValue& primitives = description["primitives"];
+    // exporters often split a mesh by material over one set of streams, then it stays one vertex range
+    bool shared = primitives.Size() > 0;
+    for (size_t p = 1; p < primitives.Size() && shared; ++p) shared = SameGltfStreams(primitives[0], primitives[p]);
+    GltfStreams sharedStreams;
+    bool verticesInPlace = false;
+    std::vector<bool> missingNormals;
+    if (shared) {
+        if (!ReadGltfStreams(file, primitives[0], sharedStreams)) {
+            std::cerr << "Skipping glTF mesh " << mesh.name << " without positions" << std::endl;
+            return;
+        }
+        verticesInPlace = MatchesVertexLayout(sharedStreams);
+        if (verticesInPlace) {
+            mesh.vertices = reinterpret_cast<const VertexAttributes*>(sharedStreams.position.data);
+            mesh.vertexCount = uint32_t(sharedStreams.position.count);
+            inPlaceBytes += mesh.vertexCount * sizeof(VertexAttributes);
+        }
+        else {
+            AppendGltfVertices(sharedStreams, mesh.convertedVertices);
+            missingNormals.assign(mesh.convertedVertices.size(), sharedStreams.normal.count == 0);
+        }
+    }
+
+    std::vector<uint32_t> indices, triangles;
+    for (size_t p = 0; p < primitives.Size(); ++p) {
+        const JsonValue& primitive = primitives[p];
+        GltfStreams streams = sharedStreams;
+        uint32_t baseVertex = 0;
+        if (!shared) {
+            if (!ReadGltfStreams(file, primitive, streams)) {
+                std::cerr << "Skipping a primitive of glTF mesh " << mesh.name << " without positions" << std::endl;
+                continue;
+            }
+            baseVertex = uint32_t(mesh.convertedVertices.size());
+            AppendGltfVertices(streams, mesh.convertedVertices);
+            missingNormals.resize(mesh.convertedVertices.size(), streams.normal.count == 0);
+        }
+        const uint32_t material = GltfMaterialSlot(primitive, materials, defaultMaterial, mesh);
+        const size_t vertexCount = streams.position.count;
+
+        GltfAccessor accessor;
+        if (primitives.Size() == 1 && primitive["mode"].AsInt(GLTF_MODE_TRIANGLES) == GLTF_MODE_TRIANGLES
+            && streams.normal.count > 0 && primitive.Has("indices") && file.Accessor(primitive["indices"].AsInt(), accessor)
+            && IndicesUploadable(accessor, vertexCount)) {
+            // reads past an odd count of 16-bit indices into the buffer padding, that index is never drawn
+            mesh.indices = accessor.data;
+            mesh.indexCount = uint32_t(accessor.count);
+            mesh.indexSize = (accessor.count * accessor.elementSize + 3) & ~size_t(3);
+            mesh.indexFormat = accessor.componentType == GLTF_COMPONENT_UNSIGNED_SHORT ? IndexFormat::Uint16 : IndexFormat::Uint32;
+            mesh.submeshes.push_back({0, mesh.indexCount, material});
+            inPlaceBytes += mesh.indexSize;
+            continue;
+        }
+        if (!ReadGltfTriangles(file, primitive, vertexCount, triangles)) {
+            std::cerr << "Skipping a primitive of glTF mesh " << mesh.name << " that is not made of triangles" << std::endl;
+            continue;
+        }
+        if (triangles.empty()) continue;
+        mesh.submeshes.push_back({uint32_t(indices.size()), uint32_t(triangles.size()), material});
+        for (uint32_t index : triangles) indices.push_back(baseVertex + index);
+    }
+
+    if (!verticesInPlace) {
+        if (std::find(missingNormals.begin(), missingNormals.end(), true) != missingNormals.end()) {
+            GenerateNormals(mesh.convertedVertices, indices, missingNormals);
+        }
+        mesh.vertices = mesh.convertedVertices.data();
+        mesh.vertexCount = uint32_t(mesh.convertedVertices.size());
+    }
+    if (mesh.indices == nullptr) {
+        GeometryData converted;
+        converted.indices = std::move(indices);
+        converted.indexFormat = mesh.vertexCount <= std::numeric_limits<uint16_t>::max() ? IndexFormat::Uint16 : IndexFormat::Uint32;
+        mesh.convertedIndices = ResourceManager::packIndices(converted);
+        mesh.indices = mesh.convertedIndices.data();
+        mesh.indexCount = uint32_t(converted.indices.size());
+        mesh.indexSize = mesh.convertedIndices.size();
+        mesh.indexFormat = converted.indexFormat;
+    }
+
+    mesh.bounds = Bounds();
+    for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+        const glm::vec3 position(mesh.vertices[v].position[0], mesh.vertices[v].position[1], mesh.vertices[v].position[2]);
+        mesh.bounds.min = glm::min(mesh.bounds.min, position);
+        mesh.bounds.max = glm::max(mesh.bounds.max, position);
+    }
+    mesh.sphere.center = 0.5f * (mesh.bounds.min + mesh.bounds.max);
+    mesh.sphere.radius = 0.0f;
+    for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+        const glm::vec3 position(mesh.vertices[v].position[0], mesh.vertices[v].position[1], mesh.vertices[v].position[2]);
+        mesh.sphere.radius = std::max(mesh.sphere.radius, glm::length(position - mesh.sphere.center));
+    }
+}
+
+glm::mat4x4 GltfNodeMatrix(const JsonValue& node) {
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.Size() == 16) {
+        // column major like glm
+        glm::mat4x4 result;
+        for (int i = 0; i < 16; ++i) result[i / 4][i % 4] = float(matrix[i].AsNumber());
+        return result;
+    }
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    const glm::vec3 translation(t[0].AsNumber(0.0), t[1].AsNumber(0.0), t[2].AsNumber(0.0));
+    const glm::quat rotation(float(r[3].AsNumber(1.0)), float(r[0].AsNumber(0.0)), float(r[1].AsNumber(0.0)), float(r[2].AsNumber(0.0)));
+    const glm::vec3 scale(s[0].AsNumber(1.0), s[1].AsNumber(1.0), s[2].AsNumber(1.0));
+    return glm::translate(glm::mat4x4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4x4(1.0f), scale);
+}
+}
+
 ShaderModule ResourceManager::loadShaderModule(const std::filesystem::path& path, Device device) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
+    VfsFile file;
+    if (!Vfs::Open(path, file)) {
         return nullptr;
     }
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    std::string shaderSource(size, ' ');
-    file.seekg(0);
-    file.read(shaderSource.data(), size);
+    std::string shaderSource(reinterpret_cast<const char*>(file.Data()), file.Size());
 
     ShaderModuleWGSLDescriptor shaderCodeDesc{};
     shaderCodeDesc.chain.next = nullptr;
@@ -29,56 +312,366 @@ ShaderModule ResourceManager::loadShaderModule(const std::filesystem::path& path
     return device.createShaderModule(shaderDesc);
 }
 
-bool ResourceManager::loadGeometryObj(const fs::path& path, std::vector<VertexAttributes>& vertexData){
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+bool ResourceManager::loadGeometryObj(const fs::path& path, GeometryData& geometry){
+    ObjData obj;
+    if (!ObjParser::Parse(path, obj)) {
+        return false;
+    }
 
-    std::string warn;
-    std::string err;
+    // group triangles by material so every material is bound once per mesh,
+    // triangles without a usemtl go to a default material appended at the end
+    loadMaterials(path, obj.materialLibraries, obj.materialNames, geometry.materials);
+    const uint32_t defaultMaterial = static_cast<uint32_t>(geometry.materials.size());
+    const size_t triangleCount = obj.triangleMaterials.size();
+    std::vector<uint32_t> materialStart(geometry.materials.size() + 2, 0);
+    for (int material : obj.triangleMaterials) {
+        materialStart[(material < 0 ? defaultMaterial : uint32_t(material)) + 1]++;
+    }
+    for (size_t m = 1; m < materialStart.size(); ++m) {
+        materialStart[m] += materialStart[m - 1];
+    }
+    std::vector<uint32_t> triangleOrder(triangleCount);
+    std::vector<uint32_t> materialFill(materialStart.begin(), materialStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const int material = obj.triangleMaterials[t];
+        triangleOrder[materialFill[material < 0 ? defaultMaterial : uint32_t(material)]++] = static_cast<uint32_t>(t);
+    }
+    if (materialStart[defaultMaterial + 1] > materialStart[defaultMaterial]) {
+        MaterialData material;
+        material.name = "default";
+        geometry.materials.push_back(material);
+    }
+    geometry.submeshes.clear();
+    for (uint32_t m = 0; m < geometry.materials.size(); ++m) {
+        if (materialStart[m + 1] == materialStart[m]) continue;
+        geometry.submeshes.push_back({3 * materialStart[m], 3 * (materialStart[m + 1] - materialStart[m]), m});
+    }
 
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.string().c_str());
+    const size_t cornerCount = obj.corners.size();
+    geometry.vertices.clear();
+    geometry.indices.resize(cornerCount);
+    // weld identical corners so every unique vertex is stored and transformed once
+    std::unordered_map<VertexAttributes, uint32_t, VertexHash, VertexEqual> uniqueVertices;
+    uniqueVertices.reserve(cornerCount);
+    const size_t positionCount = obj.positions.size() / 3;
+    const size_t normalCount = obj.normals.size() / 3;
+    const size_t texCoordCount = obj.texCoords.size() / 2;
+    for (size_t i = 0; i < cornerCount; ++i) {
+        const ObjIndex& idx = obj.corners[3 * triangleOrder[i / 3] + i % 3];
+        VertexAttributes vertex = {};
 
-    if (!warn.empty()) {
-        std::cout << warn << std::endl;
-    }
+        if (idx.position >= 0 && size_t(idx.position) < positionCount) {
+            vertex.position = {
+                obj.positions[3 * idx.position + 0],
+                obj.positions[3 * idx.position + 1],
+                obj.positions[3 * idx.position + 2]
+            };
+            vertex.color = {
+                obj.colors[3 * idx.position + 0],
+                obj.colors[3 * idx.position + 1],
+                obj.colors[3 * idx.position + 2]
+            };
+        }
+
+        if (idx.normal >= 0 && size_t(idx.normal) < normalCount) {
+            vertex.normal = {
+                obj.normals[3 * idx.normal + 0],
+                obj.normals[3 * idx.normal + 1],
+                obj.normals[3 * idx.normal + 2]
+            };
+        }
 
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
+        float u = 0.0f, v = 0.0f;
+        if (idx.texCoord >= 0 && size_t(idx.texCoord) < texCoordCount) {
+            u = obj.texCoords[2 * idx.texCoord + 0];
+            v = obj.texCoords[2 * idx.texCoord + 1];
+        }
+        vertex.texCoords = { u, 1-v };
+
+        auto [it, inserted] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(geometry.vertices.size()));
+        if (inserted) {
+            geometry.vertices.push_back(vertex);
+        }
+        geometry.indices[i] = it->second;
     }
+    geometry.vertices.shrink_to_fit();
 
-    if (!ret) {
-        return false;
+    geometry.bounds = Bounds();
+    for (const auto& vertex : geometry.vertices) {
+        glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        geometry.bounds.min = glm::min(geometry.bounds.min, position);
+        geometry.bounds.max = glm::max(geometry.bounds.max, position);
+    }
+    geometry.sphere.center = 0.5f * (geometry.bounds.min + geometry.bounds.max);
+    geometry.sphere.radius = 0.0f;
+    for (const auto& vertex : geometry.vertices) {
+        glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        geometry.sphere.radius = std::max(geometry.sphere.radius, glm::length(position - geometry.sphere.center));
     }
 
-    const auto& shape = shapes[0];
-    vertexData.resize(shape.mesh.indices.size());
-    for (size_t i = 0; i < shape.mesh.indices.size(); ++i) {
-        const tinyobj::index_t& idx = shape.mesh.indices[i];
+    // coarser levels go first so the optimizer reorders their ranges too
+    MeshSimplifier::BuildLods(geometry);
+    MeshOptimizer::Optimize(geometry);
+    MeshOptimizer::BuildMeshlets(geometry);
+
+    // 16-bit indices whenever every vertex is addressable by them
+    geometry.indexFormat = geometry.vertices.size() <= std::numeric_limits<uint16_t>::max()
+        ? IndexFormat::Uint16 : IndexFormat::Uint32;
+
+    const size_t indexSize = geometry.indexFormat == IndexFormat::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    const size_t unindexedBytes = cornerCount * sizeof(VertexAttributes);
+    const size_t indexedBytes = geometry.vertices.size() * sizeof(VertexAttributes) + cornerCount * indexSize;
+    std::cout << path.filename().string() << ": " << cornerCount << " corners welded to "
+        << geometry.vertices.size() << " vertices, " << unindexedBytes / 1024 << " KB -> "
+        << indexedBytes / 1024 << " KB (saved "
+        << (unindexedBytes > indexedBytes ? (unindexedBytes - indexedBytes) / 1024 : 0) << " KB), "
+        << geometry.submeshes.size() << " material ranges" << std::endl;
+
+    return true;
+}
 
-        vertexData[i].position = {
-            attrib.vertices[3 * idx.vertex_index + 0],
-            attrib.vertices[3 * idx.vertex_index + 1],
-            attrib.vertices[3 * idx.vertex_index + 2]
-        };
+void ResourceManager::loadMaterials(const fs::path& objPath, const std::vector<std::string>& libraries,
+    const std::vector<std::string>& names, std::vector<MaterialData>& materials) {
+    std::map<std::string, int> materialMap;
+    std::vector<tinyobj::material_t> mtlMaterials;
+    for (const auto& library : libraries) {
+        VfsFile file;
+        if (!Vfs::Open(objPath.parent_path() / fs::u8path(library), file)) {
+            std::cout << "Material library " << library << " not found" << std::endl;
+            continue;
+        }
+        std::istringstream stream(std::string(reinterpret_cast<const char*>(file.Data()), file.Size()));
+        std::string warn, err;
+        tinyobj::LoadMtl(&materialMap, &mtlMaterials, &stream, &warn, &err);
+        if (!warn.empty()) std::cout << warn << std::endl;
+        if (!err.empty()) std::cerr << err << std::endl;
+    }
+    materials.clear();
+    for (const auto& name : names) {
+        MaterialData material;
+        material.name = name;
+        auto it = materialMap.find(name);
+        if (it != materialMap.end()) {
+            const tinyobj::material_t& mtl = mtlMaterials[it->second];
+            material.diffuseTexture = mtl.diffuse_texname;
+            material.normalTexture = !mtl.normal_texname.empty() ? mtl.normal_texname : mtl.bump_texname;
+            // exporters leave Kd at its default when a diffuse map drives the colour
+            if (material.diffuseTexture.empty()) {
+                material.diffuse = glm::vec3(mtl.diffuse[0], mtl.diffuse[1], mtl.diffuse[2]);
+            }
+        }
+        else {
+            std::cout << "Material " << name << " not found in " << objPath.filename().string() << std::endl;
+        }
+        materials.push_back(material);
+    }
+}
 
-        vertexData[i].normal = {
-            attrib.normals[3 * idx.normal_index + 0],
-            attrib.normals[3 * idx.normal_index + 1],
-            attrib.normals[3 * idx.normal_index + 2]
-        };
+bool ResourceManager::loadGltf(const fs::path& path, GltfScene& scene) {
+    scene = GltfScene();
+    scene.file = std::make_shared<GltfFile>();
+    if (!scene.file->Open(path)) return false;
+    const GltfFile& file = *scene.file;
+    const JsonValue& json = file.Json();
+    // compressed geometry needs a decoder, quantized attributes are read like any other accessor
+    const JsonValue& required = json["extensionsRequired"];
+    for (size_t i = 0; i < required.Size(); ++i) {
+        if (required[i].AsString() != "KHR_mesh_quantization") {
+            std::cerr << path.filename().string() << " requires unsupported extension " << required[i].AsString() << std::endl;
+            return false;
+        }
+    }
 
-        vertexData[i].color = {
-            attrib.colors[3 * idx.vertex_index + 0],
-            attrib.colors[3 * idx.vertex_index + 1],
-            attrib.colors[3 * idx.vertex_index + 2]
-        };
+    // materials keep the images their textures sample, samplers are the renderer's own
+    auto textureImage = [&json](const JsonValue& textureInfo) {
+        const int texture = textureInfo["index"].AsInt();
+        return texture < 0 ? -1 : json["textures"][size_t(texture)]["source"].AsInt();
+    };
+    const JsonValue& materials = json["materials"];
+    for (size_t i = 0; i < materials.Size(); ++i) {
+        const JsonValue& description = materials[i];
+        GltfMaterial material;
+        material.data.name = description["name"].AsString();
+        const JsonValue& pbr = description["pbrMetallicRoughness"];
+        const JsonValue& factor = pbr["baseColorFactor"];
+        material.data.diffuse = glm::vec3(factor[0].AsNumber(1.0), factor[1].AsNumber(1.0), factor[2].AsNumber(1.0));
+        material.diffuseImage = textureImage(pbr["baseColorTexture"]);
+        material.normalImage = textureImage(description["normalTexture"]);
+        scene.materials.push_back(material);
+    }
 
-        vertexData[i].texCoords = {
-            attrib.texcoords[2 * idx.texcoord_index + 0],
-            1-attrib.texcoords[2 * idx.texcoord_index + 1]
-        };
+    const JsonValue& meshes = json["meshes"];
+    int defaultMaterial = -1;
+    size_t inPlaceBytes = 0, totalBytes = 0;
+    scene.meshes.resize(meshes.Size());
+    for (size_t i = 0; i < meshes.Size(); ++i) {
+        GltfMesh& mesh = scene.meshes[i];
+        BuildGltfMesh(file, meshes[i], scene.materials, defaultMaterial, mesh, inPlaceBytes);
+        totalBytes += mesh.vertexCount * sizeof(VertexAttributes) + mesh.indexSize;
     }
 
+    const JsonValue& nodes = json["nodes"];
+    std::vector<int> roots;
+    const JsonValue& scenes = json["scenes"];
+    if (scenes.Size() > 0) {
+        const JsonValue& sceneNodes = scenes[size_t(std::max(json["scene"].AsInt(0), 0))]["nodes"];
+        for (size_t i = 0; i < sceneNodes.Size(); ++i) roots.push_back(sceneNodes[i].AsInt());
+    }
+    else {
+        // without a scene every node that is nobody's child is a root
+        std::vector<bool> isChild(nodes.Size(), false);
+        for (size_t n = 0; n < nodes.Size(); ++n) {
+            const JsonValue& children = nodes[n]["children"];
+            for (size_t c = 0; c < children.Size(); ++c) {
+                const int child = children[c].AsInt();
+                if (child >= 0 && size_t(child) < nodes.Size()) isChild[child] = true;
+            }
+        }
+        for (size_t n = 0; n < nodes.Size(); ++n) {
+            if (!isChild[n]) roots.push_back(int(n));
+        }
+    }
+    // depth first so parents are imported before their children, every node at most once
+    std::vector<bool> visited(nodes.Size(), false);
+    std::vector<std::pair<int, int>> stack; // glTF node, parent in scene.nodes
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it) stack.push_back({*it, -1});
+    while (!stack.empty()) {
+        const auto [index, parent] = stack.back();
+        stack.pop_back();
+        if (index < 0 || size_t(index) >= nodes.Size() || visited[index]) continue;
+        visited[index] = true;
+        const JsonValue& node = nodes[index];
+        GltfNode imported;
+        imported.name = node["name"].AsString();
+        imported.mesh = node["mesh"].AsInt();
+        if (size_t(imported.mesh) >= scene.meshes.size()) imported.mesh = -1;
+        imported.parent = parent;
+        imported.matrix = GltfNodeMatrix(node);
+        scene.nodes.push_back(imported);
+        const int importedIndex = int(scene.nodes.size() - 1);
+        const JsonValue& children = node["children"];
+        for (size_t c = children.Size(); c-- > 0;) stack.push_back({children[c].AsInt(), importedIndex});
+    }
+
+    std::cout << path.filename().string() << ": " << scene.nodes.size() << " nodes, " << scene.meshes.size()
+        << " meshes, " << inPlaceBytes / 1024 << " of " << totalBytes / 1024 << " KB of geometry used in place" << std::endl;
     return true;
-}
\ No newline at end of file
+}
+
+std::vector<uint8_t> ResourceManager::packIndices(const GeometryData& geometry) {
+    const size_t indexSize = geometry.indexFormat == IndexFormat::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    // writeBuffer needs a multiple of 4 bytes, so an odd count of 16-bit indices gets one padding index
+    std::vector<uint8_t> bytes((geometry.indices.size() * indexSize + 3) & ~size_t(3), 0);
+    if (geometry.indexFormat == IndexFormat::Uint16) {
+        uint16_t* out = reinterpret_cast<uint16_t*>(bytes.data());
+        for (size_t i = 0; i < geometry.indices.size(); ++i) {
+            out[i] = static_cast<uint16_t>(geometry.indices[i]);
+        }
+    }
+    else {
+        std::memcpy(bytes.data(), geometry.indices.data(), geometry.indices.size() * sizeof(uint32_t));
+    }
+    return bytes;
+}
+
+std::vector<PackedVertex> ResourceManager::packVertices(const VertexAttributes* vertices, size_t count, const Bounds& bounds) {
+    std::vector<PackedVertex> packed(count);
+    const glm::vec3 extent = bounds.max - bounds.min;
+    // flat axes quantize to 0 and get a scale of 0 in the shader
+    const glm::vec3 inverseExtent = glm::vec3(
+        extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+        extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        const VertexAttributes& vertex = vertices[i];
+        PackedVertex& out = packed[i];
+        const glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        const uint64_t quantized = glm::packUnorm4x16(glm::vec4((position - bounds.min) * inverseExtent, 0.0f));
+        std::memcpy(out.position, &quantized, sizeof(out.position));
+
+        // octahedral mapping folds the lower hemisphere over the diagonals
+        glm::vec3 n(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+        const float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        glm::vec2 oct = length > 0.0f ? glm::vec2(n) / length : glm::vec2(0.0f);
+        if (length > 0.0f && n.z < 0.0f) {
+            oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x))) * glm::vec2(oct.x >= 0.0f ? 1.0f : -1.0f, oct.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        const uint32_t normal = glm::packSnorm2x16(oct);
+        std::memcpy(out.normal, &normal, sizeof(out.normal));
+
+        const uint32_t color = glm::packUnorm4x8(glm::vec4(vertex.color[0], vertex.color[1], vertex.color[2], 1.0f));
+        std::memcpy(out.color, &color, sizeof(out.color));
+        const uint32_t texCoords = glm::packHalf2x16(glm::vec2(vertex.texCoords[0], vertex.texCoords[1]));
+        std::memcpy(out.texCoords, &texCoords, sizeof(out.texCoords));
+    }
+    return packed;
+}
+
+uint64_t ResourceManager::hashBytes(const void* data, size_t size) {
+    // FNV-1a over 64-bit words with a final avalanche, fast enough to run over whole source files
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 14695981039346656037ull ^ size;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(uint64_t));
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+GpuTexture::~GpuTexture() {
+    if (view) view.release();
+    if (texture) {
+        texture.destroy();
+        texture.release();
+    }
+}
+
+std::string ResourceManager::textureKey(const fs::path& path, TextureFormat format) {
+    std::error_code error;
+    fs::path canonical = fs::weakly_canonical(path, error);
+    if (error) canonical = fs::absolute(path);
+    return canonical.generic_string() + "#" + std::to_string(static_cast<uint32_t>(format));
+}
+
+bool ResourceManager::isTextureResident(const std::string& key) {
+    std::lock_guard<std::mutex> lock(texturesMutex);
+    auto it = textures.find(key);
+    return it != textures.end() && !it->second.expired();
+}
+
+TextureHandle ResourceManager::acquireTexture(const std::string& key, const std::function<TextureHandle()>& create) {
+    {
+        std::lock_guard<std::mutex> lock(texturesMutex);
+        auto it = textures.find(key);
+        if (it != textures.end()) {
+            if (TextureHandle texture = it->second.lock()) return texture;
+        }
+    }
+    // created outside the lock, create may be slow and only the render thread acquires
+    TextureHandle texture = create();
+    if (texture == nullptr) return nullptr;
+    std::lock_guard<std::mutex> lock(texturesMutex);
+    for (auto it = textures.begin(); it != textures.end();) {
+        if (it->second.expired()) it = textures.erase(it);
+        else ++it;
+    }
+    textures[key] = texture;
+    return texture;
+}
+
+ImageData ResourceManager::solidImage(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    ImageData image;
+    image.width = 1;
+    image.height = 1;
+    image.pixels = { r, g, b, a };
+    return image;
+}
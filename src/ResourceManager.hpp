@@ -2,6 +2,15 @@
 #include <webgpu/webgpu.hpp>
 #include <filesystem>
 #include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include <limits>
+#include <glm/glm.hpp>
 
 namespace fs = std::filesystem;
 
@@ -12,11 +21,128 @@ struct VertexAttributes {
     std::array<float,2> texCoords;
 };
 
+// 20 byte vertex: position unorm16 in the mesh AABB (w unused), octahedral snorm16 normal,
+// unorm8 colour and float16 uv, so uvs outside [0, 1] still tile
+struct PackedVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint8_t color[4];
+    uint16_t texCoords[2];
+};
+
+enum class VertexLayout {
+    Full,
+    Packed,
+};
+
+struct Bounds {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+};
+
+struct MaterialData {
+    std::string name;
+    glm::vec3 diffuse = glm::vec3(1.0f);
+    std::string diffuseTexture;
+    std::string normalTexture;
+};
+
+// contiguous range of the index buffer drawn with one material
+struct Submesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t material;
+    // meshlets splitting the range, in index order
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+};
+
+// small run of triangles in the index buffer with object space bounds for culling, the
+// normal cone rejects it when the camera sees the back of every triangle in it
+struct Meshlet {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff; // sine of the cone half angle, 1 when the cone can't cull
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// one level of detail, a run of submeshes sharing the vertex buffer with every other level
+struct MeshLod {
+    uint32_t firstSubmesh;
+    uint32_t submeshCount;
+    float error; // largest object space deviation from the full mesh
+};
+
+struct GeometryData {
+    std::vector<VertexAttributes> vertices;
+    std::vector<uint32_t> indices;
+    wgpu::IndexFormat indexFormat = wgpu::IndexFormat::Uint32;
+    Bounds bounds;
+    BoundingSphere sphere;
+    std::vector<MaterialData> materials;
+    std::vector<Submesh> submeshes;
+    // lods[0] is the full mesh, coarser levels follow
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+};
+
+struct ImageData {
+    int width = 0;
+    int height = 0;
+    wgpu::TextureFormat format = wgpu::TextureFormat::RGBA8Unorm;
+    std::vector<uint8_t> pixels; // level 0, tightly packed rows or blocks of format
+    // lower mip levels when the source ships them, laid out like pixels
+    std::vector<std::vector<uint8_t>> mips;
+    bool premultiplied = false; // colour scaled by alpha, set once so it never happens twice
+};
+
+// GPU texture shared between every material that samples it, released with its last handle
+struct GpuTexture {
+    wgpu::Texture texture = nullptr;
+    wgpu::TextureView view = nullptr;
+    GpuTexture() = default;
+    GpuTexture(const GpuTexture&) = delete;
+    GpuTexture& operator=(const GpuTexture&) = delete;
+    ~GpuTexture();
+};
+using TextureHandle = std::shared_ptr<GpuTexture>;
+
+// textures every material can fall back to when it has no map of its own
+const std::string DEFAULT_WHITE_TEXTURE = "default:white";
+const std::string DEFAULT_NORMAL_TEXTURE = "default:normal";
+
+struct GltfScene;
+
 class ResourceManager {
     public:
     static wgpu::ShaderModule loadShaderModule(const fs::path& path, wgpu::Device device);
-    static bool loadGeometryObj(const fs::path& path, std::vector<VertexAttributes>& vertexData);
+    static bool loadGeometryObj(const fs::path& path, GeometryData& geometry);
+    // every mesh and node of the default scene, .gltf with its buffers or .glb
+    static bool loadGltf(const fs::path& path, GltfScene& scene);
+    static std::vector<uint8_t> packIndices(const GeometryData& geometry);
+    static std::vector<PackedVertex> packVertices(const VertexAttributes* vertices, size_t count, const Bounds& bounds);
+    static uint64_t hashBytes(const void* data, size_t size);
+
+    // texture registry, keys are canonical path plus format so each file is uploaded once per format
+    static std::string textureKey(const fs::path& path, wgpu::TextureFormat format);
+    // safe to call from loader threads, tells whether decoding a texture can be skipped
+    static bool isTextureResident(const std::string& key);
+    // render thread only, returns the resident texture or registers the one create makes
+    static TextureHandle acquireTexture(const std::string& key, const std::function<TextureHandle()>& create);
+    static ImageData solidImage(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
 
     private:
+    static std::unordered_map<std::string, std::weak_ptr<GpuTexture>> textures;
+    static std::mutex texturesMutex;
+    static void loadMaterials(const fs::path& objPath, const std::vector<std::string>& libraries,
+        const std::vector<std::string>& names, std::vector<MaterialData>& materials);
 
 };
\ No newline at end of file
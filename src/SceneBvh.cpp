@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include "SceneBvh.hpp"
+#include "JobSystem.hpp"
+
+// SAH candidates per axis, more only pays off for badly clustered scenes
+constexpr uint32_t SAH_BINS = 16;
+// leaves this small are never split, larger ones only when the SAH says so
+constexpr uint32_t MIN_SPLIT_OBJECTS = 2;
+constexpr uint32_t MAX_LEAF_OBJECTS = 8;
+// cost of visiting a node relative to testing one object
+constexpr float TRAVERSAL_COST = 1.0f;
+// nodes with more objects build their two halves on different workers
+constexpr uint32_t PARALLEL_BUILD_OBJECTS = 16 * 1024;
+// and bin their objects in chunks of this size
+constexpr uint32_t PARALLEL_BIN_CHUNK = 64 * 1024;
+// deeper than this the median split takes over, keeps the traversal stacks bounded
+constexpr uint32_t MAX_DEPTH = 60;
+constexpr uint32_t NO_NODE = ~0u;
+
+namespace {
+struct Bin {
+    Bounds bounds;
+    uint32_t count = 0;
+};
+
+// object boxes of a range and the box around their centroids, plus the bins along each axis
+struct BinnedRange {
+    Bounds bounds, centroidBounds;
+    Bin bins[3][SAH_BINS];
+};
+
+void Grow(Bounds& bounds, const Bounds& other) {
+    bounds.min = glm::min(bounds.min, other.min);
+    bounds.max = glm::max(bounds.max, other.max);
+}
+
+void Grow(Bounds& bounds, const glm::vec3& point) {
+    bounds.min = glm::min(bounds.min, point);
+    bounds.max = glm::max(bounds.max, point);
+}
+
+float HalfArea(const Bounds& bounds) {
+    const glm::vec3 size = bounds.max - bounds.min;
+    if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f) return 0.0f;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+bool Equal(const Bounds& a, const Bounds& b) {
+    return a.min == b.min && a.max == b.max;
+}
+
+uint32_t BinIndex(float centroid, float min, float scale) {
+    return std::min(uint32_t(std::max((centroid - min) * scale, 0.0f)), SAH_BINS - 1);
+}
+
+// -1 outside, 0 straddling, 1 inside the plane
+int ClassifyBox(const glm::vec4& plane, const Bounds& bounds) {
+    const glm::vec3 normal = glm::vec3(plane);
+    const glm::vec3 positive = glm::mix(bounds.min, bounds.max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+    const glm::vec3 negative = glm::mix(bounds.max, bounds.min, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+    if (glm::dot(normal, positive) + plane.w < 0.0f) return -1;
+    return glm::dot(normal, negative) + plane.w >= 0.0f ? 1 : 0;
+}
+
+constexpr float MISS = std::numeric_limits<float>::infinity();
+
+// distance along the ray to where it enters the box, MISS when it doesn't within maxDistance
+float RayBoxDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, const Bounds& bounds, float maxDistance) {
+    const glm::vec3 t0 = (bounds.min - origin) * inverseDirection;
+    const glm::vec3 t1 = (bounds.max - origin) * inverseDirection;
+    const glm::vec3 near = glm::min(t0, t1);
+    const glm::vec3 far = glm::max(t0, t1);
+    const float enter = std::max({near.x, near.y, near.z, 0.0f});
+    const float exit = std::min({far.x, far.y, far.z, maxDistance});
+    return enter <= exit ? enter : MISS;
+}
+
+float DistanceSquared(const glm::vec3& point, const Bounds& bounds) {
+    const glm::vec3 offset = glm::max(glm::max(bounds.min - point, point - bounds.max), glm::vec3(0.0f));
+    return glm::dot(offset, offset);
+}
+}
+
+void SceneBvh::Build(const std::vector<Bounds>& bounds) {
+    const uint32_t count = uint32_t(bounds.size());
+    objectBounds = bounds;
+    objects.resize(count);
+    std::iota(objects.begin(), objects.end(), 0u);
+    centroids.resize(count);
+    JobSystem::Get().ParallelFor((count + PARALLEL_BIN_CHUNK - 1) / PARALLEL_BIN_CHUNK, [&](size_t chunk) {
+        const size_t end = std::min<size_t>(count, (chunk + 1) * PARALLEL_BIN_CHUNK);
+        for (size_t i = chunk * PARALLEL_BIN_CHUNK; i < end; ++i) centroids[i] = 0.5f * (bounds[i].min + bounds[i].max);
+    });
+    // a binary tree with single object leaves has 2n - 1 nodes, nothing builds more
+    nodes.assign(std::max(2 * count, 2u) - 1, Node());
+    nodes[0].objectCount = count;
+    nodeCount = 1;
+    BuildNode(0, 0);
+    nodes.resize(nodeCount);
+    objectLeaves.assign(count, NO_NODE);
+    for (uint32_t node = 0; node < nodes.size(); ++node) {
+        if (nodes[node].left != NO_NODE) continue;
+        for (uint32_t i = nodes[node].firstObject; i < nodes[node].firstObject + nodes[node].objectCount; ++i) {
+            objectLeaves[objects[i]] = node;
+        }
+    }
+}
+
+void SceneBvh::BuildNode(uint32_t node, uint32_t depth) {
+    const uint32_t first = nodes[node].firstObject;
+    const uint32_t count = nodes[node].objectCount;
+    if (count < MIN_SPLIT_OBJECTS) {
+        nodes[node].bounds = Bounds();
+        for (uint32_t i = first; i < first + count; ++i) Grow(nodes[node].bounds, objectBounds[objects[i]]);
+        MakeLeaf(node);
+        return;
+    }
+    // first pass: the boxes, second pass: the bins over the centroid box
+    const uint32_t chunks = count >= 2 * PARALLEL_BIN_CHUNK ? (count + PARALLEL_BIN_CHUNK - 1) / PARALLEL_BIN_CHUNK : 1;
+    const uint32_t chunkSize = (count + chunks - 1) / chunks;
+    // small nodes are most of the tree, they bin on the stack
+    BinnedRange single;
+    std::vector<BinnedRange> chunkRanges(chunks > 1 ? chunks : 0);
+    BinnedRange* partial = chunks > 1 ? chunkRanges.data() : &single;
+    auto forChunks = [&](auto&& body) {
+        auto run = [&](size_t chunk) {
+            const uint32_t begin = first + uint32_t(chunk) * chunkSize;
+            body(partial[chunk], begin, std::min(first + count, begin + chunkSize));
+        };
+        if (chunks == 1) run(0);
+        else JobSystem::Get().ParallelFor(chunks, run);
+    };
+    forChunks([&](BinnedRange& range, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            Grow(range.bounds, objectBounds[objects[i]]);
+            Grow(range.centroidBounds, centroids[objects[i]]);
+        }
+    });
+    BinnedRange binned;
+    for (uint32_t chunk = 0; chunk < chunks; ++chunk) {
+        Grow(binned.bounds, partial[chunk].bounds);
+        Grow(binned.centroidBounds, partial[chunk].centroidBounds);
+    }
+    nodes[node].bounds = binned.bounds;
+    const glm::vec3 extent = binned.centroidBounds.max - binned.centroidBounds.min;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; ++axis) scale[axis] = extent[axis] > 0.0f ? float(SAH_BINS) / extent[axis] : 0.0f;
+    forChunks([&](BinnedRange& range, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            const uint32_t object = objects[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                Bin& bin = range.bins[axis][BinIndex(centroids[object][axis], binned.centroidBounds.min[axis], scale[axis])];
+                Grow(bin.bounds, objectBounds[object]);
+                ++bin.count;
+            }
+        }
+    });
+    for (uint32_t chunk = 0; chunk < chunks; ++chunk) {
+        for (int axis = 0; axis < 3; ++axis) {
+            for (uint32_t b = 0; b < SAH_BINS; ++b) {
+                Grow(binned.bins[axis][b].bounds, partial[chunk].bins[axis][b].bounds);
+                binned.bins[axis][b].count += partial[chunk].bins[axis][b].count;
+            }
+        }
+    }
+
+    // sweep each axis from both ends, the split costs the area weighted counts of its halves
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (scale[axis] == 0.0f) continue;
+        const Bin* bins = binned.bins[axis];
+        float rightCosts[SAH_BINS];
+        Bounds right;
+        uint32_t rightCount = 0;
+        for (uint32_t b = SAH_BINS - 1; b > 0; --b) {
+            Grow(right, bins[b].bounds);
+            rightCount += bins[b].count;
+            rightCosts[b] = HalfArea(right) * rightCount;
+        }
+        Bounds left;
+        uint32_t leftCount = 0;
+        for (uint32_t b = 1; b < SAH_BINS; ++b) {
+            Grow(left, bins[b - 1].bounds);
+            leftCount += bins[b - 1].count;
+            const float cost = HalfArea(left) * leftCount + rightCosts[b];
+            if (leftCount > 0 && leftCount < count && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+    const float parentArea = HalfArea(binned.bounds);
+    const float splitCost = TRAVERSAL_COST + (parentArea > 0.0f ? bestCost / parentArea : float(count));
+    if (count <= MAX_LEAF_OBJECTS && (bestAxis < 0 || splitCost >= float(count))) {
+        MakeLeaf(node);
+        return;
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0 && depth < MAX_DEPTH) {
+        const float min = binned.centroidBounds.min[bestAxis];
+        const float axisScale = scale[bestAxis];
+        middle = uint32_t(std::partition(objects.begin() + first, objects.begin() + first + count, [&](uint32_t object) {
+            return BinIndex(centroids[object][bestAxis], min, axisScale) < bestSplit;
+        }) - objects.begin());
+    }
+    else {
+        // every centroid in one spot, or a degenerate run of splits: halve along the widest axis
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        middle = first + count / 2;
+        std::nth_element(objects.begin() + first, objects.begin() + middle, objects.begin() + first + count,
+            [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+
+    const uint32_t left = nodeCount.fetch_add(2);
+    nodes[node].left = left;
+    nodes[left].firstObject = first;
+    nodes[left].objectCount = middle - first;
+    nodes[left].parent = node;
+    nodes[left + 1].firstObject = middle;
+    nodes[left + 1].objectCount = first + count - middle;
+    nodes[left + 1].parent = node;
+    if (count >= PARALLEL_BUILD_OBJECTS) {
+        JobSystem::Get().ParallelFor(2, [&](size_t child) { BuildNode(left + uint32_t(child), depth + 1); });
+    }
+    else {
+        BuildNode(left, depth + 1);
+        BuildNode(left + 1, depth + 1);
+    }
+}
+
+void SceneBvh::MakeLeaf(uint32_t node) {
+    nodes[node].left = NO_NODE;
+}
+
+void SceneBvh::Update(uint32_t object, const Bounds& bounds) {
+    assert(object < objectBounds.size());
+    objectBounds[object] = bounds;
+    // up from the leaf until a node comes out the same as before
+    for (uint32_t node = objectLeaves[object]; node != NO_NODE; node = nodes[node].parent) {
+        Bounds refitted;
+        if (nodes[node].left == NO_NODE) {
+            for (uint32_t i = nodes[node].firstObject; i < nodes[node].firstObject + nodes[node].objectCount; ++i) {
+                Grow(refitted, objectBounds[objects[i]]);
+            }
+        }
+        else {
+            refitted = nodes[nodes[node].left].bounds;
+            Grow(refitted, nodes[nodes[node].left + 1].bounds);
+        }
+        if (Equal(refitted, nodes[node].bounds)) break;
+        nodes[node].bounds = refitted;
+    }
+}
+
+size_t SceneBvh::ObjectCount() const {
+    return objects.size();
+}
+
+size_t SceneBvh::NodeCount() const {
+    return nodes.size();
+}
+
+void SceneBvh::Cull(const Frustum& frustum, std::vector<uint32_t>& inside, std::vector<uint32_t>& boundary) const {
+    if (objects.empty()) return;
+    // planes a node lies fully inside of are dropped for its whole subtree
+    struct Entry {
+        uint32_t node;
+        uint32_t planeMask;
+    };
+    Entry stack[2 * MAX_DEPTH + 2];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = Entry{0, (1u << 6) - 1};
+    while (stackSize > 0) {
+        const Entry entry = stack[--stackSize];
+        const Node& node = nodes[entry.node];
+        uint32_t planeMask = entry.planeMask;
+        bool outside = false;
+        for (int plane = 0; plane < 6 && !outside; ++plane) {
+            if (!(planeMask & (1u << plane))) continue;
+            const int side = ClassifyBox(frustum.planes[plane], node.bounds);
+            if (side < 0) outside = true;
+            else if (side > 0) planeMask &= ~(1u << plane);
+        }
+        if (outside) continue;
+        if (planeMask == 0 || node.left == NO_NODE) {
+            std::vector<uint32_t>& output = planeMask == 0 ? inside : boundary;
+            output.insert(output.end(), objects.begin() + node.firstObject, objects.begin() + node.firstObject + node.objectCount);
+            continue;
+        }
+        stack[stackSize++] = Entry{node.left, planeMask};
+        stack[stackSize++] = Entry{node.left + 1, planeMask};
+    }
+}
+
+bool SceneBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, BvhHit& hit, float maxDistance) const {
+    hit = BvhHit();
+    if (objects.empty()) return false;
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    float closest = maxDistance;
+    uint32_t stack[2 * MAX_DEPTH + 2];
+    uint32_t stackSize = 0;
+    if (RayBoxDistance(origin, inverseDirection, nodes[0].bounds, closest) != MISS) stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        if (node.left == NO_NODE) {
+            for (uint32_t i = node.firstObject; i < node.firstObject + node.objectCount; ++i) {
+                const float distance = RayBoxDistance(origin, inverseDirection, objectBounds[objects[i]], closest);
+                if (distance < hit.distance) {
+                    hit.object = objects[i];
+                    hit.distance = distance;
+                    closest = distance;
+                }
+            }
+            continue;
+        }
+        // the nearer child goes on top, so its hits can cut the other one off
+        float distances[2];
+        for (uint32_t child = 0; child < 2; ++child) {
+            distances[child] = RayBoxDistance(origin, inverseDirection, nodes[node.left + child].bounds, closest);
+        }
+        const uint32_t nearer = distances[1] < distances[0] ? 1 : 0;
+        if (distances[1 - nearer] != MISS) stack[stackSize++] = node.left + 1 - nearer;
+        if (distances[nearer] != MISS) stack[stackSize++] = node.left + nearer;
+    }
+    return hit.object != ~0u;
+}
+
+bool SceneBvh::Nearest(const glm::vec3& point, BvhHit& hit) const {
+    hit = BvhHit();
+    if (objects.empty()) return false;
+    float closest = std::numeric_limits<float>::infinity(); // squared
+    uint32_t stack[2 * MAX_DEPTH + 2];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        if (DistanceSquared(point, node.bounds) >= closest) continue;
+        if (node.left == NO_NODE) {
+            for (uint32_t i = node.firstObject; i < node.firstObject + node.objectCount; ++i) {
+                const float distance = DistanceSquared(point, objectBounds[objects[i]]);
+                if (distance < closest) {
+                    closest = distance;
+                    hit.object = objects[i];
+                }
+            }
+            continue;
+        }
+        const float distances[2] = {DistanceSquared(point, nodes[node.left].bounds), DistanceSquared(point, nodes[node.left + 1].bounds)};
+        const uint32_t nearer = distances[1] < distances[0] ? 1 : 0;
+        if (distances[1 - nearer] < closest) stack[stackSize++] = node.left + 1 - nearer;
+        if (distances[nearer] < closest) stack[stackSize++] = node.left + nearer;
+    }
+    hit.distance = std::sqrt(closest);
+    return hit.object != ~0u;
+}
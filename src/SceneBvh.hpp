@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Culling.hpp"
+#include "ResourceManager.hpp"
+
+// closest object a query found and how far away it is
+struct BvhHit {
+    uint32_t object = ~0u;
+    float distance = std::numeric_limits<float>::infinity();
+};
+
+// Bounding volume hierarchy over scene objects, each an id with a world space box. Built
+// top down with binned SAH splits, the top levels of large scenes split across the
+// JobSystem. Moving an object refits its leaf and the nodes above it instead of rebuilding.
+// Culling, ray and nearest object queries reject whole subtrees, so they scale with the
+// depth of the tree rather than the number of objects.
+class SceneBvh {
+public:
+    // object ids are indices into bounds
+    void Build(const std::vector<Bounds>& bounds);
+    // the object's box changed, grows or shrinks the nodes above it to fit
+    void Update(uint32_t object, const Bounds& bounds);
+    size_t ObjectCount() const;
+    size_t NodeCount() const;
+
+    // appends the objects of subtrees inside the frustum to inside, and the objects of leaves
+    // straddling it to boundary, for the caller to test with something tighter than their box
+    void Cull(const Frustum& frustum, std::vector<uint32_t>& inside, std::vector<uint32_t>& boundary) const;
+    // closest object box the ray enters within maxDistance, direction needs no normalizing
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, BvhHit& hit,
+        float maxDistance = std::numeric_limits<float>::infinity()) const;
+    // object whose box is closest to point, zero distance when the point is inside it
+    bool Nearest(const glm::vec3& point, BvhHit& hit) const;
+
+private:
+    struct Node {
+        Bounds bounds;
+        uint32_t firstObject = 0; // the node's objects are objects[firstObject, firstObject + objectCount)
+        uint32_t objectCount = 0;
+        uint32_t left = ~0u;      // right child is left + 1, leaves have none
+        uint32_t parent = ~0u;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> objects;
+    std::vector<Bounds> objectBounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> objectLeaves;
+    std::atomic<uint32_t> nodeCount{0};
+
+    void BuildNode(uint32_t node, uint32_t depth);
+    void MakeLeaf(uint32_t node);
+};
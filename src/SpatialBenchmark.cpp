@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Culling.hpp"
+#include "SpatialHash.hpp"
+
+// Moves every object of a SpatialHash each frame and times the moves next to the queries a
+// frame would run on the result: one frustum query for the camera and a batch of radius
+// queries, as gameplay code looking for neighbours would.
+namespace {
+constexpr size_t DEFAULT_OBJECT_COUNT = 500000;
+constexpr int DEFAULT_FRAME_COUNT = 60;
+constexpr float WORLD_SIZE = 1000.0f;
+// about 15 objects a cell, larger cells make moves that leave their cell rarer
+constexpr float CELL_SIZE = 32.0f;
+constexpr float MAX_SPEED = 2.0f; // units per frame
+constexpr int RADIUS_QUERIES = 1000;
+constexpr float QUERY_RADIUS = 10.0f;
+
+using Clock = std::chrono::steady_clock;
+
+double Milliseconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+}
+
+int main(int argc, char** argv) {
+    // SpatialBenchmark [object count] [frame count]
+    size_t objectCount = DEFAULT_OBJECT_COUNT;
+    int frameCount = DEFAULT_FRAME_COUNT;
+    try {
+        if (argc >= 2) objectCount = std::stoul(argv[1]);
+        if (argc >= 3) frameCount = std::stoi(argv[2]);
+    }
+    catch (const std::exception&) {
+        std::cerr << "usage: " << argv[0] << " [object count] [frame count]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(0.0f, WORLD_SIZE);
+    std::uniform_real_distribution<float> speed(-MAX_SPEED, MAX_SPEED);
+    std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+    SpatialHash hash(CELL_SIZE);
+    std::vector<SpatialId> ids(objectCount);
+    std::vector<glm::vec3> centers(objectCount);
+    std::vector<glm::vec3> velocities(objectCount);
+    const auto insertStart = Clock::now();
+    for (size_t i = 0; i < objectCount; ++i) {
+        centers[i] = glm::vec3(position(random), position(random), position(random));
+        velocities[i] = glm::vec3(speed(random), speed(random), speed(random));
+        ids[i] = hash.Insert(centers[i], size(random));
+    }
+    std::cout << "Inserted " << objectCount << " objects into " << hash.CellCount() << " cells in "
+        << Milliseconds(insertStart, Clock::now()) << " ms" << std::endl;
+
+    std::vector<glm::vec3> queryCenters(RADIUS_QUERIES);
+    for (glm::vec3& center : queryCenters) center = glm::vec3(position(random), position(random), position(random));
+    const glm::vec3 eye(0.5f * WORLD_SIZE, 0.5f * WORLD_SIZE, -100.0f);
+    const glm::mat4x4 view = glm::lookAt(eye, glm::vec3(0.5f * WORLD_SIZE), glm::vec3(0, 1, 0));
+    const glm::mat4x4 projection = glm::perspectiveZO(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 0.6f * WORLD_SIZE);
+    const Frustum frustum = Frustum::FromMatrix(projection * view);
+
+    double moveTime = 0.0, frustumTime = 0.0, radiusTime = 0.0;
+    size_t visible = 0, neighbours = 0;
+    std::vector<SpatialId> result;
+    for (int frame = 0; frame < frameCount; ++frame) {
+        // bounce off the walls so the density stays put
+        const auto moveStart = Clock::now();
+        for (size_t i = 0; i < objectCount; ++i) {
+            glm::vec3& center = centers[i];
+            center += velocities[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                if (center[axis] < 0.0f || center[axis] > WORLD_SIZE) {
+                    velocities[i][axis] = -velocities[i][axis];
+                    center[axis] = std::clamp(center[axis], 0.0f, WORLD_SIZE);
+                }
+            }
+            hash.Move(ids[i], center);
+        }
+        const auto frustumStart = Clock::now();
+        result.clear();
+        hash.QueryFrustum(frustum, result);
+        visible += result.size();
+        const auto radiusStart = Clock::now();
+        for (const glm::vec3& center : queryCenters) {
+            result.clear();
+            hash.QueryRadius(center, QUERY_RADIUS, result);
+            neighbours += result.size();
+        }
+        const auto end = Clock::now();
+        moveTime += Milliseconds(moveStart, frustumStart);
+        frustumTime += Milliseconds(frustumStart, radiusStart);
+        radiusTime += Milliseconds(radiusStart, end);
+    }
+
+    const double frames = std::max(frameCount, 1);
+    std::cout << "Per frame over " << frameCount << " frames, " << hash.CellCount() << " cells in use" << std::endl;
+    std::cout << "  move " << objectCount << " objects: " << moveTime / frames << " ms" << std::endl;
+    std::cout << "  frustum query: " << frustumTime / frames << " ms, " << visible / frames << " objects" << std::endl;
+    std::cout << "  " << RADIUS_QUERIES << " radius queries: " << radiusTime / frames << " ms, "
+        << neighbours / (frames * RADIUS_QUERIES) << " objects each" << std::endl;
+    return 0;
+}
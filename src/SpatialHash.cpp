@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "SpatialHash.hpp"
+
+constexpr uint32_t NO_CELL = ~0u;
+// cell keys use 63 bits, so this one marks an empty lookup slot
+constexpr uint64_t NO_KEY = ~uint64_t(0);
+constexpr size_t MIN_LOOKUP_SLOTS = 1024;
+// queries covering more cells than this walk the occupied ones instead
+constexpr int64_t MAX_SCANNED_CELLS = 4096;
+
+namespace {
+// 21 bits per axis, a million cells either side of the origin
+uint64_t CellKey(const glm::ivec3& coords) {
+    constexpr int32_t bias = 1 << 20;
+    constexpr uint64_t mask = (1u << 21) - 1;
+    return (uint64_t(coords.x + bias) & mask) | (uint64_t(coords.y + bias) & mask) << 21 | (uint64_t(coords.z + bias) & mask) << 42;
+}
+
+// neighbouring cells have neighbouring keys, the multiply spreads them over the table
+size_t LookupSlot(uint64_t key, size_t slotMask) {
+    return size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & slotMask;
+}
+}
+
+SpatialHash::SpatialHash(float cellSize) : cellSize(cellSize), inverseCellSize(1.0f / cellSize) {}
+
+glm::ivec3 SpatialHash::CellCoords(const glm::vec3& point) const {
+    return glm::ivec3(glm::floor(point * inverseCellSize));
+}
+
+uint32_t SpatialHash::FindCell(const glm::ivec3& coords) const {
+    if (lookupKeys.empty()) return NO_CELL;
+    const uint64_t key = CellKey(coords);
+    const size_t slotMask = lookupKeys.size() - 1;
+    for (size_t slot = LookupSlot(key, slotMask);; slot = (slot + 1) & slotMask) {
+        if (lookupKeys[slot] == key) return lookupCells[slot];
+        if (lookupKeys[slot] == NO_KEY) return NO_CELL;
+    }
+}
+
+uint32_t SpatialHash::AcquireCell(const glm::ivec3& coords) {
+    // sized for the most cells alive at once, kept at most half full
+    if (2 * (cells.size() + 1) > lookupKeys.size()) {
+        lookupKeys.assign(std::max(2 * lookupKeys.size(), MIN_LOOKUP_SLOTS), NO_KEY);
+        lookupCells.resize(lookupKeys.size());
+        const size_t slotMask = lookupKeys.size() - 1;
+        for (uint32_t cell = 0; cell < cells.size(); ++cell) {
+            if (cells[cell].objects.empty()) continue;
+            const uint64_t key = CellKey(cells[cell].coords);
+            size_t slot = LookupSlot(key, slotMask);
+            while (lookupKeys[slot] != NO_KEY) slot = (slot + 1) & slotMask;
+            lookupKeys[slot] = key;
+            lookupCells[slot] = cell;
+        }
+    }
+    const uint64_t key = CellKey(coords);
+    const size_t slotMask = lookupKeys.size() - 1;
+    size_t slot = LookupSlot(key, slotMask);
+    for (; lookupKeys[slot] != NO_KEY; slot = (slot + 1) & slotMask) {
+        if (lookupKeys[slot] == key) return lookupCells[slot];
+    }
+    uint32_t cell;
+    if (!freeCells.empty()) {
+        cell = freeCells.back();
+        freeCells.pop_back();
+    }
+    else {
+        cell = uint32_t(cells.size());
+        cells.emplace_back();
+    }
+    cells[cell].coords = coords;
+    lookupKeys[slot] = key;
+    lookupCells[slot] = cell;
+    return cell;
+}
+
+void SpatialHash::ReleaseCell(uint32_t cell) {
+    const uint64_t key = CellKey(cells[cell].coords);
+    const size_t slotMask = lookupKeys.size() - 1;
+    size_t hole = LookupSlot(key, slotMask);
+    while (lookupKeys[hole] != key) hole = (hole + 1) & slotMask;
+    // later keys of the probe run shift back into the hole unless that would put them
+    // before their home slot, so lookups never stop early at an empty slot
+    for (size_t next = (hole + 1) & slotMask; lookupKeys[next] != NO_KEY; next = (next + 1) & slotMask) {
+        const size_t home = LookupSlot(lookupKeys[next], slotMask);
+        if (((next - home) & slotMask) >= ((next - hole) & slotMask)) {
+            lookupKeys[hole] = lookupKeys[next];
+            lookupCells[hole] = lookupCells[next];
+            hole = next;
+        }
+    }
+    lookupKeys[hole] = NO_KEY;
+    freeCells.push_back(cell);
+}
+
+void SpatialHash::Link(SpatialId id, uint32_t cell) {
+    objects[id].cell = cell;
+    objects[id].slot = uint32_t(cells[cell].objects.size());
+    if (cells[cell].objects.empty()) ++occupiedCells;
+    cells[cell].objects.push_back(id);
+}
+
+void SpatialHash::Unlink(SpatialId id) {
+    // the last object of the cell takes the hole, an emptied cell goes back to the free list
+    Cell& cell = cells[objects[id].cell];
+    const SpatialId last = cell.objects.back();
+    cell.objects[objects[id].slot] = last;
+    objects[last].slot = objects[id].slot;
+    cell.objects.pop_back();
+    if (cell.objects.empty()) {
+        --occupiedCells;
+        ReleaseCell(objects[id].cell);
+    }
+    objects[id].cell = NO_CELL;
+}
+
+SpatialId SpatialHash::Insert(const glm::vec3& center, float radius) {
+    SpatialId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    else {
+        id = SpatialId(objects.size());
+        objects.emplace_back();
+    }
+    objects[id].center = center;
+    objects[id].radius = radius;
+    maxRadius = std::max(maxRadius, radius);
+    Link(id, AcquireCell(CellCoords(center)));
+    ++liveCount;
+    return id;
+}
+
+void SpatialHash::Move(SpatialId id, const glm::vec3& center) {
+    assert(id < objects.size() && objects[id].cell != NO_CELL);
+    Object& object = objects[id];
+    object.center = center;
+    const glm::ivec3 coords = CellCoords(center);
+    // most moves stay inside their cell and end here
+    if (coords == cells[object.cell].coords) return;
+    Unlink(id);
+    Link(id, AcquireCell(coords));
+}
+
+void SpatialHash::Remove(SpatialId id) {
+    assert(id < objects.size() && objects[id].cell != NO_CELL);
+    Unlink(id);
+    freeIds.push_back(id);
+    --liveCount;
+}
+
+size_t SpatialHash::Size() const {
+    return liveCount;
+}
+
+size_t SpatialHash::CellCount() const {
+    return occupiedCells;
+}
+
+void SpatialHash::QueryFrustum(const Frustum& frustum, std::vector<SpatialId>& result) const {
+    // a cell holds centres in its box, so its objects reach at most maxRadius past it; free
+    // cells are empty and skipped
+    for (const Cell& cell : cells) {
+        if (cell.objects.empty()) continue;
+        const glm::vec3 halfSize = glm::vec3(0.5f * cellSize + maxRadius);
+        const glm::vec3 center = (glm::vec3(cell.coords) + 0.5f) * cellSize;
+        bool outside = false;
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes) {
+            const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            const float extent = glm::dot(glm::abs(glm::vec3(plane)), halfSize);
+            if (distance < -extent) {
+                outside = true;
+                break;
+            }
+            if (distance < extent) inside = false;
+        }
+        if (outside) continue;
+        if (inside) {
+            result.insert(result.end(), cell.objects.begin(), cell.objects.end());
+            continue;
+        }
+        for (SpatialId id : cell.objects) {
+            if (frustum.IntersectsSphere(objects[id].center, objects[id].radius)) result.push_back(id);
+        }
+    }
+}
+
+void SpatialHash::QueryRadius(const glm::vec3& center, float radius, std::vector<SpatialId>& result) const {
+    const float reach = radius + maxRadius;
+    const glm::ivec3 low = CellCoords(center - reach);
+    const glm::ivec3 high = CellCoords(center + reach);
+    auto collect = [&](const Cell& cell) {
+        for (SpatialId id : cell.objects) {
+            const float distance = radius + objects[id].radius;
+            const glm::vec3 offset = objects[id].center - center;
+            if (glm::dot(offset, offset) <= distance * distance) result.push_back(id);
+        }
+    };
+    const glm::i64vec3 span = glm::i64vec3(high - low) + int64_t(1);
+    if (span.x * span.y * span.z > MAX_SCANNED_CELLS) {
+        for (const Cell& cell : cells) {
+            if (!cell.objects.empty() && glm::all(glm::greaterThanEqual(cell.coords, low)) && glm::all(glm::lessThanEqual(cell.coords, high))) {
+                collect(cell);
+            }
+        }
+        return;
+    }
+    for (int z = low.z; z <= high.z; ++z) {
+        for (int y = low.y; y <= high.y; ++y) {
+            for (int x = low.x; x <= high.x; ++x) {
+                const uint32_t cell = FindCell(glm::ivec3(x, y, z));
+                if (cell != NO_CELL) collect(cells[cell]);
+            }
+        }
+    }
+}
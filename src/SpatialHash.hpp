@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Culling.hpp"
+
+using SpatialId = uint32_t;
+
+// Loose uniform grid over bounding spheres, for objects that move every frame. Only the
+// cells holding something exist, found through a hash of their coordinates. An object
+// lives in the cell of its centre, so a move costs a cell lookup at most, and queries
+// widen by the largest radius to find objects reaching in from next door.
+class SpatialHash {
+public:
+    // cells several times the typical object and holding a handful each keep most moves inside
+    // their cell, smaller ones make queries tighter but moves pricier
+    explicit SpatialHash(float cellSize);
+    SpatialId Insert(const glm::vec3& center, float radius);
+    void Move(SpatialId id, const glm::vec3& center);
+    void Remove(SpatialId id);
+    size_t Size() const;
+    // cells holding at least one object
+    size_t CellCount() const;
+
+    // append every sphere touching the frustum or the query sphere
+    void QueryFrustum(const Frustum& frustum, std::vector<SpatialId>& result) const;
+    void QueryRadius(const glm::vec3& center, float radius, std::vector<SpatialId>& result) const;
+
+private:
+    struct Object {
+        glm::vec3 center;
+        float radius;
+        uint32_t cell;
+        uint32_t slot; // position in the cell's object list
+    };
+    struct Cell {
+        glm::ivec3 coords;
+        std::vector<SpatialId> objects;
+    };
+
+    float cellSize, inverseCellSize;
+    // never shrinks, a removed giant only makes queries look a little further
+    float maxRadius = 0.0f;
+    // open addressed, cell keys next to cell indices, probed linearly
+    std::vector<uint64_t> lookupKeys;
+    std::vector<uint32_t> lookupCells;
+    std::vector<Cell> cells;
+    // emptied cells, reused by the next one needed so wandering objects don't grow the grid
+    std::vector<uint32_t> freeCells;
+    size_t occupiedCells = 0;
+    std::vector<Object> objects;
+    std::vector<SpatialId> freeIds;
+    size_t liveCount = 0;
+
+    glm::ivec3 CellCoords(const glm::vec3& point) const;
+    uint32_t FindCell(const glm::ivec3& coords) const;
+    uint32_t AcquireCell(const glm::ivec3& coords);
+    void ReleaseCell(uint32_t cell);
+    void Link(SpatialId id, uint32_t cell);
+    void Unlink(SpatialId id);
+};
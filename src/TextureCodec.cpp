@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "TextureCodec.hpp"
+#include "MipmapGenerator.hpp"
+#include "JobSystem.hpp"
+
+TextureSupport TextureCodec::support;
+
+namespace {
+// block rows of a level decoded or encoded by one job
+constexpr uint32_t BLOCK_ROWS_PER_JOB = 16;
+
+struct BC7Mode {
+    uint8_t subsets, partitionBits, rotationBits, indexSelectionBits;
+    uint8_t colorBits, alphaBits, endpointPBits, sharedPBits;
+    uint8_t indexBits, index2Bits;
+};
+
+const BC7Mode BC7_MODES[8] = {
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+    {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+    {3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+    {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+    {1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+    {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+    {2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+};
+
+// subset of each pixel, one bit per pixel for two subsets and two bits for three
+const uint16_t BC7_PARTITIONS_2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+const uint32_t BC7_PARTITIONS_3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+// pixels whose index drops its top bit, subset 0 always anchors at pixel 0
+const uint8_t BC7_ANCHORS_2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+const uint8_t BC7_ANCHORS_3A[64] = {
+     3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+     3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+     8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+     3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+};
+
+const uint8_t BC7_ANCHORS_3B[64] = {
+    15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+    15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+    15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+    15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+};
+
+const uint8_t BC7_WEIGHTS_2[4] = {0, 21, 43, 64};
+const uint8_t BC7_WEIGHTS_3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+const uint8_t BC7_WEIGHTS_4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// reads a 128-bit block least significant bit first
+struct BitReader {
+    const uint8_t* data;
+    uint32_t position = 0;
+    uint32_t Read(uint32_t count) {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < count; ++i, ++position) {
+            value |= uint32_t((data[position >> 3] >> (position & 7)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+uint8_t Interpolate(uint32_t e0, uint32_t e1, uint32_t index, uint32_t bits) {
+    const uint8_t* weights = bits == 2 ? BC7_WEIGHTS_2 : bits == 3 ? BC7_WEIGHTS_3 : BC7_WEIGHTS_4;
+    return uint8_t(((64 - weights[index]) * e0 + weights[index] * e1 + 32) >> 6);
+}
+
+void BC4Palette(uint8_t r0, uint8_t r1, uint8_t* palette) {
+    palette[0] = r0;
+    palette[1] = r1;
+    if (r0 > r1) {
+        for (int i = 1; i < 7; ++i) palette[i + 1] = uint8_t(((7 - i) * r0 + i * r1 + 3) / 7);
+    }
+    else {
+        for (int i = 1; i < 5; ++i) palette[i + 1] = uint8_t(((5 - i) * r0 + i * r1 + 2) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+void DecodeBC4Block(const uint8_t* block, uint8_t* out, size_t stride) {
+    uint8_t palette[8];
+    BC4Palette(block[0], block[1], palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) indices |= uint64_t(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i) {
+        out[i * stride] = palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+void EncodeBC4Block(const uint8_t* values, size_t stride, uint8_t* block) {
+    uint8_t low = 255, high = 0;
+    for (int i = 0; i < 16; ++i) {
+        low = std::min(low, values[i * stride]);
+        high = std::max(high, values[i * stride]);
+    }
+    // high first selects the eight step palette
+    block[0] = high;
+    block[1] = low;
+    uint8_t palette[8];
+    BC4Palette(high, low, palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; ++i) {
+        const int value = values[i * stride];
+        uint64_t best = 0;
+        int bestError = 256;
+        for (int entry = 0; entry < 8; ++entry) {
+            const int error = std::abs(value - palette[entry]);
+            if (error < bestError) {
+                bestError = error;
+                best = entry;
+            }
+        }
+        indices |= best << (3 * i);
+    }
+    for (int i = 0; i < 6; ++i) block[2 + i] = uint8_t(indices >> (8 * i));
+}
+
+uint32_t BytesPerPixel(TextureFormat format) {
+    return format == TextureFormat::RG8Unorm ? 2 : 4;
+}
+
+// runs body over the blocks of a width x height level, one job per band of block rows
+template<typename Body>
+void ForEachBlock(uint32_t width, uint32_t height, const Body& body) {
+    const uint32_t blocksWide = (width + 3) / 4;
+    const uint32_t blocksHigh = (height + 3) / 4;
+    const uint32_t jobs = (blocksHigh + BLOCK_ROWS_PER_JOB - 1) / BLOCK_ROWS_PER_JOB;
+    JobSystem::Get().ParallelFor(jobs, [&](size_t job) {
+        const uint32_t end = std::min(blocksHigh, uint32_t(job + 1) * BLOCK_ROWS_PER_JOB);
+        for (uint32_t by = uint32_t(job) * BLOCK_ROWS_PER_JOB; by < end; ++by) {
+            for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+                body(bx, by, size_t(by) * blocksWide + bx);
+            }
+        }
+    });
+}
+
+// decodes one level into tightly packed pixels, edge blocks are clipped
+std::vector<uint8_t> DecodeLevel(const std::vector<uint8_t>& blocks, TextureFormat format, uint32_t width, uint32_t height) {
+    const uint32_t bytesPerPixel = format == TextureFormat::BC5RGUnorm ? 2 : 4;
+    std::vector<uint8_t> pixels(size_t(width) * height * bytesPerPixel);
+    ForEachBlock(width, height, [&](uint32_t bx, uint32_t by, size_t blockIndex) {
+        uint8_t decoded[16 * 4];
+        if (format == TextureFormat::BC5RGUnorm) TextureCodec::DecodeBC5Block(&blocks[16 * blockIndex], decoded);
+        else TextureCodec::DecodeBC7Block(&blocks[16 * blockIndex], decoded);
+        const uint32_t columns = std::min(4u, width - 4 * bx);
+        const uint32_t rows = std::min(4u, height - 4 * by);
+        for (uint32_t y = 0; y < rows; ++y) {
+            std::memcpy(&pixels[(size_t(4 * by + y) * width + 4 * bx) * bytesPerPixel],
+                &decoded[4 * y * bytesPerPixel], columns * bytesPerPixel);
+        }
+    });
+    return pixels;
+}
+
+std::vector<uint8_t> EncodeBC5Level(const std::vector<uint8_t>& rg, uint32_t width, uint32_t height) {
+    const uint32_t blocksWide = (width + 3) / 4;
+    const uint32_t blocksHigh = (height + 3) / 4;
+    std::vector<uint8_t> blocks(size_t(blocksWide) * blocksHigh * 16);
+    ForEachBlock(width, height, [&](uint32_t bx, uint32_t by, size_t blockIndex) {
+        // small mips are padded by repeating their last row and column
+        uint8_t texels[16 * 2];
+        for (uint32_t y = 0; y < 4; ++y) {
+            for (uint32_t x = 0; x < 4; ++x) {
+                const uint32_t sx = std::min(4 * bx + x, width - 1);
+                const uint32_t sy = std::min(4 * by + y, height - 1);
+                texels[2 * (4 * y + x)] = rg[2 * (size_t(sy) * width + sx)];
+                texels[2 * (4 * y + x) + 1] = rg[2 * (size_t(sy) * width + sx) + 1];
+            }
+        }
+        TextureCodec::EncodeBC5Block(texels, &blocks[16 * blockIndex]);
+    });
+    return blocks;
+}
+
+std::vector<uint8_t> ToRG8(const std::vector<uint8_t>& rgba) {
+    std::vector<uint8_t> rg(rgba.size() / 2);
+    for (size_t i = 0; i < rg.size() / 2; ++i) {
+        rg[2 * i] = rgba[4 * i];
+        rg[2 * i + 1] = rgba[4 * i + 1];
+    }
+    return rg;
+}
+}
+
+void TextureCodec::SetSupport(const TextureSupport& support) {
+    TextureCodec::support = support;
+}
+
+const TextureSupport& TextureCodec::Support() {
+    return support;
+}
+
+bool TextureCodec::IsCompressed(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::BC5RGUnorm:
+    case TextureFormat::BC7RGBAUnorm:
+    case TextureFormat::ETC2RGBA8Unorm:
+    case TextureFormat::ASTC4x4Unorm:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TextureCodec::IsSupported(TextureFormat format, uint32_t width, uint32_t height) {
+    // block compressed textures must be made of whole blocks
+    const bool wholeBlocks = width % 4 == 0 && height % 4 == 0;
+    switch (format) {
+    case TextureFormat::RGBA8Unorm:
+    case TextureFormat::RG8Unorm:
+        return true;
+    case TextureFormat::BC5RGUnorm:
+    case TextureFormat::BC7RGBAUnorm:
+        return support.bc && wholeBlocks;
+    case TextureFormat::ETC2RGBA8Unorm:
+        return support.etc2 && wholeBlocks;
+    case TextureFormat::ASTC4x4Unorm:
+        return support.astc && wholeBlocks;
+    default:
+        return false;
+    }
+}
+
+TextureLevelLayout TextureCodec::LevelLayout(TextureFormat format, uint32_t width, uint32_t height) {
+    TextureLevelLayout layout;
+    if (IsCompressed(format)) {
+        // every format we take is 16 bytes per 4x4 block
+        layout.width = (width + 3) & ~3u;
+        layout.height = (height + 3) & ~3u;
+        layout.bytesPerRow = layout.width / 4 * 16;
+        layout.rows = layout.height / 4;
+    }
+    else {
+        layout.width = width;
+        layout.height = height;
+        layout.bytesPerRow = width * BytesPerPixel(format);
+        layout.rows = height;
+    }
+    layout.size = size_t(layout.bytesPerRow) * layout.rows;
+    return layout;
+}
+
+bool TextureCodec::Transcode(ImageData& image) {
+    if (IsSupported(image.format, image.width, image.height)) return true;
+    if (image.format != TextureFormat::BC7RGBAUnorm && image.format != TextureFormat::BC5RGUnorm) {
+        // ETC2 and ASTC are only shipped for devices that sample them natively
+        return false;
+    }
+    const TextureFormat target = image.format == TextureFormat::BC5RGUnorm ? TextureFormat::RG8Unorm : TextureFormat::RGBA8Unorm;
+    image.pixels = DecodeLevel(image.pixels, image.format, image.width, image.height);
+    for (size_t level = 0; level < image.mips.size(); ++level) {
+        const uint32_t width = std::max(1, image.width >> (level + 1));
+        const uint32_t height = std::max(1, image.height >> (level + 1));
+        image.mips[level] = DecodeLevel(image.mips[level], image.format, width, height);
+    }
+    image.format = target;
+    return true;
+}
+
+void TextureCodec::PrepareNormalMap(ImageData& image) {
+    if (image.format != TextureFormat::RGBA8Unorm || image.pixels.empty()) return;
+    if (image.mips.empty()) {
+        ImageData level = image;
+        for (uint32_t mip = 1; mip < MipmapGenerator::MipLevelCount(image.width, image.height); ++mip) {
+            level = MipmapGenerator::Downsample(level);
+            image.mips.push_back(level.pixels);
+        }
+    }
+    // z is rebuilt in the shader, so only x and y are kept
+    const bool bc5 = IsSupported(TextureFormat::BC5RGUnorm, image.width, image.height);
+    image.pixels = ToRG8(image.pixels);
+    if (bc5) image.pixels = EncodeBC5Level(image.pixels, image.width, image.height);
+    for (size_t level = 0; level < image.mips.size(); ++level) {
+        image.mips[level] = ToRG8(image.mips[level]);
+        if (bc5) {
+            const uint32_t width = std::max(1, image.width >> (level + 1));
+            const uint32_t height = std::max(1, image.height >> (level + 1));
+            image.mips[level] = EncodeBC5Level(image.mips[level], width, height);
+        }
+    }
+    image.format = bc5 ? TextureFormat::BC5RGUnorm : TextureFormat::RG8Unorm;
+}
+
+void TextureCodec::DecodeBC7Block(const uint8_t* block, uint8_t* rgba) {
+    uint32_t modeIndex = 0;
+    while (modeIndex < 8 && (block[0] & (1 << modeIndex)) == 0) ++modeIndex;
+    if (modeIndex == 8) {
+        // reserved mode, decoders output transparent black
+        std::memset(rgba, 0, 16 * 4);
+        return;
+    }
+    const BC7Mode& mode = BC7_MODES[modeIndex];
+    BitReader reader{block};
+    reader.Read(modeIndex + 1);
+    const uint32_t partition = reader.Read(mode.partitionBits);
+    const uint32_t rotation = reader.Read(mode.rotationBits);
+    const uint32_t indexSelection = reader.Read(mode.indexSelectionBits);
+
+    const uint32_t endpointCount = 2 * mode.subsets;
+    uint32_t endpoints[6][4];
+    for (uint32_t channel = 0; channel < 3; ++channel) {
+        for (uint32_t e = 0; e < endpointCount; ++e) endpoints[e][channel] = reader.Read(mode.colorBits);
+    }
+    for (uint32_t e = 0; e < endpointCount; ++e) {
+        endpoints[e][3] = mode.alphaBits ? reader.Read(mode.alphaBits) : 255;
+    }
+    uint32_t pBits[6] = {};
+    if (mode.endpointPBits) {
+        for (uint32_t e = 0; e < endpointCount; ++e) pBits[e] = reader.Read(1);
+    }
+    else if (mode.sharedPBits) {
+        for (uint32_t s = 0; s < mode.subsets; ++s) pBits[2 * s] = pBits[2 * s + 1] = reader.Read(1);
+    }
+    const bool hasPBits = mode.endpointPBits || mode.sharedPBits;
+    // expand to 8 bits by replicating the top bits into the bottom
+    for (uint32_t e = 0; e < endpointCount; ++e) {
+        for (uint32_t channel = 0; channel < 4; ++channel) {
+            uint32_t bits = channel < 3 ? mode.colorBits : mode.alphaBits;
+            if (bits == 0) continue;
+            uint32_t value = endpoints[e][channel];
+            if (hasPBits) {
+                value = (value << 1) | pBits[e];
+                ++bits;
+            }
+            value <<= 8 - bits;
+            endpoints[e][channel] = value | (value >> bits);
+        }
+    }
+
+    uint32_t subsets[16];
+    for (uint32_t i = 0; i < 16; ++i) {
+        if (mode.subsets == 2) subsets[i] = (BC7_PARTITIONS_2[partition] >> i) & 1;
+        else if (mode.subsets == 3) subsets[i] = (BC7_PARTITIONS_3[partition] >> (2 * i)) & 3;
+        else subsets[i] = 0;
+    }
+    auto isAnchor = [&](uint32_t i) {
+        if (i == 0) return true;
+        if (mode.subsets == 2) return i == BC7_ANCHORS_2[partition];
+        if (mode.subsets == 3) return i == BC7_ANCHORS_3A[partition] || i == BC7_ANCHORS_3B[partition];
+        return false;
+    };
+    uint32_t indices[16], indices2[16] = {};
+    for (uint32_t i = 0; i < 16; ++i) indices[i] = reader.Read(mode.indexBits - (isAnchor(i) ? 1 : 0));
+    if (mode.index2Bits) {
+        for (uint32_t i = 0; i < 16; ++i) indices2[i] = reader.Read(mode.index2Bits - (i == 0 ? 1 : 0));
+    }
+
+    for (uint32_t i = 0; i < 16; ++i) {
+        const uint32_t* e0 = endpoints[2 * subsets[i]];
+        const uint32_t* e1 = endpoints[2 * subsets[i] + 1];
+        uint32_t colorIndex = indices[i], colorBits = mode.indexBits;
+        uint32_t alphaIndex = indices[i], alphaBits = mode.indexBits;
+        if (mode.index2Bits) {
+            if (indexSelection) {
+                colorIndex = indices2[i];
+                colorBits = mode.index2Bits;
+            }
+            else {
+                alphaIndex = indices2[i];
+                alphaBits = mode.index2Bits;
+            }
+        }
+        uint8_t* out = rgba + 4 * i;
+        for (uint32_t channel = 0; channel < 3; ++channel) {
+            out[channel] = Interpolate(e0[channel], e1[channel], colorIndex, colorBits);
+        }
+        out[3] = mode.alphaBits ? Interpolate(e0[3], e1[3], alphaIndex, alphaBits) : 255;
+        if (rotation) std::swap(out[3], out[rotation - 1]);
+    }
+}
+
+void TextureCodec::DecodeBC5Block(const uint8_t* block, uint8_t* rg) {
+    DecodeBC4Block(block, rg, 2);
+    DecodeBC4Block(block + 8, rg + 1, 2);
+}
+
+void TextureCodec::EncodeBC5Block(const uint8_t* rg, uint8_t* block) {
+    EncodeBC4Block(rg, 2, block);
+    EncodeBC4Block(rg + 1, 2, block + 8);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <cstdint>
+#include "ResourceManager.hpp"
+
+using namespace wgpu;
+
+// texture compression features the device was created with
+struct TextureSupport {
+    bool bc = false;
+    bool etc2 = false;
+    bool astc = false;
+};
+
+// size of one mip level as writeTexture wants it, blocks count as rows for compressed formats
+struct TextureLevelLayout {
+    uint32_t width, height;  // copy extent, rounded up to whole blocks
+    uint32_t bytesPerRow, rows;
+    size_t size;
+};
+
+// Block compressed texture handling: picks what the device can sample directly and
+// transcodes the rest on the CPU. BC7 decodes to RGBA8, BC5 to RG8, normal maps are
+// reduced to two channels and compressed to BC5 when the device supports it.
+class TextureCodec {
+public:
+    // set once at startup before any texture is loaded
+    static void SetSupport(const TextureSupport& support);
+    static const TextureSupport& Support();
+
+    static bool IsCompressed(TextureFormat format);
+    static bool IsSupported(TextureFormat format, uint32_t width, uint32_t height);
+    static TextureLevelLayout LevelLayout(TextureFormat format, uint32_t width, uint32_t height);
+    // leaves image in a format the device can sample, false if there is no way to
+    static bool Transcode(ImageData& image);
+    // builds the mip chain of an RGBA8 normal map and stores it as BC5 or RG8
+    static void PrepareNormalMap(ImageData& image);
+
+    static void DecodeBC7Block(const uint8_t* block, uint8_t* rgba);
+    static void DecodeBC5Block(const uint8_t* block, uint8_t* rg);
+    static void EncodeBC5Block(const uint8_t* rg, uint8_t* block);
+
+private:
+    static TextureSupport support;
+};
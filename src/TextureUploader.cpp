@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "TextureUploader.hpp"
+#include "TextureCodec.hpp"
+
+// copyBufferToTexture wants bytesPerRow in multiples of this, offsets get the same
+constexpr uint64_t COPY_ROW_ALIGNMENT = 256;
+// staging buffers are allocated in chunks of this, larger levels get a buffer of their own
+constexpr uint64_t STAGING_BUFFER_SIZE = 8ull << 20;
+// a batch is submitted early once it has staged this much
+constexpr uint64_t STAGING_BATCH_BYTES = 32ull << 20;
+// mapped buffers kept around for the next batches
+constexpr size_t STAGING_POOL_SIZE = 8;
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void TextureUploader::Initialize(Device device, Queue queue, MipmapGenerator& mipmaps) {
+    this->device = device;
+    this->queue = queue;
+    this->mipmaps = &mipmaps;
+}
+
+void TextureUploader::Terminate() {
+    Flush();
+    // the callbacks point into the batches, they have to fire before those go away
+    while (!inFlight.empty()) Poll();
+    for (auto& staging : freeBuffers) {
+        staging->buffer.destroy();
+        staging->buffer.release();
+    }
+    freeBuffers.clear();
+}
+
+TextureUsageFlags TextureUploader::RequiredUsage(bool generateMips) const {
+    return TextureUsage::CopyDst | (generateMips ? mipmaps->RequiredUsage() : TextureUsage(TextureUsage::None));
+}
+
+void TextureUploader::Upload(Texture texture, const ImageData& image, uint32_t mipLevelCount, bool generateMips) {
+    for (uint32_t level = 0; level <= image.mips.size(); ++level) {
+        StageLevel(texture, level, level == 0 ? image.pixels : image.mips[level - 1], image.format,
+            std::max(1u, uint32_t(image.width) >> level), std::max(1u, uint32_t(image.height) >> level));
+    }
+    if (generateMips) {
+        if (mipmaps->UsesCompute()) {
+            pendingMips.push_back({texture, mipLevelCount});
+        }
+        else {
+            // the CPU chain goes up with the rest of the batch
+            ImageData level = image;
+            for (uint32_t mip = 1; mip < mipLevelCount; ++mip) {
+                level = MipmapGenerator::Downsample(level);
+                StageLevel(texture, mip, level.pixels, level.format, uint32_t(level.width), uint32_t(level.height));
+            }
+        }
+    }
+    if (batch && batch->bytes >= STAGING_BATCH_BYTES) Flush();
+}
+
+void TextureUploader::StageLevel(Texture texture, uint32_t level, const std::vector<uint8_t>& pixels, TextureFormat format,
+    uint32_t width, uint32_t height) {
+    const TextureLevelLayout layout = TextureCodec::LevelLayout(format, width, height);
+    if (pixels.size() < layout.size) {
+        std::cerr << "Texture level " << level << " is smaller than its layout, skipped" << std::endl;
+        return;
+    }
+    const uint32_t stagedRow = uint32_t(AlignUp(layout.bytesPerRow, COPY_ROW_ALIGNMENT));
+    const uint64_t size = uint64_t(stagedRow) * layout.rows;
+    StagingBuffer& staging = Reserve(size);
+    if (staging.mapped == nullptr) return;
+    uint8_t* out = staging.mapped + staging.used;
+    if (stagedRow == layout.bytesPerRow) {
+        std::memcpy(out, pixels.data(), layout.size);
+    }
+    else {
+        for (uint32_t row = 0; row < layout.rows; ++row) {
+            std::memcpy(out + size_t(row) * stagedRow, pixels.data() + size_t(row) * layout.bytesPerRow, layout.bytesPerRow);
+        }
+    }
+    ImageCopyBuffer source;
+    source.buffer = staging.buffer;
+    source.layout.offset = staging.used;
+    source.layout.bytesPerRow = stagedRow;
+    source.layout.rowsPerImage = layout.rows;
+    ImageCopyTexture destination;
+    destination.texture = texture;
+    destination.mipLevel = level;
+    destination.origin = { 0, 0, 0 };
+    destination.aspect = TextureAspect::All;
+    encoder.copyBufferToTexture(source, destination, { layout.width, layout.height, 1 });
+    staging.used += size;
+    batch->bytes += layout.size;
+    ++batch->copies;
+}
+
+TextureUploader::StagingBuffer& TextureUploader::Reserve(uint64_t size) {
+    if (!batch) {
+        batch = std::make_unique<Batch>();
+        batch->start = std::chrono::steady_clock::now();
+        CommandEncoderDescriptor encoderDesc = {};
+        encoderDesc.label = "Texture upload command encoder";
+        encoder = device.createCommandEncoder(encoderDesc);
+    }
+    if (!batch->buffers.empty()) {
+        StagingBuffer& current = *batch->buffers.back();
+        const uint64_t offset = AlignUp(current.used, COPY_ROW_ALIGNMENT);
+        if (offset + size <= current.size) {
+            current.used = offset;
+            return current;
+        }
+    }
+    // the smallest pooled buffer that fits, a new one when none does
+    auto fit = freeBuffers.end();
+    for (auto it = freeBuffers.begin(); it != freeBuffers.end(); ++it) {
+        if ((*it)->size >= size && (fit == freeBuffers.end() || (*it)->size < (*fit)->size)) fit = it;
+    }
+    std::unique_ptr<StagingBuffer> staging;
+    if (fit != freeBuffers.end()) {
+        staging = std::move(*fit);
+        freeBuffers.erase(fit);
+    }
+    else {
+        staging = std::make_unique<StagingBuffer>();
+        staging->size = std::max(AlignUp(size, COPY_ROW_ALIGNMENT), STAGING_BUFFER_SIZE);
+        BufferDescriptor bufferDesc;
+        bufferDesc.label = "texture staging";
+        bufferDesc.size = staging->size;
+        bufferDesc.usage = BufferUsage::MapWrite | BufferUsage::CopySrc;
+        bufferDesc.mappedAtCreation = true;
+        staging->buffer = device.createBuffer(bufferDesc);
+        staging->mapped = static_cast<uint8_t*>(staging->buffer.getMappedRange(0, staging->size));
+    }
+    staging->used = 0;
+    batch->buffers.push_back(std::move(staging));
+    return *batch->buffers.back();
+}
+
+void TextureUploader::Flush() {
+    if (!batch) return;
+    for (auto& staging : batch->buffers) {
+        staging->buffer.unmap();
+        staging->mapped = nullptr;
+    }
+    CommandBufferDescriptor cmdBufferDescriptor = {};
+    cmdBufferDescriptor.label = "Texture upload command buffer";
+    CommandBuffer command = encoder.finish(cmdBufferDescriptor);
+    queue.submit(1, &command);
+    command.release();
+    encoder.release();
+    encoder = nullptr;
+    // the dispatches are queued behind the copies they read
+    for (const PendingMips& pending : pendingMips) {
+        mipmaps->Generate(pending.texture, ImageData(), pending.mipLevelCount);
+    }
+    pendingMips.clear();
+
+    Batch* submitted = batch.get();
+    submitted->workDone = queue.onSubmittedWorkDone([submitted](QueueWorkDoneStatus status) {
+        submitted->done = true;
+        if (status != QueueWorkDoneStatus::Success) return;
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitted->start).count();
+        const double megabytes = submitted->bytes / (1024.0 * 1024.0);
+        std::cout << "Texture upload: " << submitted->copies << " levels, " << megabytes << " MB in "
+            << milliseconds << " ms (" << megabytes / std::max(milliseconds, 1e-3) * 1000.0 << " MB/s)" << std::endl;
+    });
+    inFlight.push_back(std::move(batch));
+}
+
+void TextureUploader::Poll() {
+    device.tick();
+    for (auto& submitted : inFlight) {
+        if (!submitted->done || !submitted->mapCallbacks.empty()) continue;
+        // the GPU is done reading the batch, its buffers can be written again once mapped
+        Batch* owner = submitted.get();
+        for (auto& staging : submitted->buffers) {
+            StagingBuffer* buffer = staging.get();
+            submitted->mapCallbacks.push_back(buffer->buffer.mapAsync(MapMode::Write, 0, buffer->size,
+                [owner, buffer](BufferMapAsyncStatus status) {
+                    if (status == BufferMapAsyncStatus::Success) {
+                        buffer->mapped = static_cast<uint8_t*>(buffer->buffer.getMappedRange(0, buffer->size));
+                    }
+                    ++owner->remapped;
+                }));
+        }
+    }
+    for (auto it = inFlight.begin(); it != inFlight.end();) {
+        Batch& finished = **it;
+        if (!finished.done || finished.remapped < finished.buffers.size()) {
+            ++it;
+            continue;
+        }
+        for (auto& staging : finished.buffers) {
+            // oversized buffers and ones that failed to map aren't kept
+            if (staging->mapped != nullptr && staging->size <= STAGING_BUFFER_SIZE && freeBuffers.size() < STAGING_POOL_SIZE) {
+                freeBuffers.push_back(std::move(staging));
+            }
+            else {
+                staging->buffer.destroy();
+                staging->buffer.release();
+            }
+        }
+        it = inFlight.erase(it);
+    }
+}
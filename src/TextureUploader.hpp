@@ -0,0 +1,63 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "MipmapGenerator.hpp"
+#include "ResourceManager.hpp"
+
+using namespace wgpu;
+
+// Packs texture levels into mapped staging buffers and copies a whole batch with one submit.
+// Rows are padded to the 256 bytes copyBufferToTexture wants. A staging buffer is mapped
+// again once the GPU has finished the batch that read it and goes back into the pool.
+class TextureUploader {
+public:
+    void Initialize(Device device, Queue queue, MipmapGenerator& mipmaps);
+    // waits for batches still in flight, call before the device goes away
+    void Terminate();
+    // usage flags a texture needs to be uploaded here
+    TextureUsageFlags RequiredUsage(bool generateMips) const;
+    // stages the levels image carries and the ones generated for it, they reach the
+    // texture with the next Flush
+    void Upload(Texture texture, const ImageData& image, uint32_t mipLevelCount, bool generateMips);
+    // submits the recorded copies, then the mip generation that reads them
+    void Flush();
+    // recycles the staging buffers of finished batches, call once per frame
+    void Poll();
+
+private:
+    struct StagingBuffer {
+        Buffer buffer;
+        uint64_t size = 0;
+        uint64_t used = 0;
+        uint8_t* mapped = nullptr;
+    };
+    struct Batch {
+        std::vector<std::unique_ptr<StagingBuffer>> buffers;
+        std::vector<std::unique_ptr<BufferMapCallback>> mapCallbacks;
+        std::unique_ptr<QueueWorkDoneCallback> workDone;
+        std::chrono::steady_clock::time_point start;
+        uint64_t bytes = 0;
+        uint32_t copies = 0;
+        bool done = false;
+        size_t remapped = 0;
+    };
+    struct PendingMips {
+        Texture texture;
+        uint32_t mipLevelCount;
+    };
+    Device device;
+    Queue queue;
+    MipmapGenerator* mipmaps = nullptr;
+    CommandEncoder encoder; // null until the batch records its first copy
+    std::unique_ptr<Batch> batch;
+    std::vector<std::unique_ptr<Batch>> inFlight;
+    std::vector<std::unique_ptr<StagingBuffer>> freeBuffers;
+    std::vector<PendingMips> pendingMips;
+
+    void StageLevel(Texture texture, uint32_t level, const std::vector<uint8_t>& pixels, TextureFormat format,
+        uint32_t width, uint32_t height);
+    StagingBuffer& Reserve(uint64_t size);
+};
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cassert>
+#include "TransformBuffer.hpp"
+
+// the buffer starts this large and doubles from there
+constexpr uint32_t MIN_TRANSFORM_CAPACITY = 256;
+// clean slots a write may carry along to save another call, 640 bytes at 80 per slot
+constexpr uint32_t DIRTY_GAP_TRANSFORMS = 8;
+
+void TransformBuffer::Initialize(Device device, Queue queue, BindGroupLayout bindGroupLayout) {
+    this->device = device;
+    this->queue = queue;
+    this->bindGroupLayout = bindGroupLayout;
+    Reserve(MIN_TRANSFORM_CAPACITY);
+}
+
+uint32_t TransformBuffer::Allocate() {
+    if (!freeSlots.empty()) {
+        const uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    transforms.emplace_back();
+    return uint32_t(transforms.size() - 1);
+}
+
+void TransformBuffer::Free(uint32_t slot) {
+    assert(slot < transforms.size());
+    freeSlots.push_back(slot);
+}
+
+void TransformBuffer::Set(uint32_t slot, const ObjectTransforms& transforms) {
+    assert(slot < this->transforms.size());
+    this->transforms[slot] = transforms;
+    dirty.Mark(slot);
+}
+
+void TransformBuffer::Reserve(uint32_t count) {
+    if (count <= capacity) return;
+    capacity = std::max({count, 2 * capacity, MIN_TRANSFORM_CAPACITY});
+    if (buffer) {
+        buffer.destroy();
+        buffer.release();
+        bindGroup.release();
+    }
+    BufferDescriptor bufferDesc;
+    bufferDesc.label = "object transforms data";
+    bufferDesc.size = uint64_t(capacity) * sizeof(ObjectTransforms);
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Storage;
+    bufferDesc.mappedAtCreation = false;
+    buffer = device.createBuffer(bufferDesc);
+
+    BindGroupEntry binding;
+    binding.binding = 0;
+    binding.buffer = buffer;
+    binding.offset = 0;
+    binding.size = bufferDesc.size;
+
+    BindGroupDescriptor bindGroupDesc;
+    bindGroupDesc.layout = bindGroupLayout;
+    bindGroupDesc.entryCount = 1;
+    bindGroupDesc.entries = &binding;
+    bindGroup = device.createBindGroup(bindGroupDesc);
+    // a new buffer starts out empty
+    dirty.MarkAll();
+}
+
+void TransformBuffer::Upload() {
+    Reserve(uint32_t(transforms.size()));
+    dirty.Flush(uint32_t(transforms.size()), DIRTY_GAP_TRANSFORMS, [this](uint32_t first, uint32_t count) {
+        queue.writeBuffer(buffer, uint64_t(first) * sizeof(ObjectTransforms), &transforms[first],
+            size_t(count) * sizeof(ObjectTransforms));
+    });
+}
+
+BindGroup TransformBuffer::GetBindGroup() const {
+    return bindGroup;
+}
+
+void TransformBuffer::Terminate() {
+    buffer.destroy();
+    buffer.release();
+    bindGroup.release();
+}
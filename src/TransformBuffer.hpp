@@ -0,0 +1,36 @@
+#pragma once
+#include <webgpu/webgpu.hpp>
+#include <vector>
+#include "DirtyRanges.hpp"
+#include "Helpers.hpp"
+
+using namespace wgpu;
+
+// The transforms of every object in one storage buffer, bound once per frame. Objects own a
+// slot and the shader finds theirs through the instance index of the draw. Slots are only
+// written when their object moved, and the moved ones go up in as few writes as possible.
+class TransformBuffer {
+public:
+    // bindGroupLayout has the storage buffer at binding 0
+    void Initialize(Device device, Queue queue, BindGroupLayout bindGroupLayout);
+    uint32_t Allocate();
+    void Free(uint32_t slot);
+    void Set(uint32_t slot, const ObjectTransforms& transforms);
+    // writes the dirty ranges, call once per frame before the bind group is used
+    void Upload();
+    BindGroup GetBindGroup() const;
+    void Terminate();
+
+private:
+    Device device;
+    Queue queue;
+    BindGroupLayout bindGroupLayout;
+    Buffer buffer;
+    BindGroup bindGroup;
+    uint32_t capacity = 0;
+    std::vector<ObjectTransforms> transforms;
+    std::vector<uint32_t> freeSlots;
+    DirtyRanges dirty;
+
+    void Reserve(uint32_t count);
+};
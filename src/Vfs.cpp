@@ -0,0 +1,78 @@
+#include <iostream>
+#include "Vfs.hpp"
+#include "Lz4.hpp"
+
+std::vector<std::shared_ptr<const AssetPack>> Vfs::packs;
+
+const uint8_t* VfsFile::Data() const {
+    return data;
+}
+
+size_t VfsFile::Size() const {
+    return size;
+}
+
+bool VfsFile::Packed() const {
+    return pack != nullptr || !storage.empty();
+}
+
+void VfsFile::Close() {
+    pack.reset();
+    loose.Close();
+    std::vector<uint8_t>().swap(storage);
+    data = nullptr;
+    size = 0;
+}
+
+bool Vfs::Mount(const fs::path& packPath) {
+    auto pack = std::make_shared<AssetPack>();
+    if (!pack->Open(packPath)) return false;
+    packs.push_back(std::move(pack));
+    return true;
+}
+
+bool Vfs::Exists(const fs::path& path) {
+    if (!packs.empty()) {
+        const std::string key = AssetPack::Key(path);
+        for (const auto& pack : packs) {
+            if (pack->Find(key) != nullptr) return true;
+        }
+    }
+    std::error_code error;
+    return fs::exists(path, error);
+}
+
+bool Vfs::Open(const fs::path& path, VfsFile& file) {
+    file.Close();
+    if (!packs.empty()) {
+        const std::string key = AssetPack::Key(path);
+        for (auto pack = packs.rbegin(); pack != packs.rend(); ++pack) {
+            const AssetPackEntry* entry = (*pack)->Find(key);
+            if (entry == nullptr) continue;
+            if (entry->compression == PackCompression::None) {
+                file.pack = *pack;
+                file.data = (*pack)->EntryData(*entry);
+                file.size = entry->size;
+                return true;
+            }
+            file.storage.resize(entry->size);
+            if (!Lz4::Decompress((*pack)->EntryData(*entry), entry->storedSize, file.storage.data(), file.storage.size())) {
+                std::cerr << key << ": corrupt pack entry" << std::endl;
+                file.Close();
+                return false;
+            }
+            file.data = file.storage.data();
+            file.size = file.storage.size();
+            return true;
+        }
+    }
+    return OpenLoose(path, file);
+}
+
+bool Vfs::OpenLoose(const fs::path& path, VfsFile& file) {
+    file.Close();
+    if (!file.loose.Open(path)) return false;
+    file.data = file.loose.Data();
+    file.size = file.loose.Size();
+    return true;
+}
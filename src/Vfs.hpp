@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "AssetPack.hpp"
+#include "MappedFile.hpp"
+
+// Contents of a file opened through Vfs: a view into a mounted pack, a mapped loose
+// file or the decompressed bytes of a pack entry
+class VfsFile {
+public:
+    const uint8_t* Data() const;
+    size_t Size() const;
+    // read from a mounted pack rather than from disk
+    bool Packed() const;
+    void Close();
+
+private:
+    friend class Vfs;
+    std::shared_ptr<const AssetPack> pack; // keeps the mapping alive while the view is
+    MappedFile loose;
+    std::vector<uint8_t> storage;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// Asset reads go through here. Mounted packs are searched first, newest mount first,
+// then the loose files on disk, so development keeps working without a pack.
+class Vfs {
+public:
+    // mounts a pack over the loose files, call before the first asset is loaded
+    static bool Mount(const fs::path& packPath);
+    static bool Exists(const fs::path& path);
+    static bool Open(const fs::path& path, VfsFile& file);
+    // the file on disk even when a pack holds one under the same name
+    static bool OpenLoose(const fs::path& path, VfsFile& file);
+
+private:
+    static std::vector<std::shared_ptr<const AssetPack>> packs;
+};
@@ -0,0 +1,183 @@
+// InstanceData, see shaders.wgsl
+struct Instance {
+    row0: vec4f,
+    row1: vec4f,
+    row2: vec4f,
+    color: vec4f
+}
+
+// CullUniforms
+struct CullParams {
+    viewProjection: mat4x4f,
+    planes: array<vec4f, 6>,
+    row0: vec4f,
+    row1: vec4f,
+    row2: vec4f,
+    sphere: vec4f,
+    instanceCount: u32,
+    drawCount: u32
+}
+
+// what drawIndexedIndirect reads
+struct DrawIndexedArgs {
+    indexCount: u32,
+    instanceCount: u32,
+    firstIndex: u32,
+    baseVertex: i32,
+    firstInstance: u32
+}
+
+// survivors counted in the header, one argument set per material range of the level
+struct Draws {
+    visibleCount: atomic<u32>,
+    args: array<DrawIndexedArgs>
+}
+
+// OcclusionStats
+struct Stats {
+    inFrustum: atomic<u32>,
+    earlyDrawn: atomic<u32>,
+    lateDrawn: atomic<u32>,
+    occluded: atomic<u32>
+}
+
+// one set of instances, the early phase fills visibleInstances and draws, the late one the rest
+@group(0) @binding(0) var<uniform> params: CullParams;
+@group(0) @binding(1) var<storage, read> instances: array<Instance>;
+@group(0) @binding(2) var<storage, read_write> visibleInstances: array<u32>;
+@group(0) @binding(3) var<storage, read_write> draws: Draws;
+@group(0) @binding(4) var<storage, read_write> lateVisibleInstances: array<u32>;
+@group(0) @binding(5) var<storage, read_write> lateDraws: Draws;
+// 1 for the instances that passed the late test last frame
+@group(0) @binding(6) var<storage, read_write> instanceVisibility: array<u32>;
+// shared by every set of the frame
+@group(1) @binding(0) var depthPyramid: texture_2d<f32>;
+@group(1) @binding(1) var<storage, read_write> stats: Stats;
+
+var<workgroup> groupInFrustum: atomic<u32>;
+var<workgroup> groupOccluded: atomic<u32>;
+
+fn affine(row0: vec4f, row1: vec4f, row2: vec4f) -> mat4x4f {
+    return transpose(mat4x4f(row0, row1, row2, vec4f(0.0, 0.0, 0.0, 1.0)));
+}
+
+// world space bounding sphere of an instance, xyz centre and w radius
+fn instanceSphere(index: u32) -> vec4f {
+    let instance = instances[index];
+    let model = affine(params.row0, params.row1, params.row2) * affine(instance.row0, instance.row1, instance.row2);
+    let center = (model * vec4f(params.sphere.xyz, 1.0)).xyz;
+    // the largest axis scale keeps the sphere around the geometry under non uniform scale
+    let scale2 = max(dot(model[0].xyz, model[0].xyz), max(dot(model[1].xyz, model[1].xyz), dot(model[2].xyz, model[2].xyz)));
+    return vec4f(center, params.sphere.w * sqrt(scale2));
+}
+
+fn inFrustum(sphere: vec4f) -> bool {
+    for (var i = 0u; i < 6u; i++) {
+        let plane = params.planes[i];
+        if (dot(plane.xyz, sphere.xyz) + plane.w < -sphere.w) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// true when the sphere's box lies behind every depth its screen rectangle covers
+fn occluded(sphere: vec4f) -> bool {
+    var low = vec2f(1.0);
+    var high = vec2f(-1.0);
+    var nearest = 1.0;
+    for (var i = 0u; i < 8u; i++) {
+        let corner = sphere.xyz + sphere.w * vec3f(
+            select(-1.0, 1.0, (i & 1u) != 0u), select(-1.0, 1.0, (i & 2u) != 0u), select(-1.0, 1.0, (i & 4u) != 0u));
+        let clip = params.viewProjection * vec4f(corner, 1.0);
+        // a box reaching behind the camera covers the screen, it can't be hidden
+        if (clip.w <= 0.0) {
+            return false;
+        }
+        let ndc = clip.xyz / clip.w;
+        low = min(low, ndc.xy);
+        high = max(high, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+    // level 0 texels of the rectangle, texture rows run down the screen
+    let size = textureDimensions(depthPyramid, 0);
+    let last = size - vec2u(1u, 1u);
+    let lowUv = clamp(vec2f(low.x, -high.y) * 0.5 + 0.5, vec2f(0.0), vec2f(1.0));
+    let highUv = clamp(vec2f(high.x, -low.y) * 0.5 + 0.5, vec2f(0.0), vec2f(1.0));
+    let lowTexel = min(vec2u(lowUv * vec2f(size)), last);
+    let highTexel = min(vec2u(highUv * vec2f(size)), last);
+    // the level where the rectangle spans two texels at most on either axis
+    let extent = f32(max(highTexel.x - lowTexel.x, highTexel.y - lowTexel.y) + 1u);
+    let level = min(u32(ceil(log2(extent))), textureNumLevels(depthPyramid) - 1u);
+    let levelLast = textureDimensions(depthPyramid, level) - vec2u(1u, 1u);
+    // the last texel of a level also covers the leftovers of odd sizes, see pyramid.wgsl
+    let lowCoords = min(lowTexel >> vec2u(level), levelLast);
+    let highCoords = min(highTexel >> vec2u(level), levelLast);
+    let farthest = max(
+        max(textureLoad(depthPyramid, lowCoords, level).r, textureLoad(depthPyramid, vec2u(highCoords.x, lowCoords.y), level).r),
+        max(textureLoad(depthPyramid, vec2u(lowCoords.x, highCoords.y), level).r, textureLoad(depthPyramid, highCoords, level).r));
+    return nearest > farthest;
+}
+
+// one thread per instance, the ones visible last frame that are still inside the frustum
+// are drawn first and make up the depth the pyramid is built from
+@compute @workgroup_size(64)
+fn cs_cull_early(@builtin(global_invocation_id) id: vec3u) {
+    if (id.x >= params.instanceCount || instanceVisibility[id.x] == 0u || !inFrustum(instanceSphere(id.x))) {
+        return;
+    }
+    visibleInstances[atomicAdd(&draws.visibleCount, 1u)] = id.x;
+}
+
+fn cullLate(index: u32) {
+    let sphere = instanceSphere(index);
+    if (!inFrustum(sphere)) {
+        instanceVisibility[index] = 0u;
+        return;
+    }
+    atomicAdd(&groupInFrustum, 1u);
+    if (occluded(sphere)) {
+        atomicAdd(&groupOccluded, 1u);
+        instanceVisibility[index] = 0u;
+        return;
+    }
+    // the early phase drew it already
+    if (instanceVisibility[index] == 0u) {
+        lateVisibleInstances[atomicAdd(&lateDraws.visibleCount, 1u)] = index;
+    }
+    instanceVisibility[index] = 1u;
+}
+
+// every instance against the pyramid, the visible ones the early phase skipped are drawn
+// after it and all of them decide what the next frame's early phase draws
+@compute @workgroup_size(64)
+fn cs_cull_late(@builtin(global_invocation_id) id: vec3u, @builtin(local_invocation_index) local: u32) {
+    if (id.x < params.instanceCount) {
+        cullLate(id.x);
+    }
+    // one global add per workgroup rather than one per instance
+    workgroupBarrier();
+    if (local == 0u) {
+        atomicAdd(&stats.inFrustum, atomicLoad(&groupInFrustum));
+        atomicAdd(&stats.occluded, atomicLoad(&groupOccluded));
+    }
+}
+
+// a single thread after each phase: every range draws the survivors, the count starts over for the next frame
+@compute @workgroup_size(1)
+fn cs_finish_early() {
+    let count = atomicExchange(&draws.visibleCount, 0u);
+    for (var i = 0u; i < params.drawCount; i++) {
+        draws.args[i].instanceCount = count;
+    }
+    atomicAdd(&stats.earlyDrawn, count);
+}
+
+@compute @workgroup_size(1)
+fn cs_finish_late() {
+    let count = atomicExchange(&lateDraws.visibleCount, 0u);
+    for (var i = 0u; i < params.drawCount; i++) {
+        lateDraws.args[i].instanceCount = count;
+    }
+    atomicAdd(&stats.lateDrawn, count);
+}
@@ -1,7 +1,19 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AssetPack.hpp"
 #include "Renderer.hpp"
 
-int main (int, char**) {
+int main (int argc, char** argv) {
+    // App --pack <pack> <file or directory>... bundles assets for deployment instead of running
+    if (argc >= 2 && std::string(argv[1]) == "--pack") {
+        if (argc < 4) {
+            std::cerr << "usage: " << argv[0] << " --pack <pack> <file or directory>..." << std::endl;
+            return 1;
+        }
+        return AssetPack::Build(argv[2], std::vector<fs::path>(argv + 3, argv + argc)) ? 0 : 1;
+    }
     Renderer renderer;
     renderer.Run();
     return 0;
-}
\ No newline at end of file
+}
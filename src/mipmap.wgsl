@@ -0,0 +1,18 @@
+@group(0) @binding(0) var previousMip: texture_2d<f32>;
+@group(0) @binding(1) var nextMip: texture_storage_2d<rgba8unorm, write>;
+
+// 2x2 box filter, odd edges reuse the last texel like the CPU fallback
+@compute @workgroup_size(8, 8)
+fn cs_main(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(nextMip);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    let last = textureDimensions(previousMip, 0) - vec2u(1u, 1u);
+    let source = id.xy * 2u;
+    let color = textureLoad(previousMip, min(source, last), 0)
+        + textureLoad(previousMip, min(source + vec2u(1u, 0u), last), 0)
+        + textureLoad(previousMip, min(source + vec2u(0u, 1u), last), 0)
+        + textureLoad(previousMip, min(source + vec2u(1u, 1u), last), 0);
+    textureStore(nextMip, id.xy, color * 0.25);
+}
@@ -0,0 +1,44 @@
+// DepthPyramid, level 0 comes from the depth buffer and every level after it from the one above
+@group(0) @binding(0) var depthBuffer: texture_depth_2d;
+@group(0) @binding(1) var previousLevel: texture_2d<f32>;
+@group(0) @binding(2) var nextLevel: texture_storage_2d<r32float, write>;
+
+@compute @workgroup_size(8, 8)
+fn cs_copy(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(nextLevel);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    textureStore(nextLevel, id.xy, vec4f(textureLoad(depthBuffer, id.xy, 0), 0.0, 0.0, 1.0));
+}
+
+fn depthAt(source: vec2u, last: vec2u) -> f32 {
+    return textureLoad(previousLevel, min(source, last), 0).r;
+}
+
+// the farthest of the 2x2 texels below, the last texel of an odd row or column takes the
+// leftover one as well so no depth goes unaccounted for
+@compute @workgroup_size(8, 8)
+fn cs_reduce(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(nextLevel);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    let previousSize = textureDimensions(previousLevel, 0);
+    let last = previousSize - vec2u(1u, 1u);
+    let source = id.xy * 2u;
+    var depth = max(max(depthAt(source, last), depthAt(source + vec2u(1u, 0u), last)),
+        max(depthAt(source + vec2u(0u, 1u), last), depthAt(source + vec2u(1u, 1u), last)));
+    let extraColumn = id.x == size.x - 1u && (previousSize.x & 1u) == 1u;
+    let extraRow = id.y == size.y - 1u && (previousSize.y & 1u) == 1u;
+    if (extraColumn) {
+        depth = max(depth, max(depthAt(source + vec2u(2u, 0u), last), depthAt(source + vec2u(2u, 1u), last)));
+    }
+    if (extraRow) {
+        depth = max(depth, max(depthAt(source + vec2u(0u, 2u), last), depthAt(source + vec2u(1u, 2u), last)));
+    }
+    if (extraColumn && extraRow) {
+        depth = max(depth, depthAt(source + vec2u(2u, 2u), last));
+    }
+    textureStore(nextLevel, id.xy, vec4f(depth, 0.0, 0.0, 1.0));
+}
@@ -5,46 +5,127 @@ struct VertexInput {
     @location(3) uv: vec2f
 };
 
+// VertexLayout::Packed, see PackedVertex
+struct PackedVertexInput {
+    @location(0) position: vec4f,
+    @location(1) normal: vec2f,
+    @location(2) color: vec4f,
+    @location(3) uv: vec2f
+};
+
 struct VertexOutput {
     @builtin(position) position: vec4f,
     @location(0) uv: vec2f,
     @location(1) normal: vec3f,
     @location(2) color: vec3f,
-    @location(3) viewDirection: vec3f
+    @location(3) viewDirection: vec3f,
+    @location(4) tint: vec3f
 };
 
 struct Uniforms {
     view: mat4x4f,
     cameraPos: vec3f,
-    time: f32
+    time: f32,
+    aspect: f32
 }
 
+// ObjectTransforms, the affine model matrix as three rows and the packed vertex quantization
 struct ObjectTransforms {
-    rot: mat4x4f,
-    scale: mat4x4f,
-    trans: mat4x4f
+    row0: vec4f,
+    row1: vec4f,
+    row2: vec4f,
+    quantOffset: vec4f,
+    quantScale: vec4f
+}
+
+struct Material {
+    baseColor: vec4f
+}
+
+// InstanceData, an affine transform inside the mesh's own as three rows
+struct Instance {
+    row0: vec4f,
+    row1: vec4f,
+    row2: vec4f,
+    color: vec4f
 }
 
 @group(0) @binding(0) var<uniform> uUniforms: Uniforms;
 @group(0) @binding(1) var textureSampler: sampler;
-@group(1) @binding(0) var imageTexture: texture_2d<f32>;
-@group(1) @binding(1) var<uniform> uObjTrans: ObjectTransforms;
-@group(1) @binding(2) var normalTexture: texture_2d<f32>;
+// every object's transforms, the draw's first instance picks the object
+@group(1) @binding(0) var<storage, read> objects: array<ObjectTransforms>;
+// only bound for the instanced pipeline, the whole set is placed by instancedObject
+@group(1) @binding(1) var<storage, read> instances: array<Instance>;
+@group(1) @binding(2) var<uniform> instancedObject: ObjectTransforms;
+// instances that survived culling.wgsl, the draw's instance index walks this list
+@group(1) @binding(3) var<storage, read> visibleInstances: array<u32>;
+@group(2) @binding(0) var imageTexture: texture_2d<f32>;
+@group(2) @binding(1) var<uniform> uMaterial: Material;
+@group(2) @binding(2) var normalTexture: texture_2d<f32>;
+
+fn affine(row0: vec4f, row1: vec4f, row2: vec4f) -> mat4x4f {
+    return transpose(mat4x4f(row0, row1, row2, vec4f(0.0, 0.0, 0.0, 1.0)));
+}
 
 @vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
+fn vs_main(in: VertexInput, @builtin(instance_index) objectIndex: u32) -> VertexOutput {
+    let transforms = objects[objectIndex];
+    return transformVertex(in, affine(transforms.row0, transforms.row1, transforms.row2));
+}
+
+// octahedral normal, the lower hemisphere is folded over the diagonals
+fn octDecode(e: vec2f) -> vec3f {
+    var n = vec3f(e, 1.0 - abs(e.x) - abs(e.y));
+    let t = max(-n.z, 0.0);
+    n.x += select(t, -t, n.x >= 0.0);
+    n.y += select(t, -t, n.y >= 0.0);
+    return normalize(n);
+}
+
+fn unpackVertex(in: PackedVertexInput, transforms: ObjectTransforms) -> VertexInput {
+    var vertex: VertexInput;
+    vertex.position = transforms.quantOffset.xyz + in.position.xyz * transforms.quantScale.xyz;
+    vertex.normal = octDecode(in.normal);
+    vertex.color = in.color.rgb;
+    vertex.uv = in.uv;
+    return vertex;
+}
+
+@vertex
+fn vs_main_packed(in: PackedVertexInput, @builtin(instance_index) objectIndex: u32) -> VertexOutput {
+    let transforms = objects[objectIndex];
+    return transformVertex(unpackVertex(in, transforms), affine(transforms.row0, transforms.row1, transforms.row2));
+}
+
+fn instanceVertex(in: VertexInput, instanceIndex: u32) -> VertexOutput {
+    let instance = instances[visibleInstances[instanceIndex]];
+    let model = affine(instancedObject.row0, instancedObject.row1, instancedObject.row2);
+    var out = transformVertex(in, model * affine(instance.row0, instance.row1, instance.row2));
+    out.tint = instance.color.rgb;
+    return out;
+}
+
+@vertex
+fn vs_instanced(in: VertexInput, @builtin(instance_index) instanceIndex: u32) -> VertexOutput {
+    return instanceVertex(in, instanceIndex);
+}
+
+@vertex
+fn vs_instanced_packed(in: PackedVertexInput, @builtin(instance_index) instanceIndex: u32) -> VertexOutput {
+    return instanceVertex(unpackVertex(in, instancedObject), instanceIndex);
+}
+
+fn transformVertex(in: VertexInput, model: mat4x4f) -> VertexOutput {
     //let coords = (position+1.0)*100.0;
     let objectTranslate = vec3f(0.0,0.0,0.0);
 
-    let ratio = 640.0 / 480.0;
+    let ratio = uUniforms.aspect;
     var offset = vec2f(-0.6875, -0.463);
     offset += 0.3 * vec2f(cos(uUniforms.time), sin(uUniforms.time));
     let angle = uUniforms.time;
     let cos1 = cos(angle);
     let sin1 = sin(angle);
 
-    let model = uObjTrans.rot;
-    
     let focalPoint = vec3f(0.0, 0.0, -2.0);
     let viewT = transpose(mat4x4f(
     1.0,  0.0, 0.0, -focalPoint.x,
@@ -71,13 +152,15 @@ fn vs_main(in: VertexInput) -> VertexOutput {
     let position = P*viewT*uUniforms.view*worldPosition;
     let uv = in.uv;
     return VertexOutput(position,
-    uv, in.normal, in.color, view);
+    uv, in.normal, in.color, view, vec3f(1.0));
 }
 
 @fragment
 fn fs_main(in: VertexOutput) -> @location(0) vec4f {
     //let texCoords = vec2i(in.uv * vec2f(textureDimensions(imageTexture)));
-    var color = textureSample(imageTexture, textureSampler, in.uv).rgb;
+    // colour maps with transparency are premultiplied, lighting scales colour and coverage alike
+    let texel = textureSample(imageTexture, textureSampler, in.uv);
+    var color = texel.rgb * uMaterial.baseColor.rgb * in.tint;
     let lightDirection1 = vec3f(0.5, -0.5, 0.1);
     let lightDirection2 = vec3f(0.2, 0.4, 0.3);
     let L = vec3f(0.9, -0.9, 0.1);
@@ -87,8 +170,9 @@ fn fs_main(in: VertexOutput) -> @location(0) vec4f {
     var specular = 0.0;
     
     //let N = in.normal;
-    let encodedN = textureSample(normalTexture, textureSampler, in.uv).rgb;
-    let N = normalize(encodedN - 0.5);
+    // normal maps only store x and y (BC5/RG8), z is rebuilt from the unit length
+    let encodedN = textureSample(normalTexture, textureSampler, in.uv).rg * 2.0 - 1.0;
+    let N = normalize(vec3f(encodedN, sqrt(max(0.0, 1.0 - dot(encodedN, encodedN)))));
     let R = reflect(-L, N);
     let V = normalize(in.viewDirection);
     let RoV = max(0.0, dot(R, V));
@@ -97,5 +181,5 @@ fn fs_main(in: VertexOutput) -> @location(0) vec4f {
     let ambient = 0.05;
     color *= specular+diffuse+ambient;
 
-    return vec4f(color,1.0);
+    return vec4f(color,texel.a);
 }
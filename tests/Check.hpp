@@ -0,0 +1,17 @@
+#pragma once
+#include <iostream>
+
+// Minimal checks for the headless test executables: a failed CHECK reports its line and
+// the executable exits with the number of failures, which ctest turns into a failed test.
+inline int& CheckFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                          \
+    do {                                                                                          \
+        if (!(condition)) {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            ++CheckFailures();                                                                    \
+        }                                                                                         \
+    } while (false)
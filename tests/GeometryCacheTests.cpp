@@ -0,0 +1,96 @@
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include "Check.hpp"
+#include "GeometryCache.hpp"
+
+namespace {
+const fs::path DIRECTORY = fs::temp_directory_path() / "GeometryCacheTests";
+
+GeometryData Triangle() {
+    GeometryData geometry;
+    geometry.vertices.resize(3);
+    for (int i = 0; i < 3; ++i) geometry.vertices[i].position = {float(i), float(i * i), 0.0f};
+    geometry.indices = {0, 1, 2};
+    geometry.submeshes.push_back(Submesh{0, 3, 0});
+    geometry.lods.push_back(MeshLod{0, 1, 0.0f});
+    geometry.materials.resize(1);
+    geometry.bounds.min = glm::vec3(0.0f);
+    geometry.bounds.max = glm::vec3(2.0f, 4.0f, 0.0f);
+    return geometry;
+}
+
+std::vector<uint8_t> ReadFile(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const fs::path& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+}
+
+static void RoundTrip() {
+    const fs::path source = DIRECTORY / "triangle.obj";
+    std::ofstream(source) << "v 0 0 0\n";
+    GeometryCache stored;
+    CHECK(stored.Store(source, Triangle()));
+    GeometryCache loaded;
+    CHECK(loaded.Load(source));
+    CHECK(loaded.VertexCount() == 3 && loaded.IndexCount() == 3 && loaded.Submeshes().size() == 1);
+}
+
+// an offset past the end made size - offset wrap around and let the section be read out of bounds
+static void RejectsOffsetPastEnd() {
+    const fs::path source = DIRECTORY / "offset.obj";
+    std::ofstream(source) << "v 0 0 0\n";
+    GeometryCache stored;
+    CHECK(stored.Store(source, Triangle()));
+    const fs::path cachePath = GeometryCache::CachePath(source);
+    std::vector<uint8_t> bytes = ReadFile(cachePath);
+    CHECK(bytes.size() >= sizeof(GeometryCacheHeader));
+    if (bytes.size() < sizeof(GeometryCacheHeader)) return;
+    GeometryCacheHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(GeometryCacheHeader));
+    header.sectionOffsets[SECTION_SUBMESHES] = (uint64_t(bytes.size()) + (uint64_t(1) << 40)) & ~uint64_t(15);
+    std::memcpy(bytes.data(), &header, sizeof(GeometryCacheHeader));
+    WriteFile(cachePath, bytes);
+    GeometryCache loaded;
+    CHECK(!loaded.Load(source));
+}
+
+// the same model queued twice stores its cache from two jobs at once, neither may lose the
+// other's temporary file between writing and renaming it
+static void ConcurrentStores() {
+    const fs::path source = DIRECTORY / "shared.obj";
+    std::ofstream(source) << "v 0 0 0\n";
+    const GeometryData geometry = Triangle();
+    std::atomic<int> failures(0);
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < 4; ++writer) {
+        writers.emplace_back([&]() {
+            for (int i = 0; i < 50; ++i) {
+                GeometryCache cache;
+                if (!cache.Store(source, geometry)) ++failures;
+            }
+        });
+    }
+    for (std::thread& writer : writers) writer.join();
+    CHECK(failures == 0);
+    GeometryCache loaded;
+    CHECK(loaded.Load(source));
+}
+
+int main() {
+    std::error_code error;
+    fs::remove_all(DIRECTORY, error);
+    fs::create_directories(DIRECTORY);
+    RoundTrip();
+    RejectsOffsetPastEnd();
+    ConcurrentStores();
+    fs::remove_all(DIRECTORY, error);
+    return CheckFailures();
+}
@@ -0,0 +1,48 @@
+#include <cmath>
+#include <vector>
+#include "Check.hpp"
+#include "ImageKernels.hpp"
+
+// colour maps are sampled as RGBA8Unorm, so the shader reads stored / 255 and the blend
+// expects that to be colour times coverage
+static float Sampled(uint8_t stored) {
+    return stored / 255.0f;
+}
+
+static void HalfCoveredWhite() {
+    uint8_t pixel[4] = {255, 255, 255, 128};
+    ImageKernels::PremultiplyAlpha(pixel, 1);
+    CHECK(pixel[0] == 128 && pixel[1] == 128 && pixel[2] == 128 && pixel[3] == 128);
+    CHECK(std::fabs(Sampled(pixel[0]) - 1.0f * Sampled(pixel[3])) <= 0.5f / 255.0f);
+}
+
+// every colour and alpha pair through the SSE2 path in blocks of four and the scalar one alone
+static void AllValues() {
+    std::vector<uint8_t> block;
+    for (int alpha = 0; alpha < 256; ++alpha) {
+        for (int color = 0; color < 256; ++color) {
+            const uint8_t pixel[4] = {uint8_t(color), uint8_t(255 - color), uint8_t(color / 2), uint8_t(alpha)};
+            block.insert(block.end(), pixel, pixel + 4);
+        }
+    }
+    std::vector<uint8_t> single = block;
+    const std::vector<uint8_t> source = block;
+    ImageKernels::PremultiplyAlpha(block.data(), block.size() / 4);
+    for (size_t i = 0; i < single.size() / 4; ++i) ImageKernels::PremultiplyAlpha(single.data() + 4 * i, 1);
+    int mismatches = 0;
+    for (size_t i = 0; i < source.size(); i += 4) {
+        const uint8_t alpha = source[i + 3];
+        for (size_t channel = 0; channel < 3; ++channel) {
+            const long expected = std::lround(source[i + channel] * alpha / 255.0);
+            if (block[i + channel] != expected || single[i + channel] != expected) ++mismatches;
+        }
+        if (block[i + 3] != alpha || single[i + 3] != alpha) ++mismatches;
+    }
+    CHECK(mismatches == 0);
+}
+
+int main() {
+    HalfCoveredWhite();
+    AllValues();
+    return CheckFailures();
+}
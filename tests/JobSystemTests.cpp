@@ -0,0 +1,50 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "Check.hpp"
+#include "JobSystem.hpp"
+
+// a loop waiting on its helpers must not pick up a queued job that blocks, the render thread
+// would otherwise run a whole load or wait on a queue only it drains
+static void ParallelForSkipsUnrelatedJobs() {
+    JobSystem jobs(1);
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<bool> release(false);
+    std::atomic<bool> ranOnCaller(false);
+    auto block = [&]() {
+        if (std::this_thread::get_id() == caller) {
+            ranOnCaller = true;
+            return;
+        }
+        while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    // the first occupies the only worker, the second waits in the queue ahead of the loop's helper
+    auto busy = jobs.Submit(block);
+    auto queued = jobs.Submit(block);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::vector<int> values(1000, 0);
+    jobs.ParallelFor(values.size(), [&](size_t i) { values[i] = int(i); });
+    CHECK(!ranOnCaller);
+    bool complete = true;
+    for (size_t i = 0; i < values.size(); ++i) complete = complete && values[i] == int(i);
+    CHECK(complete);
+    release = true;
+    busy.get();
+    queued.get();
+}
+
+static void NestedParallelFor() {
+    JobSystem jobs(3);
+    std::atomic<size_t> sum(0);
+    jobs.ParallelFor(16, [&](size_t outer) {
+        jobs.ParallelFor(64, [&](size_t inner) { sum += outer * 64 + inner; });
+    });
+    CHECK(sum == 1024 * 1023 / 2);
+}
+
+int main() {
+    ParallelForSkipsUnrelatedJobs();
+    NestedParallelFor();
+    return CheckFailures();
+}